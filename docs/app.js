@@ -1,11 +1,20 @@
 // Main application logic
 class HestonApp {
     constructor() {
-        this.simulation = null;
+        this.engine = null;
+        this.engineType = null;
         this.isRunning = false;
         this.animationId = null;
         this.chart = null;
         this.wasmLoaded = false;
+        this.snapshot = null;
+        this.pendingPaths = null;
+        this.awaitingReset = false;
+        this.requests = new Map();
+        this.nextRequestId = 1;
+        this.exportSink = null;  // Callbacks of the running exportSimulation
+        this.zoom = null;        // { start, end } the chart is zoomed to, or null for the whole run
+        this.dragStart = null;   // Time under the pointer where a zoom drag began
         
         this.initializeElements();
         this.setupEventListeners();
@@ -31,13 +40,29 @@ class HestonApp {
             rho: document.getElementById('rho'),
             T: document.getElementById('T'),
             K: document.getElementById('K'),
-            N: document.getElementById('N')
+            N: document.getElementById('N'),
+            seed: document.getElementById('seed'),
+            percentileMode: document.getElementById('percentileMode'),
+            varianceReduction: document.getElementById('varianceReduction'),
+            tolerance: document.getElementById('tolerance'),
+            scheme: document.getElementById('scheme'),
+            sampling: document.getElementById('sampling'),
+            greeks: document.getElementById('greeks'),
+            payoffStyle: document.getElementById('payoffStyle'),
+            optionType: document.getElementById('optionType'),
+            barrierType: document.getElementById('barrierType'),
+            barrier: document.getElementById('barrier')
         };
         
         // Result elements
         this.results = {
             simulationCount: document.getElementById('simulationCount'),
             hestonPrice: document.getElementById('hestonPrice'),
+            standardError: document.getElementById('standardError'),
+            analyticPrice: document.getElementById('analyticPrice'),
+            delta: document.getElementById('delta'),
+            vega: document.getElementById('vega'),
+            gamma: document.getElementById('gamma'),
             blackScholesPrice: document.getElementById('blackScholesPrice'),
             priceDifference: document.getElementById('priceDifference')
         };
@@ -45,6 +70,7 @@ class HestonApp {
         // Progress elements
         this.progressFill = document.getElementById('progressFill');
         this.progressText = document.getElementById('progressText');
+        this.perfOverlay = document.getElementById('perfOverlay');
     }
 
     setupEventListeners() {
@@ -53,41 +79,244 @@ class HestonApp {
         this.resetBtn.addEventListener('click', () => this.resetSimulation());
         
         this.form.addEventListener('submit', (e) => e.preventDefault());
+
+        // Drag across the chart to zoom into that time window; double-click to zoom out
+        const canvas = document.getElementById('priceChart');
+        canvas.addEventListener('mousedown', (e) => this.dragStart = this.chartTime(e));
+        canvas.addEventListener('mouseup', (e) => {
+            const start = this.dragStart, end = this.chartTime(e);
+            this.dragStart = null;
+            if (start === null || end === null) return;
+            const x = this.chart.scales.x;
+            if (Math.abs(x.getPixelForValue(end) - x.getPixelForValue(start)) >= HestonApp.MIN_ZOOM_DRAG) {
+                this.setZoom({ start: Math.min(start, end), end: Math.max(start, end) });
+            }
+        });
+        canvas.addEventListener('dblclick', () => this.setZoom(null));
     }
 
+    // Time on the chart's x axis under a mouse event, or null outside the plot area
+    chartTime(event) {
+        const chart = this.chart;
+        if (!chart || !chart.chartArea || chart.data.datasets[0].data.length === 0) return null;
+        const rect = chart.canvas.getBoundingClientRect();
+        const px = (event.clientX - rect.left) * chart.width / rect.width;
+        if (px < chart.chartArea.left || px > chart.chartArea.right) return null;
+        return chart.scales.x.getValueForPixel(px);
+    }
+
+    // The engine replays the paths over the new window and answers with a 'paths' message
+    setZoom(zoom) {
+        if (!zoom && !this.zoom) return;
+        this.zoom = zoom;
+        this.engine.postMessage(zoom ? { type: 'zoom', start: zoom.start, end: zoom.end } : { type: 'zoom' });
+    }
+
+    // The engine runs in a dedicated worker and reports progress snapshots; if workers
+    // cannot be created (e.g. pages opened from file://) the same runner runs in-page.
+    // The WebGPU backend is used when the browser has WebGPU, unless ?engine=cpu; ?perf=1
+    // shows the performance counters overlay.
     async loadSimulation() {
+        this.startBtn.disabled = true;
+        const onMessage = (message) => this.handleEngineMessage(message);
+
         try {
-            if (typeof HestonModule !== 'undefined') {
-                const Module = await HestonModule();
-                this.simulation = new WasmSimulation(Module);
-                this.wasmLoaded = true;
-                this.progressText.textContent = "Ready for simulation with WebAssembly.";
-            } else {
-                throw new Error("WebAssembly module not available");
-            }
+            const worker = new Worker('simulation-worker.js');
+            worker.onmessage = (event) => onMessage(event.data);
+            worker.onerror = (error) => console.error("Simulation worker error:", error);
+            this.engine = worker;
         } catch (error) {
-            console.warn("WebAssembly not available, falling back to JavaScript:", error);
-            await this.loadFallback();
-            this.simulation = new HestonSimulationJS();
-            this.wasmLoaded = false;
-            this.progressText.textContent = "WebAssembly not ready. Ready for reduced-speed simulation.";
+            console.warn("Web Workers not available, running the simulation in-page:", error);
+            await this.loadScript('simulation-worker.js');
+            const runner = new SimulationRunner((src) => this.loadScript(src), onMessage);
+            this.engine = { postMessage: (message) => runner.handleMessage(message) };
         }
+
+        const query = new URLSearchParams(window.location.search);
+        const webgpu = typeof navigator !== 'undefined' && !!navigator.gpu && query.get('engine') !== 'cpu';
+        this.showPerf = query.get('perf') === '1';
+        this.perfOverlay.hidden = !this.showPerf;
+        this.engine.postMessage({ type: 'init', webgpu, perf: this.showPerf });
     }
 
-    async loadFallback() {
-        return new Promise((resolve) => {
-            if (window.HestonSimulationJS) {
-                resolve();
-                return;
-            }
-            
+    loadScript(src) {
+        return new Promise((resolve, reject) => {
             const script = document.createElement('script');
-            script.src = 'simulation-fallback.js';
+            script.src = src;
             script.onload = resolve;
+            script.onerror = () => reject(new Error(`Failed to load ${src}`));
             document.head.appendChild(script);
         });
     }
 
+    handleEngineMessage(message) {
+        switch (message.type) {
+            case 'ready':
+                this.engineType = message.engine;
+                this.wasmLoaded = message.engine !== 'js';
+                this.progressText.textContent = this.readyText(message);
+                this.startBtn.disabled = false;
+                break;
+            case 'progress':
+                // Snapshots posted before a reset was processed are stale
+                if (this.awaitingReset) break;
+                this.snapshot = message.snapshot;
+                if (message.snapshot.paths) {
+                    this.pendingPaths = message.snapshot.paths;
+                }
+                if (message.snapshot.status !== 'running') {
+                    this.finishSimulation();
+                }
+                this.scheduleRender();
+                break;
+            case 'paths':
+                if (this.awaitingReset || !this.snapshot) break;
+                this.pendingPaths = message.paths;
+                this.scheduleRender();
+                break;
+            case 'reset':
+                this.awaitingReset = false;
+                break;
+            case 'exportChunk':
+                this.receiveExportChunk(message);
+                break;
+            case 'grid':
+            case 'mlmc':
+            case 'sensitivities':
+            case 'calibration': {
+                const resolve = this.requests.get(message.id);
+                this.requests.delete(message.id);
+                if (resolve) resolve(message.result);
+                break;
+            }
+        }
+    }
+
+    readyText(message) {
+        if (message.engine === 'webgpu') {
+            return "Ready for simulation with WebGPU.";
+        }
+        if (message.engine === 'wasm-mt') {
+            return `Ready for simulation with WebAssembly (${message.threads} threads).`;
+        }
+        if (message.engine === 'wasm') {
+            return "Ready for simulation with WebAssembly.";
+        }
+        return "WebAssembly not ready. Ready for reduced-speed simulation.";
+    }
+
+    // Price a strike x maturity grid with the parameters of the last run
+    priceOptionGrid(strikes, maturities, numPaths) {
+        return this.request({ type: 'priceGrid', strikes, maturities, numPaths });
+    }
+
+    // Multilevel Monte Carlo price of the last run's option; levels use baseSteps * 2^l steps
+    priceMlmc(targetRmse, baseSteps = 4, maxLevel = 10) {
+        return this.request({ type: 'priceMlmc', targetRmse, baseSteps, maxLevel });
+    }
+
+    // Price and dC/d{v0, theta, kappa, xi, rho} of the last run's option by adjoint
+    // differentiation (Milstein and full truncation only)
+    priceSensitivities(numPaths) {
+        return this.request({ type: 'priceSensitivities', numPaths });
+    }
+
+    // Fit v0, theta, kappa, xi and rho to market quotes [{ K, T, price }], holding S0 and r at
+    // the form's values, and copy the fit into the form. With mcPaths > 0 the fit is
+    // refined against the Monte Carlo model at the form's scheme and N.
+    async calibrate(quotes, mcPaths = 0) {
+        const result = await this.request({ type: 'calibrate', params: this.getParameters(), quotes, mcPaths });
+        if (result) {
+            Object.entries(result.params).forEach(([name, value]) => {
+                this.inputs[name].value = value.toPrecision(6);
+            });
+        }
+        return result;
+    }
+
+    // Run the form's parameters with the engine's streaming export and pass each chunk (a
+    // Uint8Array in the format of the README) to onChunk, which may return a promise; the
+    // engine pauses while two chunks are unacknowledged. options are those of
+    // WasmSimulation.exportBegin plus maxPaths. Resolves once the last chunk is handled.
+    exportSimulation(options, onChunk) {
+        return new Promise((resolve, reject) => {
+            if (this.exportSink) {
+                reject(new Error("An export is already running"));
+                return;
+            }
+            this.exportSink = { onChunk, resolve, reject, done: Promise.resolve(), error: null };
+            if (!this.startSimulation({ export: options })) {
+                this.exportSink = null;
+                reject(new Error("The export run could not start"));
+            }
+        });
+    }
+
+    // Export to a file, written chunk by chunk through the File System Access API where the
+    // browser has it, otherwise collected into a Blob and downloaded
+    async saveExport(options, name = 'heston-export.bin') {
+        if (typeof window.showSaveFilePicker === 'function') {
+            const handle = await window.showSaveFilePicker({ suggestedName: name });
+            const file = await handle.createWritable();
+            try {
+                await this.exportSimulation(options, (chunk) => file.write(chunk));
+            } finally {
+                await file.close();
+            }
+            return;
+        }
+        const parts = [];
+        await this.exportSimulation(options, (chunk) => { parts.push(chunk); });
+        const link = document.createElement('a');
+        link.href = URL.createObjectURL(new Blob(parts, { type: 'application/octet-stream' }));
+        link.download = name;
+        link.click();
+        setTimeout(() => URL.revokeObjectURL(link.href), 0);
+    }
+
+    // Hand an export chunk to the sink of exportSimulation, in order, and acknowledge it
+    // once the sink is done with it. A failing sink stops the run; the remaining chunks
+    // are acknowledged unread.
+    receiveExportChunk(message) {
+        const sink = this.exportSink;
+        if (!sink) {
+            if (message.chunk) this.engine.postMessage({ type: 'exportAck' });
+            return;
+        }
+        const chunk = message.chunk;
+        sink.done = sink.done.then(async () => {
+            if (chunk && !sink.error) {
+                try {
+                    await sink.onChunk(chunk);
+                } catch (error) {
+                    sink.error = error;
+                    this.stopSimulation();
+                }
+            }
+            if (chunk) this.engine.postMessage({ type: 'exportAck' });
+        });
+        if (!message.final) return;
+
+        this.exportSink = null;
+        sink.done.then(() => {
+            const error = sink.error || (message.error && new Error(message.error));
+            if (error) {
+                sink.reject(error);
+            } else {
+                sink.resolve();
+            }
+        });
+    }
+
+    // Post a one-off request to the engine; resolves with the result of its reply
+    request(message) {
+        const id = this.nextRequestId++;
+        return new Promise((resolve) => {
+            this.requests.set(id, resolve);
+            this.engine.postMessage({ ...message, id });
+        });
+    }
+
     getParameters() {
         return {
             S0: parseFloat(this.inputs.S0.value),
@@ -99,16 +328,36 @@ class HestonApp {
             rho: parseFloat(this.inputs.rho.value),
             T: parseFloat(this.inputs.T.value),
             K: parseFloat(this.inputs.K.value),
-            N: parseInt(this.inputs.N.value)
+            N: parseInt(this.inputs.N.value),
+            seed: parseInt(this.inputs.seed.value),
+            percentileMode: parseInt(this.inputs.percentileMode.value),
+            varianceReduction: parseInt(this.inputs.varianceReduction.value),
+            tolerance: parseFloat(this.inputs.tolerance.value) || 0,
+            scheme: parseInt(this.inputs.scheme.value),
+            qmcReplicas: parseInt(this.inputs.sampling.value),
+            greeks: this.inputs.greeks.value === '1',
+            payoff: {
+                style: parseInt(this.inputs.payoffStyle.value),
+                put: this.inputs.optionType.value === '1',
+                barrierType: parseInt(this.inputs.barrierType.value),
+                barrier: parseFloat(this.inputs.barrier.value)
+            }
         };
     }
 
     validateParameters() {
         const params = this.getParameters();
         
+        // QE samples the variance distribution itself, so it stays accurate with a few steps
+        const minSteps = params.scheme === HestonApp.SCHEME_QE ? 1 : 100;
         if (params.S0 <= 0 || params.K <= 0 || params.T <= 0 || params.v0 <= 0 || 
-            params.theta <= 0 || params.kappa <= 0 || params.xi <= 0 || params.N < 100) {
-            alert("Please ensure all parameters are positive and N >= 100");
+            params.theta <= 0 || params.kappa <= 0 || params.xi <= 0 || !(params.N >= minSteps)) {
+            alert(`Please ensure all parameters are positive and N >= ${minSteps}`);
+            return false;
+        }
+
+        if (!Number.isSafeInteger(params.seed) || params.seed < 0) {
+            alert("Random seed must be a non-negative integer");
             return false;
         }
         
@@ -117,19 +366,29 @@ class HestonApp {
             return false;
         }
         
+        if (params.payoff.style === HestonApp.PAYOFF_BARRIER && !(params.payoff.barrier > 0)) {
+            alert("Barrier level must be positive");
+            return false;
+        }
+
         return true;
     }
 
-    startSimulation() {
-        if (!this.validateParameters()) return;
+    // extra is merged into the run's parameters (exportSimulation passes export). Returns
+    // whether the run started.
+    startSimulation(extra = {}) {
+        if (!this.engineType || !this.validateParameters()) return false;
         
         this.clearChart();
-        const params = this.getParameters();
-        
-        this.simulation.initializeSimulation(
-            params.S0, params.v0, params.r, params.theta, params.kappa,
-            params.xi, params.rho, params.T, params.K, params.N
-        );
+        this.snapshot = null;
+        this.pendingPaths = null;
+        this.engine.postMessage({
+            type: 'start',
+            params: {
+                ...this.getParameters(), chartPoints: this.chartPoints(),
+                pathCheckpoints: HestonApp.PATH_CHECKPOINTS, ...extra
+            }
+        });
         
         this.isRunning = true;
         this.startBtn.disabled = true;
@@ -137,30 +396,31 @@ class HestonApp {
         this.resetBtn.disabled = true;
         
         Object.values(this.inputs).forEach(input => input.disabled = true);
-        
-        this.updateResults();
-        
-        this.runSimulationLoop();
+        return true;
     }
 
     stopSimulation() {
+        if (this.isRunning) {
+            this.engine.postMessage({ type: 'stop' });
+        }
+    }
+
+    // Called once the engine reports that it is no longer running
+    finishSimulation() {
         this.isRunning = false;
         this.startBtn.disabled = false;
         this.stopBtn.disabled = true;
         this.resetBtn.disabled = false;
         
         Object.values(this.inputs).forEach(input => input.disabled = false);
-        
-        if (this.animationId) {
-            cancelAnimationFrame(this.animationId);
-            this.animationId = null;
-        }
-        
-        this.progressText.textContent = `Simulation stopped at ${this.simulation.getSimulationCount()} runs`;
     }
 
     resetSimulation() {
+        this.engine.postMessage({ type: 'reset' });
+        this.awaitingReset = true;
         this.isRunning = false;
+        this.snapshot = null;
+        this.pendingPaths = null;
         this.startBtn.disabled = false;
         this.stopBtn.disabled = true;
         this.resetBtn.disabled = false;
@@ -174,9 +434,13 @@ class HestonApp {
         
         this.results.simulationCount.textContent = '0';
         this.results.hestonPrice.textContent = '-';
+        this.results.standardError.textContent = '-';
+        this.results.analyticPrice.textContent = '-';
+        HestonApp.GREEKS.forEach(name => this.results[name].textContent = '-');
         this.results.blackScholesPrice.textContent = '-';
         this.results.priceDifference.textContent = '-';
         this.progressFill.style.width = '0%';
+        this.perfOverlay.textContent = '';
         this.progressText.textContent = this.wasmLoaded ? 
             "WebAssembly ready - Ready for high-performance simulation" : 
             "JavaScript fallback ready - Ready to start simulation";
@@ -184,43 +448,66 @@ class HestonApp {
         this.clearChart();
     }
     clearChart() {
+        this.zoom = null;
         if (this.chart) {
-            this.chart.data.labels = [];
-            this.chart.data.datasets = [];
-            if (this.chart.options && this.chart.options.scales && this.chart.options.scales.y) {
-                this.chart.options.scales.y.min = undefined;
-                this.chart.options.scales.y.max = undefined;
-            }
+            this.chart.data.datasets.forEach(dataset => dataset.data = []);
+            this.chart.options.scales.y.min = undefined;
+            this.chart.options.scales.y.max = undefined;
             this.chart.update('none');
         }
     }
 
-    runSimulationLoop() {
-        if (!this.isRunning) return;
-        
-        const batchSize = this.wasmLoaded ? 20 : 5;
-        this.simulation.runSimulationBatch(batchSize);
+    // Min-max decimation keeps two points per pixel column of the plot area
+    chartPoints() {
+        const width = (this.chart && this.chart.chartArea) ? this.chart.chartArea.width :
+            document.getElementById('priceChart').width;
+        return Math.max(4, Math.round(2 * width));
+    }
+
+    // Snapshots arrive from the engine at their own pace; the page draws at most one
+    // per animation frame and never waits on the simulation
+    scheduleRender() {
+        if (this.animationId) return;
+        this.animationId = requestAnimationFrame(() => {
+            this.animationId = null;
+            this.render();
+        });
+    }
+
+    render() {
+        const snapshot = this.snapshot;
+        if (!snapshot) return;
         
-        const count = this.simulation.getSimulationCount();
-        if (count % 1000 === 0 || this.simulation.isTrackingPhase()) {
-            this.updateResults();
-            this.updateProgress();
-            this.updateChart();
+        this.updateResults(snapshot);
+        this.updateProgress(snapshot);
+        if (this.showPerf) {
+            this.updatePerfOverlay(snapshot.perf);
+        }
+        if (this.pendingPaths) {
+            this.updateChart(this.pendingPaths);
+            this.pendingPaths = null;
         }
-        
-        this.animationId = requestAnimationFrame(() => this.runSimulationLoop());
     }
 
-    updateResults() {
-        const count = this.simulation.getSimulationCount();
-        const hestonPrice = this.simulation.getOptionPrice();
-        const bsPrice = this.simulation.getBlackScholesPrice();
-        const difference = hestonPrice - bsPrice;
+    updateResults(snapshot) {
+        const count = snapshot.count;
+        const hestonPrice = snapshot.price;
+        const bsPrice = snapshot.blackScholesPrice;
         
         this.results.simulationCount.textContent = count.toLocaleString();
         this.results.hestonPrice.textContent = hestonPrice.toFixed(4);
-        this.results.blackScholesPrice.textContent = bsPrice.toFixed(4);
-        this.results.priceDifference.textContent = difference.toFixed(4);
+        this.results.standardError.textContent = snapshot.standardError !== null ?
+            snapshot.standardError.toFixed(4) : '-';
+        this.results.analyticPrice.textContent = snapshot.analyticPrice !== null ?
+            snapshot.analyticPrice.toFixed(4) : '-';
+        HestonApp.GREEKS.forEach(name => {
+            const greek = snapshot.greeks && snapshot.greeks[name];
+            this.results[name].textContent = greek ?
+                `${greek.value.toFixed(name === 'gamma' ? 5 : 4)} ± ${greek.standardError.toFixed(name === 'gamma' ? 5 : 4)}` : '-';
+        });
+        // Path-dependent payoffs have no Black-Scholes reference
+        this.results.blackScholesPrice.textContent = bsPrice !== null ? bsPrice.toFixed(4) : '-';
+        this.results.priceDifference.textContent = bsPrice !== null ? (hestonPrice - bsPrice).toFixed(4) : '-';
         
         if (count > 0) {
             this.results.hestonPrice.classList.add('price-update');
@@ -228,66 +515,79 @@ class HestonApp {
         }
     }
 
-    updateProgress() {
-        const count = this.simulation.getSimulationCount();
-        const isTracking = this.simulation.isTrackingPhase();
+    updateProgress(snapshot) {
+        const count = snapshot.count;
         
-        if (isTracking) {
+        if (snapshot.status === 'converged') {
+            this.progressFill.style.width = '100%';
+            this.progressText.textContent = `Target precision reached after ${count.toLocaleString()} runs`;
+        } else if (snapshot.status === 'stopped') {
+            this.progressText.textContent = `Simulation stopped at ${count} runs`;
+        } else if (snapshot.tracking) {
             const progress = (count / 1000) * 100;
             this.progressFill.style.width = `${Math.min(progress, 100)}%`;
             this.progressText.textContent = `Building percentile paths: ${count}/1000`;
         } else {
+            // A run continued from the engine's result cache starts at the cached count
+            const restored = snapshot.restored > 0 ? `, continued from ${snapshot.restored.toLocaleString()}` : '';
             this.progressFill.style.width = '100%';
-            this.progressText.textContent = `Running high-precision simulation: ${count.toLocaleString()} runs`;
+            this.progressText.textContent = `Running high-precision simulation: ${count.toLocaleString()} runs ` +
+                `(${Math.round(snapshot.pathsPerSecond).toLocaleString()} paths/s${restored})`;
         }
     }
 
-    updateChart() {
-        if (this.simulation.isTrackingPhase()) {
-            return;
+    // Where the run's time goes. Engine phase times are summed over threads, so shares are
+    // of their total rather than of the wall time; marshal is the worker's time spent
+    // reading paths out of the engine and packing them for the page.
+    updatePerfOverlay(perf) {
+        if (!perf) return;
+        const ms = (x) => `${x.toFixed(1).padStart(9)} ms`;
+        const rate = (x) => Math.round(x).toLocaleString();
+        const engine = perf.engine || {};
+        const lines = [];
+
+        if (engine.batchMs !== undefined) {
+            const phases = [['RNG', engine.rngMs], ['Step', engine.stepMs], ['Payoff', engine.payoffMs],
+                            ['Percentiles', engine.percentileMs], ['Copy-out', engine.copyOutMs]];
+            const total = phases.reduce((sum, phase) => sum + phase[1], 0) || 1;
+            phases.forEach(([name, time]) => {
+                lines.push(`${name.padEnd(12)}${ms(time)} ${(100 * time / total).toFixed(1).padStart(5)}%`);
+            });
+            lines.push(`${'Batches'.padEnd(12)}${ms(engine.batchMs)}`);
+            lines.push(`Paths/s ${rate(engine.pathsPerSecond)}, steps/s ${rate(engine.stepsPerSecond)}`);
+        } else {
+            lines.push("Engine counters not compiled in (./build.sh --perf)");
         }
+        if (engine.gpuPaths) {
+            lines.push(`${'GPU'.padEnd(12)}${ms(engine.gpuMs)}`, `${'GPU merge'.padEnd(12)}${ms(engine.gpuMergeMs)}`);
+            lines.push(`GPU paths/s ${rate(engine.gpuPathsPerSecond)}`);
+        }
+        lines.push(`${'Marshal'.padEnd(12)}${ms(perf.marshalMs)}`);
+        this.perfOverlay.textContent = lines.join('\n');
+    }
 
-        const N = this.simulation.getTimeSteps();
-        const T = parseFloat(this.inputs.T.value);
-        const timeGrid = Array.from({length: N + 1}, (_, i) => (i * T / N).toFixed(3));
-
-        const datasets = [];
-        const percentiles = [
-            {value: 0, label: '0.1st Percentile', color: 'rgb(220, 53, 69)'},
-            {value: 25, label: '25th Percentile', color: 'rgb(255, 193, 7)'},
-            {value: 50, label: 'Median', color: 'rgb(13, 110, 253)'},
-            {value: 75, label: '75th Percentile', color: 'rgb(102, 16, 242)'},
-            {value: 100, label: '99.9th Percentile', color: 'rgb(25, 135, 84)'}
-        ];
-
-        let allY = [];
-        percentiles.forEach(p => {
-            const path = this.simulation.getPercentilePath(p.value);
-            if (path) {
-                datasets.push({
-                    label: p.label,
-                    data: Array.from(path),
-                    borderColor: p.color,
-                    backgroundColor: p.color + '20',
-                    borderWidth: 2,
-                    fill: false,
-                    pointRadius: 0,
-                    pointHoverRadius: 4
-                });
-                allY = allY.concat(path);
+    // block is in the get_decimated_paths layout: [M, yMin, yMax], then for each
+    // percentile M times followed by M prices, over the whole run or the zoomed window.
+    // The datasets are updated in place.
+    updateChart(block) {
+        const M = block[0];
+        const yMin = block[1];
+        const yMax = block[2];
+
+        this.chart.data.datasets.forEach((dataset, k) => {
+            const offset = 3 + 2 * k * M;
+            const data = new Array(M);
+            for (let i = 0; i < M; i++) {
+                data[i] = { x: block[offset + i], y: block[offset + M + i] };
             }
+            dataset.data = data;
         });
 
-        let yMin = Math.min(...allY);
-        let yMax = Math.max(...allY);
         const margin = (yMax - yMin) * 0.05;
-        yMin -= margin;
-        yMax += margin;
-
-        this.chart.data.labels = timeGrid;
-        this.chart.data.datasets = datasets;
-        this.chart.options.scales.y.min = yMin;
-        this.chart.options.scales.y.max = yMax;
+        this.chart.options.scales.x.min = block[3];
+        this.chart.options.scales.x.max = block[3 + M - 1];
+        this.chart.options.scales.y.min = yMin - margin;
+        this.chart.options.scales.y.max = yMax + margin;
         this.chart.update('none');
     }
 
@@ -299,12 +599,22 @@ class HestonApp {
         this.chart = new Chart(ctx, {
             type: 'line',
             data: {
-                labels: [],
-                datasets: []
+                datasets: HestonApp.PERCENTILE_SERIES.map(p => ({
+                    label: p.label,
+                    data: [],
+                    borderColor: p.color,
+                    backgroundColor: p.color + '20',
+                    borderWidth: 2,
+                    fill: false,
+                    pointRadius: 0,
+                    pointHoverRadius: 4
+                }))
             },
             options: {
                 responsive: false,
                 maintainAspectRatio: false,
+                parsing: false,
+                normalized: true,
                 plugins: {
                     legend: {
                         position: 'top',
@@ -317,6 +627,8 @@ class HestonApp {
                 },
                 scales: {
                     x: {
+                        type: 'linear',
+                        min: 0,
                         display: true,
                         title: {
                             display: true,
@@ -349,65 +661,21 @@ class HestonApp {
     }
 }
 
-// WebAssembly wrapper class
-class WasmSimulation {
-    constructor(module) {
-        this.module = module;
-        this.initializeSimulation = module.cwrap('initialize_simulation', null, 
-            ['number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number']);
-        this.runSimulationBatch = module.cwrap('run_simulation_batch', null, ['number']);
-        this.getSimulationCount = module.cwrap('get_simulation_count', 'number', []);
-        this.getOptionPrice = module.cwrap('get_option_price', 'number', []);
-        this.getBlackScholesPrice = module.cwrap('get_black_scholes_price', 'number', []);
-        this.getPercentilePathPtr = module.cwrap('get_percentile_path', 'number', ['number']);
-        this.getTimeSteps = module.cwrap('get_time_steps', 'number', []);
-        this.isTrackingPhase = module.cwrap('is_tracking_phase', 'number', []);
-    }
-    
-    getPercentilePath(percentile) {
-        const ptr = this.getPercentilePathPtr(percentile);
-        if (ptr === 0) return null;
-        const N = this.getTimeSteps();
-        
-        try {
-            if (this.module.getValue) {
-                const result = [];
-                for (let i = 0; i <= N; i++) {
-                    result.push(this.module.getValue(ptr + (i * 8), 'double'));
-                }
-                return result;
-            }
-            
-            if (this.module.HEAPF64) {
-                const result = [];
-                for (let i = 0; i <= N; i++) {
-                    result.push(this.module.HEAPF64[(ptr >> 3) + i]);
-                }
-                return result;
-            }
-            
-            let memoryBuffer = null;
-            if (this.module.wasmMemory && this.module.wasmMemory.buffer) {
-                memoryBuffer = this.module.wasmMemory.buffer;
-            } else if (this.module.memory && this.module.memory.buffer) {
-                memoryBuffer = this.module.memory.buffer;
-            } else if (this.module.exports && this.module.exports.memory && this.module.exports.memory.buffer) {
-                memoryBuffer = this.module.exports.memory.buffer;
-            }
-            
-            if (memoryBuffer) {
-                const view = new Float64Array(memoryBuffer, ptr, N + 1);
-                return Array.from(view);
-            }
-            
-            return null;
-            
-        } catch (e) {
-            console.error("Error accessing WASM memory:", e);
-            return null;
-        }
-    }
-}
+HestonApp.SCHEME_QE = 2;
+HestonApp.PAYOFF_BARRIER = 3;
+HestonApp.GREEKS = ['delta', 'vega', 'gamma'];
+// Percentile paths are kept as this many (S, v) checkpoints and replayed per zoom window
+HestonApp.PATH_CHECKPOINTS = 64;
+HestonApp.MIN_ZOOM_DRAG = 8;  // Pixels; shorter drags are clicks
+
+// Chart series in the order the engine returns percentile paths
+HestonApp.PERCENTILE_SERIES = [
+    {label: '0.1st Percentile', color: 'rgb(220, 53, 69)'},
+    {label: '25th Percentile', color: 'rgb(255, 193, 7)'},
+    {label: 'Median', color: 'rgb(13, 110, 253)'},
+    {label: '75th Percentile', color: 'rgb(102, 16, 242)'},
+    {label: '99.9th Percentile', color: 'rgb(25, 135, 84)'}
+];
 
 document.addEventListener('DOMContentLoaded', function() {
     new HestonApp();
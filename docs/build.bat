@@ -2,6 +2,9 @@
 
 echo Building Heston model simulation...
 
+rem Build next to the script, so it also works when run from the repository root
+cd /d "%~dp0"
+
 where emcc >nul 2>nul
 if %ERRORLEVEL% neq 0 (
     echo Error: Emscripten not found. Please install Emscripten SDK.
@@ -9,21 +12,40 @@ if %ERRORLEVEL% neq 0 (
     exit /b 1
 )
 
+rem Pass --threads to build the multi-threaded variant (simulation-mt.js), which runs
+rem the fast phase on a web-worker pool and needs a cross-origin isolated page. Pass
+rem --perf to compile in the performance counters shown by the ?perf=1 overlay.
+set OUTPUT=simulation
+set EXPORT_NAME=HestonModule
+set THREAD_FLAGS=
+set PERF_FLAGS=
+for %%A in (%*) do (
+    if "%%A"=="--threads" (
+        set OUTPUT=simulation-mt
+        set EXPORT_NAME=HestonModuleMT
+        set THREAD_FLAGS=-pthread -DHESTON_THREADS -s PTHREAD_POOL_SIZE=navigator.hardwareConcurrency
+    )
+    if "%%A"=="--perf" set PERF_FLAGS=-DHESTON_PERF
+)
+
 emcc heston.c ^
-    -o simulation.js ^
+    -o %OUTPUT%.js ^
     -s WASM=1 ^
-    -s EXPORTED_RUNTIME_METHODS="[\"ccall\", \"cwrap\", \"getValue\", \"setValue\"]" ^
+    -s EXPORTED_RUNTIME_METHODS="[\"ccall\", \"cwrap\", \"getValue\", \"setValue\", \"HEAPF64\", \"HEAPU8\"]" ^
     -s EXPORTED_FUNCTIONS="[\"_malloc\", \"_free\"]" ^
     -s ALLOW_MEMORY_GROWTH=1 ^
     -s MODULARIZE=1 ^
-    -s EXPORT_NAME="HestonModule" ^
+    -s EXPORT_NAME="%EXPORT_NAME%" ^
+    %THREAD_FLAGS% ^
+    %PERF_FLAGS% ^
+    -msimd128 ^
     -O3 ^
     -s SAFE_HEAP=0 ^
     -s ASSERTIONS=0 ^
     -s INITIAL_MEMORY=67108864
 
 if %ERRORLEVEL% equ 0 (
-    echo Build successful! Generated simulation.js and simulation.wasm
+    echo Build successful! Generated %OUTPUT%.js and %OUTPUT%.wasm
 ) else (
     echo Build failed!
     exit /b 1
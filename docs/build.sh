@@ -4,6 +4,9 @@
 
 echo "Building Heston model simulation..."
 
+# Build next to the script, so it also works when run from the repository root
+cd "$(dirname "$0")" || exit 1
+
 # Check if emscripten is available
 if ! command -v emcc &> /dev/null; then
     echo "Error: Emscripten not found. Please install Emscripten SDK."
@@ -11,20 +14,41 @@ if ! command -v emcc &> /dev/null; then
     exit 1
 fi
 
+# Pass --threads to build the multi-threaded variant (simulation-mt.js), which runs
+# the fast phase on a web-worker pool and needs a cross-origin isolated page. Pass
+# --perf to compile in the performance counters shown by the ?perf=1 overlay.
+OUTPUT="simulation"
+EXPORT_NAME="HestonModule"
+THREAD_FLAGS=""
+PERF_FLAGS=""
+for arg in "$@"; do
+    if [ "$arg" == "--threads" ]; then
+        OUTPUT="simulation-mt"
+        EXPORT_NAME="HestonModuleMT"
+        THREAD_FLAGS="-pthread -DHESTON_THREADS -s PTHREAD_POOL_SIZE=navigator.hardwareConcurrency"
+    elif [ "$arg" == "--perf" ]; then
+        PERF_FLAGS="-DHESTON_PERF"
+    fi
+done
+
 # Compile C to WebAssembly
 emcc heston.c \
-    -o simulation.js \
+    -o $OUTPUT.js \
     -s WASM=1 \
-    -s EXPORTED_RUNTIME_METHODS='["ccall", "cwrap"]' \
+    -s EXPORTED_RUNTIME_METHODS='["ccall", "cwrap", "getValue", "setValue", "HEAPF64", "HEAPU8"]' \
+    -s EXPORTED_FUNCTIONS='["_malloc", "_free"]' \
     -s ALLOW_MEMORY_GROWTH=1 \
     -s MODULARIZE=1 \
-    -s EXPORT_NAME="HestonModule" \
+    -s EXPORT_NAME="$EXPORT_NAME" \
+    $THREAD_FLAGS \
+    $PERF_FLAGS \
+    -msimd128 \
     -O3 \
     -s SAFE_HEAP=0 \
     -s ASSERTIONS=0
 
 if [ $? -eq 0 ]; then
-    echo "Build successful! Generated simulation.js and simulation.wasm"
+    echo "Build successful! Generated $OUTPUT.js and $OUTPUT.wasm"
 else
     echo "Build failed!"
     exit 1
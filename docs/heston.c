@@ -2,68 +2,720 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
-#include <time.h>
+#include <stdint.h>
+#include <complex.h>
+#include "heston.h"
+#ifdef __EMSCRIPTEN__
 #include <emscripten/emscripten.h> // For compiling to WebAssembly
+#else
+#define EMSCRIPTEN_KEEPALIVE HESTON_API
+#endif
+#ifdef HESTON_THREADS
+#include <pthread.h> // Built with -pthread (Emscripten web-worker pool or native)
+#endif
+#if defined(HESTON_PERF) && !defined(__EMSCRIPTEN__)
+#include <time.h>
+#endif
+#if defined(__AVX512F__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
 
 // Constants
 #define MAX_PERCENTILE_PATHS 1000
 #define PERCENTILE_TRACKING_LIMIT 1000
+#define MAX_THREADS 64
+#define NUM_PERCENTILES 5
+#define CONFIDENCE_Z 1.959963984540054  // Two-sided 95% normal quantile
+#define CONVERGENCE_MIN_PATHS 1000       // Paths before the tolerance check is trusted
+
+// Percentile modes, VR_* flags, SCHEME_*, PAYOFF_*, GREEK_* and SENS_* indices are in heston.h
+#define NUM_SCHEMES 3        // SCHEME_* values
+#define NUM_PAYOFF_STYLES 5  // PAYOFF_* values
+#define RNG_BLOCK 64  // Normals produced per refill (two per Philox block)
+#define QE_PSI_CRITICAL 1.5       // Switch between the quadratic and exponential branches
+
+// Randomized quasi-Monte Carlo
+#define SOBOL_DIMS 32          // Sobol dimensions, shared out to the first Brownian-bridge points
+#define SOBOL_BITS 32
+#define QMC_MAX_REPLICAS 32    // Independently scrambled copies of the point set
+#define MAX_STAT_GROUPS QMC_MAX_REPLICAS
+
+// Result cache
+#define RESULT_CACHE_SIZE 8  // Runs kept per context
+
+// Streaming export
+#define EXPORT_HEADER_BYTES 64        // Stream header, written ahead of the first chunk
+#define EXPORT_CHUNK_HEADER_BYTES 32  // Header of every chunk
+#define EXPORT_VERSION 1
+#define EXPORT_MAX_CHUNK (1 << 24)    // Samples per chunk, whatever the budget
+
+// Greeks accumulated alongside the price
+#define GREEK_BUMP 0.01  // Relative size of the common-random-numbers bumps
+
+// Calibration bounds of (v0, theta, kappa, xi, rho)
+#define CALIB_MAX_ITERATIONS 100
+#define CALIB_MC_PASSES 2  // Bias-correction passes of the optional Monte Carlo refinement
+static const double CALIB_LOWER[CALIB_PARAMS] = {1e-4, 1e-4, 1e-3, 1e-3, -0.999};
+static const double CALIB_UPPER[CALIB_PARAMS] = {4.0, 4.0, 20.0, 5.0, 0.999};
 
-// Structure to hold a price path
+// Multilevel Monte Carlo
+#define MLMC_MAX_LEVELS 16
+#define MLMC_INITIAL_SAMPLES 1000  // Pilot samples on each newly added level
+
+// Paths advanced together by the SIMD kernel. WASM SIMD128 holds two doubles, so its
+// four lanes run as two interleaved vectors; native builds use AVX2 (-mavx2) or AVX-512,
+// and fall back to two SSE2 lanes otherwise.
+#if defined(__AVX512F__)
+#define SIMD_LANES 8
+#elif defined(__AVX__) || defined(__wasm_simd128__)
+#define SIMD_LANES 4
+#else
+#define SIMD_LANES 2
+#endif
+
+// Hot-path instrumentation for get_perf_stats, compiled in with -DHESTON_PERF. Without it
+// the PERF_* macros expand to nothing, so release builds read no timers.
+#ifdef HESTON_PERF
+static inline double perf_now_ms(void) {
+#ifdef __EMSCRIPTEN__
+    return emscripten_get_now();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1e3 * ts.tv_sec + 1e-6 * ts.tv_nsec;
+#endif
+}
+#define PERF_BEGIN(start) double start = perf_now_ms()
+#define PERF_END(acc, start) ((acc) += perf_now_ms() - (start))
+#define PERF_ADD(acc, n) ((acc) += (n))
+#else
+#define PERF_BEGIN(start)
+#define PERF_END(acc, start)
+#define PERF_ADD(acc, n)
+#endif
+
+// Random number stream on top of a counter-based generator (Philox4x32-10).
+// Every path gets its own substream, so paths can be generated on any thread,
+// in any order, and any position in any stream is reachable in O(1).
 typedef struct {
-    double *path;
+    uint32_t key[2];    // Seed
+    uint64_t stream;    // Substream id (the path index)
+    uint64_t counter;   // Next Philox block to draw within the stream
+    double normals[RNG_BLOCK];
+    int next;           // Next unused entry of normals[]
+    // Quasi-Monte Carlo: when qmc_active, refills copy from the path's precomputed normals
+    // instead of drawing from Philox. The buffer holds 4N doubles: 2N normals plus scratch.
+    int qmc_active;
+    double *qmc_normals;
+    size_t qmc_capacity;
+    size_t qmc_length;
+    size_t qmc_pos;
+#ifdef HESTON_PERF
+    double perf_ms;     // Time spent producing normals, collected by run_slot
+    double perf_draws;  // Normals produced
+#endif
+} RngStream;
+
+// A tracked path is recorded by its substream only; the full path can be replayed from it
+typedef struct {
+    uint64_t path_index;
     double final_price;
 } PricePath;
 
-// Structure to hold simulation state
+// Bump allocator for percentile paths: one contiguous block, reset by rewinding `used`
+typedef struct {
+    double *base;
+    size_t capacity;  // In doubles
+    size_t used;
+} PathArena;
+
+// P² online quantile estimator (Jain & Chlamtac, 1985): five markers, O(1) memory
+typedef struct {
+    double p;      // Target quantile
+    int count;     // Observations seen
+    double q[5];   // Marker heights
+    double n[5];   // Marker positions
+    double np[5];  // Desired marker positions
+    double dn[5];  // Desired position increments per observation
+} P2Quantile;
+
+// Path chosen for one of the percentiles. Only its substream is recorded; the full
+// path is re-simulated into `path` when it is requested, or with path checkpoints only
+// its (S, v) states at the checkpoint steps go to `checkpoints`.
+typedef struct {
+    int has_candidate;
+    uint64_t path_index;
+    double final_price;
+    int built;             // 1 if `path` (or `checkpoints`) holds path `built_index`
+    uint64_t built_index;
+    double *path;          // N+1 doubles from the path arena, NULL with checkpoints
+    double *checkpoints;   // 2 * path_checkpoints doubles from the path arena: S, then v
+} PercentileCandidate;
+
+// Payoff descriptor (PAYOFF_*, OPTION_* and BARRIER_* in heston.h)
+typedef struct {
+    int style;
+    int put;           // 1 for OPTION_PUT
+    int barrier_type;  // PAYOFF_BARRIER only
+    double barrier;
+} PayoffSpec;
+
+// Engine options; setters change `options`, initialize_simulation snapshots them into `active`
+typedef struct {
+    uint64_t seed;  // Runs with the same seed are identical
+    int percentile_mode;
+    int variance_reduction;  // VR_* flags
+    double target_tolerance; // 95% CI half-width at which the run stops (0 = run until stopped)
+    int scheme;              // SCHEME_* discretization
+    int qmc_replicas;        // Scrambled Sobol replicas (0 = pseudo-random sampling)
+    int greeks;              // 1 to estimate delta, vega and gamma from the same paths
+    int path_checkpoints;    // Percentile paths kept as this many (S, v) states (0 = whole paths)
+    PayoffSpec payoff;
+} SimulationOptions;
+
+// Brownian bridge over steps 1..N on unit time: entry i fills point index[i] from its
+// neighbours left[i] - 1 (time 0 when left[i] == 0) and right[i] (Glasserman, 2004)
+typedef struct {
+    int size;
+    int *index, *left, *right;
+    double *left_weight, *right_weight, *std_dev;
+} BrownianBridge;
+
+// Per-step constants of a discretization scheme, computed once per time-step size so
+// the step loops only multiply and add them
+typedef struct {
+    int scheme;
+    double dt, sqrt_dt, half_dt;
+    double r, theta, kappa, xi, rho, rho_bar;
+    double r_dt, kappa_dt;  // r dt, kappa dt
+    double milstein;      // xi^2 / 4 * dt (Milstein correction; 0 otherwise)
+    double qe_decay;      // e^{-kappa dt}
+    double qe_c1, qe_c2;  // Conditional variance of v_{t+dt} is c1 v_t + c2
+    double qe_k0, qe_k1, qe_k2, qe_k3, qe_k4;  // Log-price coefficients (gamma1 = gamma2 = 1/2)
+} StepParams;
+
+// Welford-style running moments of the per-sample payoff Y and control variate X.
+// A sample is one path, or one antithetic pair averaged. Partials merge exactly (Chan et al.).
+typedef struct {
+    double n;
+    double mean_y, mean_x;
+    double m2_y, m2_x;  // Sums of squared deviations from the mean
+    double c_xy;        // Sum of cross deviations
+} PayoffStats;
+
+#ifdef HESTON_PERF
+// Time (ms) per phase and normals drawn, in the PERF_* sense of heston.h
+typedef struct {
+    double rng_ms, step_ms, payoff_ms, copy_out_ms, percentile_ms, batch_ms;
+    double draws;
+} PerfCounters;
+#endif
+
+// Everything a batch accumulates: payoff moments per QMC replica (one group otherwise)
+// and, when enabled, the per-sample Greek contributions in their mean_y/m2_y
+typedef struct {
+    PayoffStats groups[MAX_STAT_GROUPS];
+    PayoffStats greeks[NUM_GREEKS];
+#ifdef HESTON_PERF
+    PerfCounters perf;  // Summed over thread slots like the moments
+#endif
+} RunStats;
+
+// What identifies a run for the result cache: the model and every option that changes its
+// paths or payoffs (the target tolerance only decides when it stops). Runs with equal
+// keys draw the same paths, so one can continue the other.
+typedef struct {
+    double S0, v0, r, theta, kappa, xi, rho, T, K;
+    int N;
+    SimulationOptions options;
+} RunKey;
+
+// A run saved in the result cache. Path p always draws from the same substream, so the
+// sample count is also the offset at which the run's random streams continue.
+typedef struct {
+    int used;
+    uint64_t last_used;  // Cache clock at the last save or restore
+    RunKey key;
+    RunStats stats;
+    int simulation_count;
+    double price, standard_error;
+    double greeks[NUM_GREEKS], greek_errors[NUM_GREEKS];
+    PercentileCandidate candidates[NUM_PERCENTILES];  // Substreams only; paths are replayed
+    P2Quantile quantiles[3];
+} CachedRun;
+
+// Streaming export of the current run (export_begin). One buffer is reused for every
+// chunk: the stream header (ahead of the first chunk only), the chunk header and the
+// chunk's columns, which are filled at offsets sized for a full chunk and packed when the
+// chunk is finished.
 typedef struct {
+    int active;
+    int flags;
+    int value_bytes;   // 4 (float32) or 8 (float64)
+    int columns;       // S_T, and A with EXPORT_PATH_VALUES
+    int path_stride;   // Paths with index % path_stride == 0 are exported (0: none)
+    int path_points;
+    int capacity;      // Samples per chunk, a whole number of batch rounds
+    int max_paths;     // Exported paths a chunk can hold
+    unsigned char *buffer;
+    size_t head;       // Bytes ahead of the chunk header: the stream header, or 0
+    int samples;       // Samples in the open chunk
+    int paths;
+    uint64_t first_path;  // Path index of the open chunk's first sample
+    size_t ready;         // Length of the finished chunk until export_release, else 0
+    double *path_scratch; // N+1 doubles for replayed paths
+} ExportStream;
+
+// Step kernels specialized for one (scheme, payoff style[, antithetic]) combination; see
+// PATH_KERNELS and GROUP_KERNELS. A PathKernel simulates one path and returns its payoff
+// path value, a GroupKernel simulates SIMD_LANES consecutive paths of the run.
+typedef double (*PathKernel)(RngStream *rng, double z_sign, const StepParams *p, double S0, double v0, int N,
+                             const PayoffSpec *payoff, double *S_T, double *W_T);
+typedef void (*GroupKernel)(struct HestonContext *ctx, RngStream *lanes, uint64_t first_path, double *out_S,
+                            double *out_W, double *out_value);
+
+// Everything one simulation owns: parameters, options, RNG streams, accumulators and
+// buffers. Callers hold it through the opaque HestonContext handle of heston.h; the
+// thread pool is the only state shared between contexts.
+struct HestonContext {
     // Parameters
     double S0, v0, r, theta, kappa, xi, rho, T, K;
     int N;
+    StepParams step;  // Per-step constants of the run's scheme and T / N
     
     // Simulation state
     int simulation_count;
     int tracking_phase;  // 1 if still tracking percentiles, 0 if only accumulating payoffs
     
-    // Price tracking for percentiles
+    // Price tracking for percentiles: (path_index, final_price) of the first paths
     PricePath *all_paths;
     int paths_stored;
     
-    // Percentile paths (indices into all_paths after sorting)
-    int min_idx, p25_idx, p50_idx, p75_idx, max_idx;
+    // Percentile paths, one candidate per percentile, replayed into path_arena on demand
+    PercentileCandidate candidates[NUM_PERCENTILES];
+    PathArena path_arena;
+    double *percentile_paths;  // NUM_PERCENTILES * (N+1) doubles carved from path_arena
+    int path_checkpoints;      // Checkpoints per candidate (at most N+1), or 0 for whole paths
+    int percentile_version;    // Bumped whenever any percentile candidate changes
+    double *decimated;         // Chart-resolution copy of the percentile paths
+    size_t decimated_len;
+    double *variance_scratch;  // Reused (N+1)-double buffer for the variance path
+    int variance_scratch_len;
+
+    // Streaming percentiles: P² markers for p25/p50/p75
+    P2Quantile quantiles[3];
+    double *batch_finals;  // Final prices of the current batch, indexed by path
+    double *batch_W;       // Brownian endpoints W_T of the price driver, indexed by path
+    int batch_finals_len;
+    double *batch_values;  // Path values of a path-dependent payoff, indexed by path
+    int batch_values_len;
+    double *batch_greeks;  // NUM_GREEKS contributions per path when Greeks are enabled
+    int batch_greeks_len;
     
     // Option pricing
-    double total_payoffs;
+    RunStats stats;
     double current_option_price;
+    double standard_error;  // Of current_option_price
+    double greeks[NUM_GREEKS];
+    double greek_errors[NUM_GREEKS];
+    int converged;          // 1 once the target tolerance is met; further batches are skipped
     double black_scholes_price;
-} SimulationState;
+    double analytic_price;
+    double control_sigma;  // Matched volatility of the Black-Scholes control variate
+    double control_mean;   // E[X], the undiscounted Black-Scholes price under control_sigma
+
+    SimulationOptions options;
+    SimulationOptions active;
+    PathKernel path_kernel;    // Kernels of the active scheme and payoff, chosen per batch
+    GroupKernel group_kernel;  // NULL when the scheme has no SIMD kernel
+
+    // Random number streams: rng drives the main thread, thread_rng[i] drives worker slot i.
+    // Path p always draws from substream p, whichever slot simulates it.
+    RngStream rng;
+    RngStream thread_rng[MAX_THREADS][SIMD_LANES];
+    int num_threads;
+
+    // Quasi-Monte Carlo
+    BrownianBridge bridge;
+    uint32_t qmc_scramble[QMC_MAX_REPLICAS][SOBOL_DIMS];  // Owen-scrambling seeds
+
+    // Result cache: initialize_simulation saves the run it replaces and continues a saved
+    // run whose key comes back (least recently used entries are evicted first)
+    RunKey run_key;  // Of the current run
+    CachedRun cache[RESULT_CACHE_SIZE];
+    uint64_t cache_clock;
+    int cache_disabled;    // set_result_cache(ctx, 0)
+    int restored_count;    // Samples the current run took over from the cache
+
+    ExportStream export_stream;
+};
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", 2011)
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U
+#define PHILOX_W1 0xBB67AE85U
+
+static inline void philox4x32_10(const uint32_t in[4], const uint32_t key_in[2], uint32_t out[4]) {
+    uint32_t c0 = in[0], c1 = in[1], c2 = in[2], c3 = in[3];
+    uint32_t k0 = key_in[0], k1 = key_in[1];
+
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// Map 64 random bits to a uniform in the open interval (0, 1)
+static inline double uniform_from_bits(uint32_t lo, uint32_t hi) {
+    uint64_t bits = ((uint64_t)hi << 32) | lo;
+    return ((double)(bits >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+// Inverse normal CDF (Acklam's rational approximation, relative error < 1.15e-9)
+static const double ICDF_A[6] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                                  1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+static const double ICDF_B[5] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                                  6.680131188771972e+01, -1.328068155288572e+01};
+static const double ICDF_C[6] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                                 -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+static const double ICDF_D[4] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                                  3.754408661907416e+00};
+#define ICDF_P_LOW 0.02425
+
+static inline double inverse_norm_cdf_tail(double p) {
+    // Lower tail; the upper tail follows by symmetry
+    double q = sqrt(-2.0 * log(p < 0.5 ? p : 1.0 - p));
+    double x = (((((ICDF_C[0] * q + ICDF_C[1]) * q + ICDF_C[2]) * q + ICDF_C[3]) * q + ICDF_C[4]) * q + ICDF_C[5]) /
+               ((((ICDF_D[0] * q + ICDF_D[1]) * q + ICDF_D[2]) * q + ICDF_D[3]) * q + 1.0);
+    return p < 0.5 ? x : -x;
+}
+
+double inverse_norm_cdf(double p) {
+    if (p < ICDF_P_LOW || p > 1.0 - ICDF_P_LOW) {
+        return inverse_norm_cdf_tail(p);
+    }
+    double q = p - 0.5;
+    double r = q * q;
+    return (((((ICDF_A[0] * r + ICDF_A[1]) * r + ICDF_A[2]) * r + ICDF_A[3]) * r + ICDF_A[4]) * r + ICDF_A[5]) * q /
+           (((((ICDF_B[0] * r + ICDF_B[1]) * r + ICDF_B[2]) * r + ICDF_B[3]) * r + ICDF_B[4]) * r + 1.0);
+}
 
-// Global simulation state
-static SimulationState sim_state = {0};
+// Refill the normal block. The central rational approximation runs branch-free over
+// the whole block so it vectorizes; the ~5% of draws in the tails are patched afterwards.
+static void rng_refill(RngStream *rng) {
+    PERF_BEGIN(start);
+    if (rng->qmc_active) {
+        for (int j = 0; j < RNG_BLOCK; j++) {
+            size_t k = rng->qmc_pos + j;
+            rng->normals[j] = k < rng->qmc_length ? rng->qmc_normals[k] : 0.0;
+        }
+        rng->qmc_pos += RNG_BLOCK;
+        rng->next = 0;
+        PERF_END(rng->perf_ms, start);
+        return;
+    }
+
+    PERF_ADD(rng->perf_draws, RNG_BLOCK);
+    double u[RNG_BLOCK];
+    uint32_t ctr[4], out[4];
+    ctr[2] = (uint32_t)rng->stream;
+    ctr[3] = (uint32_t)(rng->stream >> 32);
+
+    for (int j = 0; j < RNG_BLOCK; j += 2) {
+        ctr[0] = (uint32_t)rng->counter;
+        ctr[1] = (uint32_t)(rng->counter >> 32);
+        philox4x32_10(ctr, rng->key, out);
+        u[j] = uniform_from_bits(out[0], out[1]);
+        u[j + 1] = uniform_from_bits(out[2], out[3]);
+        rng->counter++;
+    }
+
+    for (int j = 0; j < RNG_BLOCK; j++) {
+        double q = u[j] - 0.5;
+        double r = q * q;
+        rng->normals[j] = (((((ICDF_A[0] * r + ICDF_A[1]) * r + ICDF_A[2]) * r + ICDF_A[3]) * r + ICDF_A[4]) * r + ICDF_A[5]) * q /
+                          (((((ICDF_B[0] * r + ICDF_B[1]) * r + ICDF_B[2]) * r + ICDF_B[3]) * r + ICDF_B[4]) * r + 1.0);
+    }
+
+    for (int j = 0; j < RNG_BLOCK; j++) {
+        if (u[j] < ICDF_P_LOW || u[j] > 1.0 - ICDF_P_LOW) {
+            rng->normals[j] = inverse_norm_cdf_tail(u[j]);
+        }
+    }
+
+    rng->next = 0;
+    PERF_END(rng->perf_ms, start);
+}
+
+// Seed a stream; the seed is the Philox key, shared by all substreams of a run
+void rng_seed(RngStream *rng, uint64_t seed) {
+    rng->key[0] = (uint32_t)seed;
+    rng->key[1] = (uint32_t)(seed >> 32);
+    rng->stream = 0;
+    rng->counter = 0;
+    rng->next = RNG_BLOCK;
+    rng->qmc_active = 0;
+#ifdef HESTON_PERF
+    rng->perf_ms = 0.0;
+    rng->perf_draws = 0.0;
+#endif
+}
+
+// Jump to normal number `position` of substream `stream` in O(1)
+void rng_seek(RngStream *rng, uint64_t stream, uint64_t position) {
+    rng->qmc_active = 0;
+    rng->stream = stream;
+    rng->counter = position / 2;
+    rng->next = RNG_BLOCK;
+    if (position % 2) {
+        rng_refill(rng);
+        rng->next = 1;
+    }
+}
+
+double normal_random(RngStream *rng) {
+    if (rng->next >= RNG_BLOCK) {
+        rng_refill(rng);
+    }
+    return rng->normals[rng->next++];
+}
+
+// Substream and sign of the normals driving a path (antithetic pairs share a substream)
+static inline uint64_t path_substream(HestonContext *ctx, uint64_t path) {
+    return (ctx->active.variance_reduction & VR_ANTITHETIC) ? path / 2 : path;
+}
+
+static inline double path_sign(HestonContext *ctx, uint64_t path) {
+    return ((ctx->active.variance_reduction & VR_ANTITHETIC) && (path & 1)) ? -1.0 : 1.0;
+}
+
+// Joe & Kuo (2008) primitive polynomials (degree, coefficients) and initial direction
+// numbers for Sobol dimensions 2..SOBOL_DIMS; dimension 1 is van der Corput
+static const struct { int degree; int coeffs; int m[8]; } SOBOL_INIT[SOBOL_DIMS - 1] = {
+    {1, 0, {1}}, {2, 1, {1, 3}}, {3, 1, {1, 3, 1}}, {3, 2, {1, 1, 1}},
+    {4, 1, {1, 1, 3, 3}}, {4, 4, {1, 3, 5, 13}}, {5, 2, {1, 1, 5, 5, 17}},
+    {5, 4, {1, 1, 5, 5, 5}}, {5, 7, {1, 1, 7, 11, 19}}, {5, 11, {1, 1, 5, 1, 1}},
+    {5, 13, {1, 1, 1, 3, 11}}, {5, 14, {1, 3, 5, 5, 31}}, {6, 1, {1, 3, 3, 9, 7, 49}},
+    {6, 13, {1, 1, 1, 15, 21, 21}}, {6, 16, {1, 3, 1, 13, 27, 49}}, {6, 19, {1, 1, 1, 15, 7, 5}},
+    {6, 22, {1, 3, 1, 15, 13, 25}}, {6, 25, {1, 1, 5, 5, 19, 61}}, {7, 1, {1, 3, 7, 11, 23, 15, 103}},
+    {7, 4, {1, 3, 7, 13, 13, 15, 69}}, {7, 7, {1, 1, 3, 13, 7, 35, 63}}, {7, 8, {1, 3, 5, 9, 1, 25, 53}},
+    {7, 14, {1, 3, 1, 13, 9, 35, 107}}, {7, 19, {1, 3, 1, 5, 27, 61, 31}}, {7, 21, {1, 1, 5, 11, 19, 41, 61}},
+    {7, 28, {1, 3, 5, 3, 3, 13, 69}}, {7, 31, {1, 1, 7, 13, 1, 19, 1}}, {7, 32, {1, 3, 7, 5, 13, 19, 59}},
+    {7, 37, {1, 1, 3, 9, 25, 29, 41}}, {7, 41, {1, 3, 5, 13, 23, 1, 55}}, {7, 42, {1, 3, 7, 3, 13, 59, 17}}
+};
+
+static uint32_t sobol_directions[SOBOL_DIMS][SOBOL_BITS];
+static int sobol_ready = 0;
+
+static void sobol_init() {
+    for (int k = 0; k < SOBOL_BITS; k++) {
+        sobol_directions[0][k] = 1u << (SOBOL_BITS - 1 - k);
+    }
+    for (int d = 1; d < SOBOL_DIMS; d++) {
+        int s = SOBOL_INIT[d - 1].degree;
+        int a = SOBOL_INIT[d - 1].coeffs;
+        uint32_t *v = sobol_directions[d];
+        for (int k = 0; k < s; k++) {
+            v[k] = (uint32_t)SOBOL_INIT[d - 1].m[k] << (SOBOL_BITS - 1 - k);
+        }
+        for (int k = s; k < SOBOL_BITS; k++) {
+            v[k] = v[k - s] ^ (v[k - s] >> s);
+            for (int l = 1; l < s; l++) {
+                if ((a >> (s - 1 - l)) & 1) v[k] ^= v[k - l];
+            }
+        }
+    }
+    sobol_ready = 1;
+}
+
+// Point `index` of Sobol dimension d as 32 fraction bits (direct, not Gray-code, order)
+static inline uint32_t sobol_point(uint64_t index, int d) {
+    uint32_t x = 0;
+    for (int k = 0; index && k < SOBOL_BITS; index >>= 1, k++) {
+        if (index & 1) x ^= sobol_directions[d][k];
+    }
+    return x;
+}
+
+static inline uint32_t reverse_bits32(uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// Hash-based nested uniform (Owen) scrambling of a 32-bit fraction (Burley, 2020)
+static inline uint32_t owen_scramble(uint32_t x, uint32_t seed) {
+    x = reverse_bits32(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverse_bits32(x);
+}
 
-// Random number generation (simple LCG)
-static unsigned long rand_seed;
+// Build the bridge schedule for N unit steps; the first entry is the endpoint W(N)
+static int bridge_init(BrownianBridge *b, int N) {
+    if (b->size == N) return 1;
+    free(b->index); free(b->left); free(b->right);
+    free(b->left_weight); free(b->right_weight); free(b->std_dev);
+    memset(b, 0, sizeof(*b));
 
-double simple_random() {
-    rand_seed = (rand_seed * 1103515245 + 12345) & 0x7fffffff;
-    return (double)rand_seed / 0x7fffffff;
+    b->index = (int*)malloc(N * sizeof(int));
+    b->left = (int*)malloc(N * sizeof(int));
+    b->right = (int*)malloc(N * sizeof(int));
+    b->left_weight = (double*)malloc(N * sizeof(double));
+    b->right_weight = (double*)malloc(N * sizeof(double));
+    b->std_dev = (double*)malloc(N * sizeof(double));
+    int *filled = (int*)calloc(N, sizeof(int));
+    if (!b->index || !b->left || !b->right || !b->left_weight || !b->right_weight || !b->std_dev || !filled) {
+        free(filled);
+        return 0;
+    }
+
+    // Point l sits at time l + 1
+    filled[N - 1] = 1;
+    b->index[0] = N - 1;
+    b->left[0] = b->right[0] = 0;
+    b->std_dev[0] = sqrt((double)N);
+    b->left_weight[0] = b->right_weight[0] = 0.0;
+    for (int i = 1, j = 0; i < N; i++) {
+        while (filled[j]) j++;
+        int k = j;
+        while (!filled[k]) k++;
+        int l = j + ((k - 1 - j) >> 1);
+        filled[l] = 1;
+        double t_left = j;  // Time of point j - 1 (0 for the origin)
+        double t_mid = l + 1.0, t_right = k + 1.0;
+        b->index[i] = l;
+        b->left[i] = j;
+        b->right[i] = k;
+        b->left_weight[i] = (t_right - t_mid) / (t_right - t_left);
+        b->right_weight[i] = (t_mid - t_left) / (t_right - t_left);
+        b->std_dev[i] = sqrt((t_mid - t_left) * (t_right - t_mid) / (t_right - t_left));
+        j = k + 1;
+        if (j >= N) j = 0;
+    }
+    free(filled);
+    b->size = N;
+    return 1;
+}
+
+// Turn bridge-ordered normals z into the N unit-variance increments of the path
+static void bridge_increments(const BrownianBridge *b, const double *z, double *path) {
+    int N = b->size;
+    path[N - 1] = b->std_dev[0] * z[0];
+    for (int i = 1; i < N; i++) {
+        int j = b->left[i], k = b->right[i], l = b->index[i];
+        double left = j ? path[j - 1] : 0.0;
+        path[l] = b->left_weight[i] * left + b->right_weight[i] * path[k] + b->std_dev[i] * z[i];
+    }
+    for (int i = N - 1; i >= 1; i--) {
+        path[i] -= path[i - 1];
+    }
 }
 
-double normal_random() {
-    static int has_spare = 0;
-    static double spare;
+// Position rng at the start of `path`'s normals. With QMC on, the path's substream s is
+// point s / R of replica s % R: bridge point i of Brownian motion m (0 = first normal
+// of each step, 1 = second) takes Sobol dimension 2i + m while that exists, the rest
+// come from the substream's Philox draws, and both motions are built by the bridge.
+static void path_seek(HestonContext *ctx, RngStream *rng, uint64_t path) {
+    uint64_t stream = path_substream(ctx, path);
+    rng_seek(rng, stream, 0);
+    int R = ctx->active.qmc_replicas;
+    if (R == 0) return;
+
+    int N = ctx->bridge.size;
+    size_t need = 4 * (size_t)N;
+    if (rng->qmc_capacity < need) {
+        free(rng->qmc_normals);
+        rng->qmc_normals = (double*)malloc(need * sizeof(double));
+        rng->qmc_capacity = rng->qmc_normals ? need : 0;
+        if (!rng->qmc_normals) return;  // Stay on pseudo-random draws
+    }
     
-    if (has_spare) {
-        has_spare = 0;
-        return spare;
+#ifdef HESTON_PERF
+    // The Philox refills below are part of this construction and must count once
+    double start = perf_now_ms(), nested_ms = rng->perf_ms, nested_draws = rng->perf_draws;
+#endif
+    uint64_t point = stream / R;
+    int replica = (int)(stream % R);
+    double *out = rng->qmc_normals;
+    double *z = out + 2 * (size_t)N;
+    double *increments = z + N;
+    for (int m = 0; m < 2; m++) {
+        for (int i = 0; i < N; i++) {
+            int d = 2 * i + m;
+            if (d < SOBOL_DIMS) {
+                uint32_t x = owen_scramble(sobol_point(point, d), ctx->qmc_scramble[replica][d]);
+                z[i] = inverse_norm_cdf((x + 0.5) * (1.0 / 4294967296.0));
+            } else {
+                z[i] = normal_random(rng);
+            }
+        }
+        bridge_increments(&ctx->bridge, z, increments);
+        for (int i = 0; i < N; i++) {
+            out[2 * i + m] = increments[i];
+        }
     }
     
-    has_spare = 1;
-    double u = simple_random();
-    double v = simple_random();
-    double mag = sqrt(-2.0 * log(u));
-    spare = mag * cos(2.0 * M_PI * v);
-    return mag * sin(2.0 * M_PI * v);
+    rng->qmc_active = 1;
+    rng->qmc_length = 2 * (size_t)N;
+    rng->qmc_pos = 0;
+    rng->next = RNG_BLOCK;
+#ifdef HESTON_PERF
+    rng->perf_ms = nested_ms + (perf_now_ms() - start);
+    rng->perf_draws = nested_draws + 2 * (double)N;
+#endif
+}
+
+// Position rng at step `step` of `path` (normal 2 step), as if its first steps had been drawn
+static void path_seek_step(HestonContext *ctx, RngStream *rng, uint64_t path, int step) {
+    path_seek(ctx, rng, path);
+    if (rng->qmc_active) {
+        rng->qmc_pos = 2 * (size_t)step;
+    } else {
+        rng_seek(rng, path_substream(ctx, path), 2 * (uint64_t)step);
+    }
+}
+
+// Prepare the direction numbers, the bridge schedule for N steps and the scrambling
+// seeds, which come from the run's Philox key on a counter range no path substream reaches
+static void qmc_init(HestonContext *ctx, int N) {
+    if (!sobol_ready) sobol_init();
+    if (!bridge_init(&ctx->bridge, N)) {
+        ctx->active.qmc_replicas = 0;
+        return;
+    }
+    for (int g = 0; g < QMC_MAX_REPLICAS; g++) {
+        for (int d = 0; d < SOBOL_DIMS; d += 4) {
+            uint32_t in[4] = {(uint32_t)g, (uint32_t)d, 0xFFFFFFFFu, 0xFFFFFFFFu};
+            philox4x32_10(in, ctx->rng.key, &ctx->qmc_scramble[g][d]);
+        }
+    }
+}
+
+// Statistics group of a path: its QMC replica, or 0 for pseudo-random sampling
+static inline int path_group(HestonContext *ctx, uint64_t path) {
+    int R = ctx->active.qmc_replicas;
+    return R ? (int)(path_substream(ctx, path) % R) : 0;
+}
+
+static inline int stat_groups(HestonContext *ctx) {
+    return ctx->active.qmc_replicas ? ctx->active.qmc_replicas : 1;
 }
 
 // Normal CDF for Black-Scholes
@@ -78,213 +730,2670 @@ double black_scholes_call(double S0, double K, double r, double T, double sigma)
     return S0 * norm_cdf(d1) - K * exp(-r * T) * norm_cdf(d2);
 }
 
-// Simulate a single price path using Milstein scheme
-double* simulate_single_path(double S0, double v0, double r, double theta, double kappa, 
-                            double xi, double rho, double T, int N) {
-    double dt = T / N;
-    double *S = (double*)malloc((N + 1) * sizeof(double));
-    double *v = (double*)malloc((N + 1) * sizeof(double));
+// Complex log(1 + z), keeping precision when |z| is tiny
+static inline double complex clog1p(double complex z) {
+    if (cabs(z) < 1e-4) return z * (1.0 - z * (0.5 - z / 3.0));
+    return clog(1.0 + z);
+}
+
+// Characteristic function of ln(S_T / F) under Heston, in the "little trap" form
+// (Albrecher et al.) that keeps the complex log on its principal branch. beta - d is
+// rewritten as -xi^2 (iu + u^2) / (beta + d) so small xi does not cancel.
+static double complex heston_cf(double complex u, double v0, double theta, double kappa,
+                                double xi, double rho, double T) {
+    double complex iu = I * u;
+    double complex a = iu + u * u;
+    double complex beta = kappa - rho * xi * iu;
+    double complex d = csqrt(beta * beta + xi * xi * a);
+    double complex r_minus = -a / (beta + d); // (beta - d) / xi^2
+    double complex g = xi * xi * r_minus / (beta + d);
+    double complex e = cexp(-d * T);
+    double complex C = kappa * theta *
+                       (r_minus * T - (2.0 / (xi * xi)) * clog1p(g * (1.0 - e) / (1.0 - g)));
+    double complex D = r_minus * (1.0 - e) / (1.0 - g * e);
+    return cexp(C + D * v0);
+}
+
+// heston_cf and its gradient with respect to (v0, theta, kappa, xi, rho), by forward
+// differentiation of the same little-trap expressions; grad gets CALIB_PARAMS entries
+static double complex heston_cf_grad(double complex u, double v0, double theta, double kappa,
+                                     double xi, double rho, double T, double complex *grad) {
+    double complex iu = I * u;
+    double complex a = iu + u * u;
+    double complex beta = kappa - rho * xi * iu;
+    double complex d = csqrt(beta * beta + xi * xi * a);
+    double complex bd = beta + d;
+    double complex r_minus = -a / bd;
+    double complex g = xi * xi * r_minus / bd;
+    double complex e = cexp(-d * T);
+    double complex q = g * (1.0 - e) / (1.0 - g);
+    double complex L = clog1p(q);
+    double complex C = kappa * theta * (r_minus * T - (2.0 / (xi * xi)) * L);
+    double complex D = r_minus * (1.0 - e) / (1.0 - g * e);
+    double complex phi = cexp(C + D * v0);
+
+    grad[0] = phi * D;
+    grad[1] = phi * C / theta;
+    // kappa, xi, rho act through beta (and xi also directly)
+    for (int k = 0; k < 3; k++) {
+        double dkappa = k == 0, dxi = k == 1;
+        double complex dbeta = k == 0 ? 1.0 : (k == 1 ? -rho * iu : -xi * iu);
+        double complex dd = (beta * dbeta + xi * dxi * a) / d;
+        double complex dbd = dbeta + dd;
+        double complex dr = a * dbd / (bd * bd);
+        double complex dg = (2.0 * xi * dxi * r_minus + xi * xi * dr) / bd - g * dbd / bd;
+        double complex de = -T * dd * e;
+        double complex dq = (dg * (1.0 - e) - g * de) / (1.0 - g) + q * dg / (1.0 - g);
+        double complex dL = dq / (1.0 + q);
+        double complex dC = dkappa * theta * (r_minus * T - (2.0 / (xi * xi)) * L) +
+                            kappa * theta * (dr * T - (2.0 / (xi * xi)) * dL + (4.0 * dxi / (xi * xi * xi)) * L);
+        double complex dD = (dr * (1.0 - e) - r_minus * de) / (1.0 - g * e) +
+                            D * (dg * e + g * de) / (1.0 - g * e);
+        grad[2 + k] = phi * (dC + dD * v0);
+    }
+    return phi;
+}
+
+// 8-point Gauss-Legendre nodes and weights on [-1, 1] (symmetric halves)
+static const double GL_NODES[4] = {0.1834346424956498, 0.5255324099163290,
+                                   0.7966664774136267, 0.9602898564975363};
+static const double GL_WEIGHTS[4] = {0.3626837833783620, 0.3137066458778873,
+                                     0.2223810344533745, 0.1012285362903763};
+
+// Lewis integrand Re[e^{iux} phi(u - i/2)] / (u^2 + 1/4)
+static inline double lewis_integrand(double u, double x, double v0, double theta, double kappa,
+                                     double xi, double rho, double T) {
+    double complex phi = heston_cf(u - 0.5 * I, v0, theta, kappa, xi, rho, T);
+    return creal(cexp(I * u * x) * phi) / (u * u + 0.25);
+}
+
+// Semi-analytic Heston European call via the Lewis (2000) single-integral formula,
+// integrated with composite Gauss-Legendre panels until the tail is negligible
+EMSCRIPTEN_KEEPALIVE
+double heston_analytic_call(double S0, double v0, double r, double theta, double kappa,
+                            double xi, double rho, double T, double K) {
+    if (T <= 0.0) return fmax(S0 - K, 0.0);
+    if (xi < 1e-8) {
+        // Deterministic variance: Black-Scholes at the integrated variance
+        double kT = kappa * T;
+        double avg_variance = theta + (v0 - theta) * (kT > 1e-12 ? (1.0 - exp(-kT)) / kT : 1.0);
+        return black_scholes_call(S0, K, r, T, sqrt(fmax(avg_variance, 1e-12)));
+    }
+
+    double x = log(S0 / K) + r * T;
+    // Panels widen with distance from the integrand's poles at u = +-i/2, capped so
+    // each panel spans at most about one oscillation of e^{iux}
+    const double max_width = fmin(4.0, 6.0 / (fabs(x) + 1.0));
+    const int max_panels = 4000;
+    double integral = 0.0;
+    double a = 0.0;
+    int quiet_panels = 0;
+    for (int p = 0; p < max_panels && quiet_panels < 2; p++) {
+        double width = fmin(0.25 + 0.5 * a, max_width);
+        double mid = a + 0.5 * width;
+        double half = 0.5 * width;
+        double panel = 0.0;
+        for (int k = 0; k < 4; k++) {
+            double offset = half * GL_NODES[k];
+            panel += GL_WEIGHTS[k] * (lewis_integrand(mid - offset, x, v0, theta, kappa, xi, rho, T) +
+                                      lewis_integrand(mid + offset, x, v0, theta, kappa, xi, rho, T));
+        }
+        panel *= half;
+        integral += panel;
+        a += width;
+        quiet_panels = fabs(panel) < 1e-14 * fmax(fabs(integral), 1e-300) ? quiet_panels + 1 : 0;
+    }
+
+    double price = S0 - sqrt(S0 * K) * exp(-0.5 * r * T) * integral / M_PI;
+    // Clamp round-off into the no-arbitrage bounds
+    return fmin(fmax(price, fmax(S0 - K * exp(-r * T), 0.0)), S0);
+}
+
+// Lewis prices of `count` strikes sharing maturity T under params (v0, theta, kappa, xi,
+// rho), with their gradients in jac[CALIB_PARAMS * j ..]. Every characteristic function
+// value (and gradient) at a quadrature node is shared by all the strikes; the panels are
+// those of heston_analytic_call for the widest |x| among them. Prices are not clamped.
+// work holds (2 + CALIB_PARAMS) * count doubles.
+static void lewis_maturity_slice(const double *params, double S0, double r, double T, const double *strikes,
+                                 int count, double *prices, double *jac, double *work) {
+    double *x = work;
+    double *integral = x + count;
+    double *dintegral = integral + count;  // CALIB_PARAMS per strike
+    double max_x = 0.0;
+    for (int j = 0; j < count; j++) {
+        x[j] = log(S0 / strikes[j]) + r * T;
+        max_x = fmax(max_x, fabs(x[j]));
+        integral[j] = 0.0;
+    }
+    memset(dintegral, 0, (size_t)CALIB_PARAMS * count * sizeof(double));
+
+    const double max_width = fmin(4.0, 6.0 / (max_x + 1.0));
+    const int max_panels = 4000;
+    double total = 0.0;
+    double a = 0.0;
+    int quiet_panels = 0;
+    for (int p = 0; p < max_panels && quiet_panels < 2; p++) {
+        double width = fmin(0.25 + 0.5 * a, max_width);
+        double half = 0.5 * width;
+        double bound = 0.0;  // Largest possible contribution of this panel to any strike
+        for (int n = 0; n < 8; n++) {
+            double offset = half * GL_NODES[n % 4];
+            double u = a + half + (n < 4 ? -offset : offset);
+            double w = half * GL_WEIGHTS[n % 4] / (u * u + 0.25);
+            double complex grad[CALIB_PARAMS];
+            double complex phi = heston_cf_grad(u - 0.5 * I, params[0], params[1], params[2],
+                                                params[3], params[4], T, grad);
+            bound += w * cabs(phi);
+            for (int j = 0; j < count; j++) {
+                double complex rot = cexp(I * u * x[j]);
+                integral[j] += w * creal(rot * phi);
+                for (int k = 0; k < CALIB_PARAMS; k++) {
+                    dintegral[CALIB_PARAMS * j + k] += w * creal(rot * grad[k]);
+                }
+            }
+        }
+        total += bound;
+        a += width;
+        quiet_panels = bound < 1e-14 * total ? quiet_panels + 1 : 0;
+    }
+
+    for (int j = 0; j < count; j++) {
+        double scale = sqrt(S0 * strikes[j]) * exp(-0.5 * r * T) / M_PI;
+        prices[j] = S0 - scale * integral[j];
+        for (int k = 0; k < CALIB_PARAMS; k++) {
+            jac[CALIB_PARAMS * j + k] = -scale * dintegral[CALIB_PARAMS * j + k];
+        }
+    }
+}
+
+void step_params_init(StepParams *p, int scheme, double r, double theta, double kappa,
+                      double xi, double rho, double dt) {
+    // QE divides by xi; with (almost) deterministic variance full truncation is exact enough
+    if (scheme == SCHEME_QE && xi < 1e-6) scheme = SCHEME_FULL_TRUNCATION;
+
+    p->scheme = scheme;
+    p->dt = dt;
+    p->sqrt_dt = sqrt(dt);
+    p->half_dt = 0.5 * dt;
+    p->r = r;
+    p->theta = theta;
+    p->kappa = kappa;
+    p->xi = xi;
+    p->rho = rho;
+    p->rho_bar = sqrt(1 - rho * rho);
+    p->r_dt = r * dt;
+    p->kappa_dt = kappa * dt;
+    p->milstein = scheme == SCHEME_MILSTEIN ? (xi * xi / 4.0) * dt : 0.0;
+
+    double e = exp(-kappa * dt);
+    double one_minus_e = kappa * dt > 1e-8 ? 1.0 - e : kappa * dt;
+    double k_safe = kappa > 1e-12 ? kappa : 1e-12;
+    p->qe_decay = e;
+    p->qe_c1 = xi * xi * e * one_minus_e / k_safe;
+    p->qe_c2 = theta * xi * xi * one_minus_e * one_minus_e / (2.0 * k_safe);
+    if (scheme == SCHEME_QE) {
+        p->qe_k0 = -rho * kappa * theta * dt / xi;
+        p->qe_k1 = 0.5 * dt * (kappa * rho / xi - 0.5) - rho / xi;
+        p->qe_k2 = 0.5 * dt * (kappa * rho / xi - 0.5) + rho / xi;
+        p->qe_k3 = 0.5 * dt * (1 - rho * rho);
+        p->qe_k4 = p->qe_k3;
+    }
+}
+
+// Andersen's QE draw of v_{t+dt} given v_t: a scaled noncentral chi-square matched by a
+// squared normal when the distribution is concentrated (psi <= 1.5), otherwise a point
+// mass at zero plus an exponential tail, sampled by inverting its CDF at Phi(z)
+static inline double qe_variance_step(const StepParams *p, double v, double z) {
+    double m = p->theta + (v - p->theta) * p->qe_decay;
+    double s2 = v * p->qe_c1 + p->qe_c2;
+    double psi = s2 / (m * m);
+
+    if (psi <= QE_PSI_CRITICAL) {
+        double inv_psi = 2.0 / psi;
+        double b2 = inv_psi - 1.0 + sqrt(inv_psi) * sqrt(inv_psi - 1.0);
+        double a = m / (1.0 + b2);
+        double bz = sqrt(b2) + z;
+        return a * bz * bz;
+    }
+
+    double prob_zero = (psi - 1.0) / (psi + 1.0);
+    double beta = (1.0 - prob_zero) / m;
+    double tail = 0.5 * erfc(z / sqrt(2.0));  // 1 - Phi(z) without cancellation
+    return tail >= 1.0 - prob_zero ? 0.0 : log((1.0 - prob_zero) / tail) / beta;
+}
+
+// Advance (S, v) by one step from the two independent normals z1, z2 of that step and
+// return the increment of the Brownian motion paired with S for the control variate.
+// Milstein and full truncation correlate S with v through z1; QE drives v with z1 and
+// S's independent part with z2, and reports rho z1 + rho_bar z2 as the increment.
+// `scheme` is p->scheme; the kernels pass it as a literal so their step carries no
+// scheme branches, other callers pass p->scheme.
+static inline __attribute__((always_inline))
+double heston_scheme_step(const StepParams *p, const int scheme, double z1, double z2, double *S, double *v) {
+    double v_prev = *v;
+
+    if (scheme == SCHEME_QE) {
+        double v_next = qe_variance_step(p, v_prev, z1);
+        *S = *S * exp(p->r_dt + p->qe_k0 + p->qe_k1 * v_prev + p->qe_k2 * v_next +
+                      sqrt(p->qe_k3 * v_prev + p->qe_k4 * v_next) * z2);
+        *v = v_next;
+        return (p->rho * z1 + p->rho_bar * z2) * p->sqrt_dt;
+    }
+
+    double Z_S = z1;
+    double Z_v = p->rho * Z_S + p->rho_bar * z2;
+    double v_clamped = fmax(v_prev, 0.0);
+    double sqrt_v_dt = sqrt(v_clamped * p->dt);
+    *v = v_prev + p->kappa_dt * (p->theta - v_clamped) +
+         Z_v * p->xi * sqrt_v_dt +
+         p->milstein * (Z_v * Z_v - 1.0);
+
+    // Milstein keeps the raw previous variance in the drift; full truncation uses v+
+    double v_drift = scheme == SCHEME_MILSTEIN ? v_prev : v_clamped;
+    *S = *S * exp(p->r_dt - v_drift * p->half_dt + Z_S * sqrt_v_dt);
+    return Z_S * p->sqrt_dt;
+}
+
+static inline double heston_step(const StepParams *p, double z1, double z2, double *S, double *v) {
+    return heston_scheme_step(p, p->scheme, z1, z2, S, v);
+}
+
+// Simulate a single price path, writing prices into S and variances into the
+// caller-owned scratch buffer v (both N+1 doubles).
+// z_sign = -1 gives the antithetic mirror of the stream's path.
+void simulate_single_path(RngStream *rng, double z_sign, double *S, double *v, double S0, double v0,
+                          double r, double theta, double kappa, double xi, double rho, double T, int N,
+                          int scheme) {
+    StepParams p;
+    step_params_init(&p, scheme, r, theta, kappa, xi, rho, T / N);
     
     S[0] = S0;
     v[0] = v0;
     
     for (int i = 1; i <= N; i++) {
-        // Generate correlated Brownian increments
-        double Z_S = normal_random();
-        double Z_v = rho * Z_S + sqrt(1 - rho * rho) * normal_random();
-        
-        // Update volatility using Milstein scheme
-        double v_prev = fmax(v[i-1], 0.0);
-        v[i] = v[i-1] + kappa * (theta - v_prev) * dt + 
-               Z_v * xi * sqrt(v_prev * dt) + 
-               (xi * xi / 4.0) * ((Z_v * Z_v - 1.0) * dt);
-        
-        // Update stock price using v[i-1] (NOT the updated v[i])
-        S[i] = S[i-1] * exp((r - v[i-1] / 2.0) * dt + Z_S * sqrt(fmax(v[i-1], 0.0) * dt));
+        double z1 = z_sign * normal_random(rng);
+        double z2 = z_sign * normal_random(rng);
+        S[i] = S[i-1];
+        v[i] = v[i-1];
+        heston_step(&p, z1, z2, &S[i], &v[i]);
+    }
+}
+
+// Simulate only the final price of N steps of p from (S0, v0); the endpoint of the price
+// Brownian motion goes to *W_T for the control variate
+double simulate_final_price(RngStream *rng, double z_sign, const StepParams *p, double S0, double v0, int N,
+                            double *W_T) {
+    double S = S0;
+    double v = v0;
+    double W = 0.0;
+
+    for (int i = 1; i <= N; i++) {
+        double z1 = z_sign * normal_random(rng);
+        double z2 = z_sign * normal_random(rng);
+        W += heston_step(p, z1, z2, &S, &v);
     }
     
-    free(v);
+    *W_T = W;
     return S;
 }
 
-// Simulate only final price (for efficiency after tracking phase)
-double simulate_final_price(double S0, double v0, double r, double theta, double kappa, 
-                           double xi, double rho, double T, int N) {
-    double dt = T / N;
+// simulate_final_price for any payoff: returns the payoff's path value A (S_T goes to
+// *S_T) with its running average, extremum or barrier flag updated in the step loop, so
+// memory stays O(1) in N. `scheme` and `style` are literals at every call site of this
+// body, so each instantiation keeps only its own step and update. dir = +1 tracks maxima
+// and up barriers, -1 minima and down barriers. A barrier path that does not pay has
+// A = NAN.
+static inline __attribute__((always_inline))
+double path_value_kernel(RngStream *rng, double z_sign, const StepParams *p, double S0, double v0, int N,
+                         const PayoffSpec *payoff, const int scheme, const int style, double *S_T, double *W_T) {
+    double dir = (style == PAYOFF_BARRIER ? (payoff->barrier_type & BARRIER_UP) : !payoff->put) ? 1.0 : -1.0;
+    double H = payoff->barrier;
     double S = S0;
     double v = v0;
+    double W = 0.0;
+    double acc = style == PAYOFF_LOOKBACK ? dir * S0 : 0.0;
+    int hit = style == PAYOFF_BARRIER && dir * (S0 - H) >= 0.0;
     
     for (int i = 1; i <= N; i++) {
-        // Generate correlated Brownian increments
-        double Z_S = normal_random();
-        double Z_v = rho * Z_S + sqrt(1 - rho * rho) * normal_random();
-        
-        // Store previous variance for stock price update
+        double z1 = z_sign * normal_random(rng);
+        double z2 = z_sign * normal_random(rng);
+        W += heston_scheme_step(p, scheme, z1, z2, &S, &v);
+        if (style == PAYOFF_ASIAN_ARITHMETIC) acc += S;
+        else if (style == PAYOFF_ASIAN_GEOMETRIC) acc += log(S);
+        else if (style == PAYOFF_LOOKBACK) acc = fmax(acc, dir * S);
+        else if (style == PAYOFF_BARRIER) hit |= dir * (S - H) >= 0.0;
+    }
+
+    *S_T = S;
+    *W_T = W;
+    switch (style) {
+        case PAYOFF_ASIAN_ARITHMETIC: return acc / N;
+        case PAYOFF_ASIAN_GEOMETRIC: return exp(acc / N);
+        case PAYOFF_LOOKBACK: return dir * acc;
+        case PAYOFF_BARRIER: return hit == !!(payoff->barrier_type & BARRIER_IN) ? S : NAN;
+        default: return S;
+    }
+}
+
+#define DEFINE_PATH_KERNEL(name, scheme, style) \
+    static double name(RngStream *rng, double z_sign, const StepParams *p, double S0, double v0, int N, \
+                       const PayoffSpec *payoff, double *S_T, double *W_T) { \
+        return path_value_kernel(rng, z_sign, p, S0, v0, N, payoff, scheme, style, S_T, W_T); \
+    }
+
+// Instantiate a kernel for every payoff style under one prefix, and list them in
+// PAYOFF_* order for a table row
+#define DEFINE_PAYOFF_KERNELS(define, prefix, ...) \
+    define(prefix##_european, __VA_ARGS__, PAYOFF_EUROPEAN) \
+    define(prefix##_asian_arithmetic, __VA_ARGS__, PAYOFF_ASIAN_ARITHMETIC) \
+    define(prefix##_asian_geometric, __VA_ARGS__, PAYOFF_ASIAN_GEOMETRIC) \
+    define(prefix##_barrier, __VA_ARGS__, PAYOFF_BARRIER) \
+    define(prefix##_lookback, __VA_ARGS__, PAYOFF_LOOKBACK)
+#define PAYOFF_KERNEL_ROW(prefix) \
+    { prefix##_european, prefix##_asian_arithmetic, prefix##_asian_geometric, prefix##_barrier, prefix##_lookback }
+
+DEFINE_PAYOFF_KERNELS(DEFINE_PATH_KERNEL, path_milstein, SCHEME_MILSTEIN)
+DEFINE_PAYOFF_KERNELS(DEFINE_PATH_KERNEL, path_full_truncation, SCHEME_FULL_TRUNCATION)
+DEFINE_PAYOFF_KERNELS(DEFINE_PATH_KERNEL, path_qe, SCHEME_QE)
+
+// Scalar kernels by [scheme][payoff style]
+static const PathKernel PATH_KERNELS[NUM_SCHEMES][NUM_PAYOFF_STYLES] = {
+    PAYOFF_KERNEL_ROW(path_milstein),
+    PAYOFF_KERNEL_ROW(path_full_truncation),
+    PAYOFF_KERNEL_ROW(path_qe)
+};
+
+// Undiscounted payoff on path value A; NAN (a barrier path that does not pay) pays 0
+static inline double payoff_amount(const PayoffSpec *payoff, double A, double K) {
+    if (isnan(A)) return 0.0;
+    return payoff->put ? fmax(K - A, 0.0) : fmax(A - K, 0.0);
+}
+
+// simulate_final_price plus what the Greeks need: the pathwise derivative of ln S_T with
+// respect to v0 (Milstein and full truncation only) and the likelihood-ratio score of
+// ln S_0. Conditional on the variance path, ln S_T is normal with a mean that moves one
+// for one with ln S_0, and its variance is the sum of the squared amplitudes a_k of the
+// noise e_k that only drives S, so the score is sum(a_k e_k) / sum(a_k^2). The score is
+// 0 when that variance vanishes (|rho| = 1).
+double simulate_final_price_greeks(RngStream *rng, double z_sign, const StepParams *p, double S0, double v0,
+                                   int N, double *W_T, double *dlogS_dv0, double *score) {
+    double S = S0;
+    double v = v0;
+    double W = 0.0;
+    double dx = 0.0, dv = 1.0;  // d ln S / d v0, d v / d v0
+    double num = 0.0, den = 0.0;
+
+    for (int i = 1; i <= N; i++) {
+        double z1 = z_sign * normal_random(rng);
+        double z2 = z_sign * normal_random(rng);
         double v_prev = v;
+        W += heston_step(p, z1, z2, &S, &v);
+
+        if (p->scheme == SCHEME_QE) {
+            double a = sqrt(p->qe_k3 * v_prev + p->qe_k4 * v);
+            num += a * z2;
+            den += a * a;
+            continue;
+        }
         
-        // Update volatility using Milstein scheme
-        double v_clamped = fmax(v, 0.0);
-        v = v + kappa * (theta - v_clamped) * dt + 
-            Z_v * xi * sqrt(v_clamped * dt) + 
-            (xi * xi / 4.0) * ((Z_v * Z_v - 1.0) * dt);
+        // Z_S = rho Z_v + rho_bar e with e = rho_bar z1 - rho z2 independent of Z_v
+        double v_clamped = fmax(v_prev, 0.0);
+        double a = p->rho_bar * sqrt(v_clamped * p->dt);
+        num += a * (p->rho_bar * z1 - p->rho * z2);
+        den += a * a;
         
-        // Update stock price using previous variance
-        S = S * exp((r - v_prev / 2.0) * dt + Z_S * sqrt(fmax(v_prev, 0.0) * dt));
+        if (v_prev > 0.0) {
+            double Z_v = p->rho * z1 + p->rho_bar * z2;
+            double half_inv_sqrt = 0.5 * p->sqrt_dt / sqrt(v_prev);
+            dx += (z1 * half_inv_sqrt - p->half_dt) * dv;
+            dv *= 1.0 - p->kappa_dt + Z_v * p->xi * half_inv_sqrt;
+        } else {
+            // Truncated: only Milstein's raw drift still sees v_prev
+            if (p->scheme == SCHEME_MILSTEIN) dx -= p->half_dt * dv;
+        }
     }
     
+    *W_T = W;
+    *dlogS_dv0 = p->scheme == SCHEME_QE ? NAN : dx;
+    *score = den > 0.0 ? num / den : 0.0;
     return S;
 }
 
-// Comparison function for sorting paths by final price
-int compare_paths(const void *a, const void *b) {
-    PricePath *path_a = (PricePath*)a;
-    PricePath *path_b = (PricePath*)b;
-    
-    if (path_a->final_price < path_b->final_price) return -1;
-    if (path_a->final_price > path_b->final_price) return 1;
-    return 0;
+// Structure-of-arrays lanes for the SIMD kernel (GCC/Clang vector extensions; they lower
+// to SIMD128 with -msimd128 and to AVX2/AVX-512 natively)
+typedef double vdouble __attribute__((vector_size(SIMD_LANES * sizeof(double))));
+typedef int64_t vlong __attribute__((vector_size(SIMD_LANES * sizeof(double))));
+
+static inline vdouble vbroadcast(double x) {
+    return (vdouble){0} + x;
 }
 
-// Initialize simulation
-EMSCRIPTEN_KEEPALIVE
-void initialize_simulation(double S0, double v0, double r, double theta, double kappa, 
-                          double xi, double rho, double T, double K, int N) {
-    // Clean up previous simulation
-    if (sim_state.all_paths) {
-        for (int i = 0; i < sim_state.paths_stored; i++) {
-            if (sim_state.all_paths[i].path) {
-                free(sim_state.all_paths[i].path);
-            }
-        }
-        free(sim_state.all_paths);
-    }
-    
-    // Set parameters
-    sim_state.S0 = S0;
-    sim_state.v0 = v0;
-    sim_state.r = r;
-    sim_state.theta = theta;
-    sim_state.kappa = kappa;
-    sim_state.xi = xi;
-    sim_state.rho = rho;
-    sim_state.T = T;
-    sim_state.K = K;
-    sim_state.N = N;
+// Branch-free max(x, 0): the comparison mask is all ones where x > 0
+static inline vdouble vclamp_zero(vdouble x) {
+    return (vdouble)((vlong)x & (vlong)(x > 0.0));
+}
+
+// __has_builtin is only tested under clang: compilers without it (GCC < 10, MSVC) cannot
+// parse the call, even on the right of a false &&
+#if defined(__clang__)
+#if __has_builtin(__builtin_elementwise_sqrt)
+#define HAVE_ELEMENTWISE_SQRT 1
+#endif
+#endif
+
+static inline vdouble vsqrt(vdouble x) {
+#if defined(HAVE_ELEMENTWISE_SQRT)
+    return __builtin_elementwise_sqrt(x);
+#elif SIMD_LANES == 8 && defined(__AVX512F__)
+    return (vdouble)_mm512_sqrt_pd((__m512d)x);
+#elif SIMD_LANES == 4 && defined(__AVX__)
+    return (vdouble)_mm256_sqrt_pd((__m256d)x);
+#else
+    for (int j = 0; j < SIMD_LANES; j++) x[j] = sqrt(x[j]);
+    return x;
+#endif
+}
+
+static inline vdouble vmax(vdouble a, vdouble b) {
+    vlong greater = (vlong)(a > b);
+    return (vdouble)(((vlong)a & greater) | ((vlong)b & ~greater));
+}
+
+// Branch-free exp: x = n*ln2 + r with |r| <= ln2/2, exp(r) by a degree-11 Taylor
+// polynomial (truncation error < 1e-14 relative), 2^n assembled in the exponent bits
+static inline vdouble vexp(vdouble x) {
+    const double ln2_hi = 6.93145751953125e-1;
+    const double ln2_lo = 1.42860682030941723212e-6;
+    const double round_magic = 6755399441055744.0;  // 1.5 * 2^52
     
-    // Reset simulation state
-    sim_state.simulation_count = 0;
-    sim_state.tracking_phase = 1;
-    sim_state.paths_stored = 0;
-    sim_state.total_payoffs = 0.0;
-    sim_state.current_option_price = 0.0;
+    vdouble lo = vbroadcast(-708.0), hi = vbroadcast(708.0);
+    x = (vdouble)(((vlong)x & (vlong)(x > lo)) | ((vlong)lo & ~(vlong)(x > lo)));
+    x = (vdouble)(((vlong)x & (vlong)(x < hi)) | ((vlong)hi & ~(vlong)(x < hi)));
     
-    // Allocate memory for path tracking
-    sim_state.all_paths = (PricePath*)malloc(MAX_PERCENTILE_PATHS * sizeof(PricePath));
-    memset(sim_state.all_paths, 0, MAX_PERCENTILE_PATHS * sizeof(PricePath));
+    vdouble n = (x * 1.4426950408889634 + round_magic) - round_magic;
+    vdouble r = (x - n * ln2_hi) - n * ln2_lo;
     
-    // Calculate Black-Scholes price
-    sim_state.black_scholes_price = black_scholes_call(S0, K, r, T, sqrt(v0));
+    vdouble p = vbroadcast(1.0 / 39916800.0);
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
     
-    // Set random seed based on system time for non-deterministic runs
-    rand_seed = (unsigned long)time(NULL);
+    vlong scale = (__builtin_convertvector(n, vlong) + 1023) << 52;
+    return p * (vdouble)scale;
 }
 
-// Run a batch of simulations
-EMSCRIPTEN_KEEPALIVE
-void run_simulation_batch(int batch_size) {
-    for (int i = 0; i < batch_size; i++) {
-        if (sim_state.tracking_phase && sim_state.simulation_count < PERCENTILE_TRACKING_LIMIT) {
-            // Full path simulation for percentile tracking
-            double *path = simulate_single_path(sim_state.S0, sim_state.v0, sim_state.r, 
-                                              sim_state.theta, sim_state.kappa, sim_state.xi, 
-                                              sim_state.rho, sim_state.T, sim_state.N);
-            
-            if (sim_state.paths_stored < MAX_PERCENTILE_PATHS) {
-                sim_state.all_paths[sim_state.paths_stored].path = path;
-                sim_state.all_paths[sim_state.paths_stored].final_price = path[sim_state.N];
-                sim_state.paths_stored++;
-            }
-            
-            // Calculate payoff
-            double payoff = fmax(path[sim_state.N] - sim_state.K, 0.0);
-            sim_state.total_payoffs += payoff;
-            
-            // Check if we should exit tracking phase
-            if (sim_state.simulation_count >= PERCENTILE_TRACKING_LIMIT - 1) {
-                sim_state.tracking_phase = 0;
-                
-                // Sort paths for percentile calculation
-                qsort(sim_state.all_paths, sim_state.paths_stored, sizeof(PricePath), compare_paths);
-                
-                // Calculate percentile indices
-                sim_state.min_idx = 0;
-                sim_state.p25_idx = sim_state.paths_stored / 4;
-                sim_state.p50_idx = sim_state.paths_stored / 2;
-                sim_state.p75_idx = (3 * sim_state.paths_stored) / 4;
-                sim_state.max_idx = sim_state.paths_stored - 1;
+// Advance SIMD_LANES paths (first_path + lane) together and write their final prices
+// and Brownian endpoints. Every lane reads the same substream as the scalar kernels, so
+// results match them up to rounding in vexp. With antithetic variates groups start on a
+// pair, so odd lanes are mirrors and reuse their neighbour's draws instead of generating
+// them again. Handles SCHEME_MILSTEIN and SCHEME_FULL_TRUNCATION; QE paths take the
+// scalar kernel. For path-dependent payoffs the lanes' path values go to out_value,
+// accumulated as in path_value_kernel. `scheme`, `style` and `antithetic` are literals in
+// each instantiation.
+static inline __attribute__((always_inline))
+void simd_kernel(HestonContext *ctx, RngStream *lanes, uint64_t first_path, const int scheme, const int style,
+                 const int antithetic, double *out_S, double *out_W, double *out_value) {
+    const StepParams *p = &ctx->step;
+    const PayoffSpec *payoff = &ctx->active.payoff;
+    double S0 = ctx->S0;
+    int N = ctx->N;
+    vdouble S = vbroadcast(S0);
+    vdouble v = vbroadcast(ctx->v0);
+    vdouble sum_Z = vbroadcast(0.0);
+    vdouble Z_S = {0}, Z_2 = {0}, sign = {0};
+
+    double dir = (style == PAYOFF_BARRIER ? (payoff->barrier_type & BARRIER_UP) : !payoff->put) ? 1.0 : -1.0;
+    double H = payoff->barrier;
+    vdouble acc = vbroadcast(style == PAYOFF_LOOKBACK ? dir * S0 : 0.0);
+    vdouble log_S = vbroadcast(0.0);  // ln(S / S0), for geometric averages
+    vlong hit = {0};  // All ones in lanes that have hit the barrier
+    if (style == PAYOFF_BARRIER && dir * (S0 - H) >= 0.0) hit = ~hit;
+
+    for (int j = 0; j < SIMD_LANES; j++) {
+        sign[j] = antithetic && (j & 1) ? -1.0 : 1.0;
+        if (!(antithetic && (j & 1))) {
+            path_seek(ctx, &lanes[j], first_path + j);
+        }
+    }
+
+    for (int i = 1; i <= N; i++) {
+        // Gather this step's normals lane by lane from the per-path streams
+        for (int j = 0; j < SIMD_LANES; j++) {
+            if (antithetic && (j & 1)) {
+                Z_S[j] = Z_S[j-1];
+                Z_2[j] = Z_2[j-1];
+            } else {
+                Z_S[j] = normal_random(&lanes[j]);
+                Z_2[j] = normal_random(&lanes[j]);
             }
-        } else {
-            // Fast simulation - only final price needed
-            double final_price = simulate_final_price(sim_state.S0, sim_state.v0, sim_state.r, 
-                                                    sim_state.theta, sim_state.kappa, sim_state.xi, 
-                                                    sim_state.rho, sim_state.T, sim_state.N);
-            
-            double payoff = fmax(final_price - sim_state.K, 0.0);
-            sim_state.total_payoffs += payoff;
         }
+        vdouble Z_Sp = antithetic ? sign * Z_S : Z_S;
+        vdouble Z_v = p->rho * Z_Sp + p->rho_bar * (antithetic ? sign * Z_2 : Z_2);
+        sum_Z += Z_Sp;
+
+        // Variance update, stock price update with the previous variance; Milstein keeps
+        // the raw previous variance in the drift, full truncation uses v+
+        vdouble v_clamped = vclamp_zero(v);
+        vdouble sqrt_v_dt = vsqrt(v_clamped * p->dt);
+        vdouble v_next = v + p->kappa_dt * (p->theta - v_clamped) +
+                         Z_v * p->xi * sqrt_v_dt;
+        if (scheme == SCHEME_MILSTEIN) v_next += p->milstein * (Z_v * Z_v - 1.0);
+        vdouble v_drift = scheme == SCHEME_MILSTEIN ? v : v_clamped;
+        vdouble x = p->r_dt - v_drift * p->half_dt + Z_Sp * sqrt_v_dt;
+        S = S * vexp(x);
+        v = v_next;
         
-        sim_state.simulation_count++;
+        if (style == PAYOFF_ASIAN_ARITHMETIC) {
+            acc += S;
+        } else if (style == PAYOFF_ASIAN_GEOMETRIC) {
+            log_S += x;
+            acc += log_S;
+        } else if (style == PAYOFF_LOOKBACK) {
+            acc = vmax(acc, dir * S);
+        } else if (style == PAYOFF_BARRIER) {
+            hit |= (vlong)(dir * (S - H) >= 0.0);
+        }
     }
     
-    // Update option price
-    sim_state.current_option_price = exp(-sim_state.r * sim_state.T) * 
-                                   (sim_state.total_payoffs / sim_state.simulation_count);
+    int knock_in = !!(payoff->barrier_type & BARRIER_IN);
+    for (int j = 0; j < SIMD_LANES; j++) {
+        out_S[j] = S[j];
+        out_W[j] = sum_Z[j] * p->sqrt_dt;
+        switch (style) {
+            case PAYOFF_ASIAN_ARITHMETIC: out_value[j] = acc[j] / N; break;
+            case PAYOFF_ASIAN_GEOMETRIC: out_value[j] = S0 * exp(acc[j] / N); break;
+            case PAYOFF_LOOKBACK: out_value[j] = dir * acc[j]; break;
+            case PAYOFF_BARRIER: out_value[j] = (hit[j] != 0) == knock_in ? S[j] : NAN; break;
+            default: break;
+        }
+    }
 }
 
-// Get current simulation count
-EMSCRIPTEN_KEEPALIVE
-int get_simulation_count() {
-    return sim_state.simulation_count;
-}
+#define DEFINE_GROUP_KERNEL(name, scheme, antithetic, style) \
+    static void name(HestonContext *ctx, RngStream *lanes, uint64_t first_path, double *out_S, double *out_W, \
+                     double *out_value) { \
+        simd_kernel(ctx, lanes, first_path, scheme, style, antithetic, out_S, out_W, out_value); \
+    }
 
-// Get current option price
-EMSCRIPTEN_KEEPALIVE
-double get_option_price() {
-    return sim_state.current_option_price;
+DEFINE_PAYOFF_KERNELS(DEFINE_GROUP_KERNEL, group_milstein, SCHEME_MILSTEIN, 0)
+DEFINE_PAYOFF_KERNELS(DEFINE_GROUP_KERNEL, group_milstein_antithetic, SCHEME_MILSTEIN, 1)
+DEFINE_PAYOFF_KERNELS(DEFINE_GROUP_KERNEL, group_full_truncation, SCHEME_FULL_TRUNCATION, 0)
+DEFINE_PAYOFF_KERNELS(DEFINE_GROUP_KERNEL, group_full_truncation_antithetic, SCHEME_FULL_TRUNCATION, 1)
+
+// SIMD kernels by [scheme][antithetic][payoff style]; QE has none and stays NULL
+static const GroupKernel GROUP_KERNELS[NUM_SCHEMES][2][NUM_PAYOFF_STYLES] = {
+    { PAYOFF_KERNEL_ROW(group_milstein), PAYOFF_KERNEL_ROW(group_milstein_antithetic) },
+    { PAYOFF_KERNEL_ROW(group_full_truncation), PAYOFF_KERNEL_ROW(group_full_truncation_antithetic) }
+};
+
+// Make room for `capacity` doubles; the block is kept (and only grows) across runs
+int arena_reserve(PathArena *arena, size_t capacity) {
+    if (arena->capacity < capacity) {
+        free(arena->base);
+        arena->base = (double*)malloc(capacity * sizeof(double));
+        arena->capacity = arena->base ? capacity : 0;
+    }
+    arena->used = 0;
+    return arena->base != NULL;
 }
 
-// Get Black-Scholes price
-EMSCRIPTEN_KEEPALIVE
-double get_black_scholes_price() {
-    return sim_state.black_scholes_price;
+// Carve `count` doubles from the arena, or NULL once it is full
+double* arena_alloc(PathArena *arena, size_t count) {
+    if (arena->used + count > arena->capacity) return NULL;
+    double *block = arena->base + arena->used;
+    arena->used += count;
+    return block;
 }
 
-// Get percentile path data
-EMSCRIPTEN_KEEPALIVE
-double* get_percentile_path(int percentile) {
-    if (!sim_state.tracking_phase && sim_state.paths_stored > 0) {
-        int idx;
-        switch (percentile) {
-            case 0: idx = sim_state.min_idx; break;
-            case 25: idx = sim_state.p25_idx; break;
-            case 50: idx = sim_state.p50_idx; break;
-            case 75: idx = sim_state.p75_idx; break;
-            case 100: idx = sim_state.max_idx; break;
-            default: return NULL;
-        }
-        return sim_state.all_paths[idx].path;
+void p2_init(P2Quantile *est, double p) {
+    est->p = p;
+    est->count = 0;
+    for (int i = 0; i < 5; i++) {
+        est->n[i] = i + 1;
     }
+    est->np[0] = 1.0;
+    est->np[1] = 1.0 + 2.0 * p;
+    est->np[2] = 1.0 + 4.0 * p;
+    est->np[3] = 3.0 + 2.0 * p;
+    est->np[4] = 5.0;
+    est->dn[0] = 0.0;
+    est->dn[1] = p / 2.0;
+    est->dn[2] = p;
+    est->dn[3] = (1.0 + p) / 2.0;
+    est->dn[4] = 1.0;
+}
+
+void p2_update(P2Quantile *est, double x) {
+    double *q = est->q, *n = est->n;
+
+    // The first five observations become the initial markers
+    if (est->count < 5) {
+        q[est->count++] = x;
+        for (int i = est->count - 1; i > 0 && q[i] < q[i-1]; i--) {
+            double t = q[i]; q[i] = q[i-1]; q[i-1] = t;
+        }
+        return;
+    }
+
+    // Find the cell containing x, extending the extremes if needed
+    int k;
+    if (x < q[0]) { q[0] = x; k = 0; }
+    else if (x < q[1]) k = 0;
+    else if (x < q[2]) k = 1;
+    else if (x < q[3]) k = 2;
+    else if (x <= q[4]) k = 3;
+    else { q[4] = x; k = 3; }
+
+    for (int i = k + 1; i < 5; i++) n[i] += 1.0;
+    for (int i = 0; i < 5; i++) est->np[i] += est->dn[i];
+
+    // Move the middle markers towards their desired positions (piecewise-parabolic)
+    for (int i = 1; i <= 3; i++) {
+        double d = est->np[i] - n[i];
+        if ((d >= 1.0 && n[i+1] - n[i] > 1.0) || (d <= -1.0 && n[i-1] - n[i] < -1.0)) {
+            int s = d > 0 ? 1 : -1;
+            double qp = q[i] + s / (n[i+1] - n[i-1]) *
+                        ((n[i] - n[i-1] + s) * (q[i+1] - q[i]) / (n[i+1] - n[i]) +
+                         (n[i+1] - n[i] - s) * (q[i] - q[i-1]) / (n[i] - n[i-1]));
+            if (q[i-1] < qp && qp < q[i+1]) {
+                q[i] = qp;
+            } else {
+                q[i] = q[i] + s * (q[i+s] - q[i]) / (n[i+s] - n[i]);
+            }
+            n[i] += s;
+        }
+    }
+    est->count++;
+}
+
+double p2_estimate(const P2Quantile *est) {
+    if (est->count >= 5) return est->q[2];
+    if (est->count == 0) return 0.0;
+    // Fewer than five observations: nearest rank of the sorted sample
+    return est->q[(int)(est->p * (est->count - 1) + 0.5)];
+}
+
+// Feed a batch of final prices (path first_path + i) to the streaming percentiles and
+// keep, for each percentile, the path whose final price is nearest the current estimate
+void track_streaming_percentiles(HestonContext *ctx, uint64_t first_path, const double *finals, int count) {
+    PercentileCandidate *c = ctx->candidates;
+
+    for (int i = 0; i < count; i++) {
+        double x = finals[i];
+        uint64_t index = first_path + i;
+
+        for (int k = 0; k < 3; k++) {
+            p2_update(&ctx->quantiles[k], x);
+        }
+
+        for (int k = 0; k < NUM_PERCENTILES; k++) {
+            int better;
+            if (!c[k].has_candidate) {
+                better = 1;
+            } else if (k == 0) {
+                better = x < c[k].final_price;
+            } else if (k == NUM_PERCENTILES - 1) {
+                better = x > c[k].final_price;
+            } else {
+                double target = p2_estimate(&ctx->quantiles[k - 1]);
+                better = fabs(x - target) < fabs(c[k].final_price - target);
+            }
+            if (better) {
+                c[k].has_candidate = 1;
+                c[k].path_index = index;
+                c[k].final_price = x;
+                ctx->percentile_version++;
+            }
+        }
+    }
+}
+
+// Record (path_index, final_price) for tracked paths while the tracking sample fills
+void record_tracked_paths(HestonContext *ctx, uint64_t first_path, const double *finals, int count) {
+    for (int i = 0; i < count && ctx->paths_stored < MAX_PERCENTILE_PATHS; i++) {
+        if (first_path + i >= PERCENTILE_TRACKING_LIMIT) break;
+        ctx->all_paths[ctx->paths_stored].path_index = first_path + i;
+        ctx->all_paths[ctx->paths_stored].final_price = finals[i];
+        ctx->paths_stored++;
+    }
+}
+
+// Comparison function for sorting paths by final price
+int compare_paths(const void *a, const void *b) {
+    PricePath *path_a = (PricePath*)a;
+    PricePath *path_b = (PricePath*)b;
+
+    if (path_a->final_price < path_b->final_price) return -1;
+    if (path_a->final_price > path_b->final_price) return 1;
+    return 0;
+}
+
+// Sort the tracked sample and pick its min, quartiles and max as the percentile paths
+void select_stored_percentiles(HestonContext *ctx) {
+    if (ctx->paths_stored == 0) return;
+    qsort(ctx->all_paths, ctx->paths_stored, sizeof(PricePath), compare_paths);
+
+    int indices[NUM_PERCENTILES] = {
+        0,
+        ctx->paths_stored / 4,
+        ctx->paths_stored / 2,
+        (3 * ctx->paths_stored) / 4,
+        ctx->paths_stored - 1
+    };
+    for (int k = 0; k < NUM_PERCENTILES; k++) {
+        ctx->candidates[k].has_candidate = 1;
+        ctx->candidates[k].path_index = ctx->all_paths[indices[k]].path_index;
+        ctx->candidates[k].final_price = ctx->all_paths[indices[k]].final_price;
+    }
+    ctx->percentile_version++;
+}
+
+// Per-path Greek contributions of the European call or put, undiscounted, with slope
+// g'(S_T) = 1{S_T > K} (call) or -1{S_T < K} (put): pathwise delta g' S_T / S0, vega
+// dPayoff/dv0 and the mixed likelihood-ratio/pathwise gamma g' S_T / S0^2 (score - 1)
+// (Glasserman, 2004, 7.3). QE has no pathwise v0 derivative, so its vega is a central
+// bump of v0 replayed on the path's own substream (common random numbers). Without a
+// score gamma is a central bump of S0, which needs no new path since S_T is
+// proportional to S0.
+static double simulate_path_greeks(HestonContext *ctx, RngStream *rng, uint64_t path, double *W, double *greeks) {
+    double z_sign = path_sign(ctx, path);
+    double S0 = ctx->S0, v0 = ctx->v0, K = ctx->K;
+    double dlogS_dv0, score;
+    path_seek(ctx, rng, path);
+    double S = simulate_final_price_greeks(rng, z_sign, &ctx->step, S0, v0, ctx->N, W, &dlogS_dv0, &score);
+    const PayoffSpec *payoff = &ctx->active.payoff;
+    double slope = payoff->put ? -(S < K ? 1.0 : 0.0) : (S > K ? 1.0 : 0.0);
+    greeks[GREEK_DELTA] = slope * S / S0;
+
+    if (!isnan(dlogS_dv0)) {
+        greeks[GREEK_VEGA] = slope * S * dlogS_dv0;
+    } else {
+        double h = GREEK_BUMP * v0;
+        double W_bump, up, down;
+        path_seek(ctx, rng, path);
+        up = simulate_final_price(rng, z_sign, &ctx->step, S0, v0 + h, ctx->N, &W_bump);
+        path_seek(ctx, rng, path);
+        down = simulate_final_price(rng, z_sign, &ctx->step, S0, v0 - h, ctx->N, &W_bump);
+        greeks[GREEK_VEGA] = (payoff_amount(payoff, up, K) - payoff_amount(payoff, down, K)) / (2.0 * h);
+    }
+
+    if (score != 0.0) {
+        greeks[GREEK_GAMMA] = slope * S / (S0 * S0) * (score - 1.0);
+    } else {
+        double h = GREEK_BUMP * S0;
+        double ratio = S / S0;
+        greeks[GREEK_GAMMA] = (payoff_amount(payoff, (S0 + h) * ratio, K) - 2.0 * payoff_amount(payoff, S, K) +
+                               payoff_amount(payoff, (S0 - h) * ratio, K)) / (h * h);
+    }
+    return S;
+}
+
+// Simulate paths first_path .. first_path + count - 1, writing final prices and Brownian
+// endpoints to finals[0 .. count-1] and W[0 .. count-1]. `lanes` holds SIMD_LANES streams;
+// full groups go through the batch's SIMD kernel, if it has one, and the remainder through
+// its scalar one. If values is not NULL, the path values of the active path-dependent
+// payoff go to values[0 .. count-1]. If greeks is not NULL, every path takes the scalar
+// Greek kernel and writes NUM_GREEKS contributions to greeks[NUM_GREEKS * i ..].
+void simulate_paths(HestonContext *ctx, RngStream *lanes, uint64_t first_path, int count, double *finals,
+                    double *W, double *values, double *greeks) {
+    int i = 0;
+
+    if (greeks) {
+        for (; i < count; i++) {
+            finals[i] = simulate_path_greeks(ctx, &lanes[0], first_path + i, &W[i], greeks + NUM_GREEKS * i);
+        }
+        return;
+    }
+
+    if (ctx->group_kernel) {
+        for (; i + SIMD_LANES <= count; i += SIMD_LANES) {
+            ctx->group_kernel(ctx, lanes, first_path + i, finals + i, W + i, values ? values + i : NULL);
+        }
+    }
+
+    for (; i < count; i++) {
+        uint64_t path = first_path + i;
+        path_seek(ctx, &lanes[0], path);
+        double value = ctx->path_kernel(&lanes[0], path_sign(ctx, path), &ctx->step, ctx->S0, ctx->v0, ctx->N,
+                                        &ctx->active.payoff, &finals[i], &W[i]);
+        if (values) values[i] = value;
+    }
+}
+
+// Simulate one path across consecutive maturities, writing S at each of them to out_S.
+// Segment j runs from maturities[j-1] (0 for j = 0) to maturities[j] in steps[j] steps
+// of `scheme`, so every maturity falls exactly on the time grid.
+void simulate_observed_prices(RngStream *rng, double z_sign, double S0, double v0, double r,
+                              double theta, double kappa, double xi, double rho, int scheme,
+                              const double *maturities, const int *steps, int num_obs, double *out_S) {
+    double S = S0;
+    double v = v0;
+    double t = 0.0;
+    StepParams p;
+
+    for (int j = 0; j < num_obs; j++) {
+        step_params_init(&p, scheme, r, theta, kappa, xi, rho, (maturities[j] - t) / steps[j]);
+        for (int i = 0; i < steps[j]; i++) {
+            double z1 = z_sign * normal_random(rng);
+            double z2 = z_sign * normal_random(rng);
+            heston_step(&p, z1, z2, &S, &v);
+        }
+        out_S[j] = S;
+        t = maturities[j];
+    }
+}
+
+static inline void stats_add(PayoffStats *stats, double y, double x) {
+    stats->n += 1.0;
+    double dy = y - stats->mean_y;
+    double dx = x - stats->mean_x;
+    stats->mean_y += dy / stats->n;
+    stats->mean_x += dx / stats->n;
+    stats->m2_y += dy * (y - stats->mean_y);
+    stats->m2_x += dx * (x - stats->mean_x);
+    stats->c_xy += dx * (y - stats->mean_y);
+}
+
+void stats_merge(PayoffStats *into, const PayoffStats *from) {
+    if (from->n == 0.0) return;
+    if (into->n == 0.0) {
+        *into = *from;
+        return;
+    }
+    double n = into->n + from->n;
+    double dy = from->mean_y - into->mean_y;
+    double dx = from->mean_x - into->mean_x;
+    double w = into->n * from->n / n;
+    into->m2_y += from->m2_y + dy * dy * w;
+    into->m2_x += from->m2_x + dx * dx * w;
+    into->c_xy += from->c_xy + dx * dy * w;
+    into->mean_y += dy * from->n / n;
+    into->mean_x += dx * from->n / n;
+    into->n = n;
+}
+
+// Add the payoffs (and control variates) of `count` simulated paths, starting at
+// first_path, to their groups in stats. The payoff applies to values[] for path-dependent
+// payoffs and to S_T times `scale` (1 unless moment matching) when values is NULL.
+// Antithetic pairs are averaged into one sample, so `count` is even and the slice starts
+// on a pair in that mode.
+void accumulate_path_stats(HestonContext *ctx, PayoffStats *stats, uint64_t first_path, const double *finals,
+                           const double *W, const double *values, int count, double scale) {
+    double K = ctx->K;
+    const PayoffSpec *payoff = &ctx->active.payoff;
+    int per_sample = (ctx->active.variance_reduction & VR_ANTITHETIC) ? 2 : 1;
+    int control = ctx->active.variance_reduction & VR_CONTROL_VARIATE;
+
+    // European Black-Scholes option of the same type on the same Brownian path: E[X] is
+    // known in closed form
+    double sigma = ctx->control_sigma;
+    double drift = (ctx->r - 0.5 * sigma * sigma) * ctx->T;
+
+    for (int i = 0; i + per_sample <= count; i += per_sample) {
+        double y = 0.0, x = 0.0;
+        for (int j = i; j < i + per_sample; j++) {
+            y += payoff_amount(payoff, values ? values[j] : scale * finals[j], K);
+            if (control) {
+                x += payoff_amount(payoff, ctx->S0 * exp(drift + sigma * W[j]), K);
+            }
+        }
+        stats_add(&stats[path_group(ctx, first_path + i)], y / per_sample, x / per_sample);
+    }
+}
+
+// Add per-path Greek contributions to stats, averaging antithetic pairs like the payoffs.
+// Moment matching does not rescale them.
+void accumulate_greek_stats(HestonContext *ctx, PayoffStats *stats, const double *greeks, int count) {
+    int per_sample = (ctx->active.variance_reduction & VR_ANTITHETIC) ? 2 : 1;
+    for (int i = 0; i + per_sample <= count; i += per_sample) {
+        for (int k = 0; k < NUM_GREEKS; k++) {
+            double y = 0.0;
+            for (int j = i; j < i + per_sample; j++) {
+                y += greeks[NUM_GREEKS * j + k];
+            }
+            stats_add(&stats[k], y / per_sample, 0.0);
+        }
+    }
+}
+
+#ifdef HESTON_PERF
+// Move the RNG time and draws of a slot's lanes into perf, out of the kernel time that
+// contains them
+static void perf_collect_lanes(PerfCounters *perf, RngStream *lanes) {
+    for (int j = 0; j < SIMD_LANES; j++) {
+        perf->rng_ms += lanes[j].perf_ms;
+        perf->step_ms -= lanes[j].perf_ms;
+        perf->draws += lanes[j].perf_draws;
+        lanes[j].perf_ms = 0.0;
+        lanes[j].perf_draws = 0.0;
+    }
+}
+#define PERF_COLLECT_LANES(perf, lanes) perf_collect_lanes(perf, lanes)
+#else
+#define PERF_COLLECT_LANES(perf, lanes)
+#endif
+
+// Work done by one thread slot: simulate its paths and, unless the batch must be
+// moment matched first, accumulate their payoffs (and Greeks) into stats
+void run_slot(HestonContext *ctx, RngStream *lanes, uint64_t first_path, int count, double *finals, double *W,
+              double *values, double *greeks, RunStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    PERF_BEGIN(kernel_start);
+    simulate_paths(ctx, lanes, first_path, count, finals, W, values, greeks);
+    PERF_END(stats->perf.step_ms, kernel_start);
+    PERF_COLLECT_LANES(&stats->perf, lanes);
+    PERF_BEGIN(payoff_start);
+    if (!(ctx->active.variance_reduction & VR_MOMENT_MATCHING)) {
+        accumulate_path_stats(ctx, stats->groups, first_path, finals, W, values, count, 1.0);
+    }
+    if (greeks) {
+        accumulate_greek_stats(ctx, stats->greeks, greeks, count);
+    }
+    PERF_END(stats->perf.payoff_ms, payoff_start);
+}
+
+static void run_stats_merge(HestonContext *ctx, RunStats *into, const RunStats *from) {
+    for (int g = 0; g < stat_groups(ctx); g++) {
+        stats_merge(&into->groups[g], &from->groups[g]);
+    }
+    for (int k = 0; k < NUM_GREEKS; k++) {
+        stats_merge(&into->greeks[k], &from->greeks[k]);
+    }
+#ifdef HESTON_PERF
+    into->perf.rng_ms += from->perf.rng_ms;
+    into->perf.step_ms += from->perf.step_ms;
+    into->perf.payoff_ms += from->perf.payoff_ms;
+    into->perf.draws += from->perf.draws;
+#endif
+}
+
+#ifdef HESTON_THREADS
+// Persistent worker pool shared by all contexts; slot 0 is the calling thread, slots
+// 1..size-1 are workers. A batch holds `dispatch` from posting to merging, so calls on
+// different contexts from different threads take turns.
+typedef struct {
+    pthread_t threads[MAX_THREADS];
+    pthread_mutex_t dispatch;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    int size;
+    int generation;  // Incremented each time a batch is posted
+    int pending;     // Workers still running the current batch
+    int shutdown;
+    HestonContext *ctx;  // Context of the current batch
+    uint64_t slot_first_path[MAX_THREADS];
+    int slot_paths[MAX_THREADS];
+    double *slot_finals[MAX_THREADS];
+    double *slot_W[MAX_THREADS];
+    double *slot_values[MAX_THREADS];
+    double *slot_greeks[MAX_THREADS];
+    RunStats slot_stats[MAX_THREADS];
+} ThreadPool;
+
+static ThreadPool pool = {
+    .dispatch = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work_ready = PTHREAD_COND_INITIALIZER,
+    .work_done = PTHREAD_COND_INITIALIZER,
+    .size = 1
+};
+
+static void* pool_worker(void *arg) {
+    int slot = (int)(size_t)arg;
+    int seen_generation = 0;
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (!pool.shutdown && pool.generation == seen_generation) {
+            pthread_cond_wait(&pool.work_ready, &pool.lock);
+        }
+        if (pool.shutdown) break;
+        seen_generation = pool.generation;
+        HestonContext *ctx = pool.ctx;
+        uint64_t first_path = pool.slot_first_path[slot];
+        int count = pool.slot_paths[slot];
+        double *finals = pool.slot_finals[slot];
+        double *W = pool.slot_W[slot];
+        double *values = pool.slot_values[slot];
+        double *greeks = pool.slot_greeks[slot];
+        pthread_mutex_unlock(&pool.lock);
+
+        // Each slot writes only its own entry of slot_stats. Batches with fewer threads
+        // than the pool give the other slots no paths.
+        if (count > 0) {
+            run_slot(ctx, ctx->thread_rng[slot], first_path, count, finals, W, values, greeks,
+                     &pool.slot_stats[slot]);
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.pending == 0) {
+            pthread_cond_signal(&pool.work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
     return NULL;
 }
 
+static void pool_stop() {
+    pthread_mutex_lock(&pool.lock);
+    pool.shutdown = 1;
+    pthread_cond_broadcast(&pool.work_ready);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int i = 1; i < pool.size; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    pool.shutdown = 0;
+    pool.size = 1;
+}
+
+static void pool_start(int size) {
+    // Workers start with seen_generation = 0, so reset before any of them exist
+    pool.generation = 0;
+    pool.size = 1;
+    for (int i = 1; i < size; i++) {
+        if (pthread_create(&pool.threads[i], NULL, pool_worker, (void*)(size_t)i) != 0) break;
+        pool.size++;
+    }
+}
+#endif
+
+// Run paths first_path .. first_path + count - 1 split across all threads, writing their
+// final prices and Brownian endpoints to finals/W (path values to values and Greek
+// contributions to greeks unless NULL) and adding their payoffs to stats.
+// Each slot owns a fixed contiguous range of path substreams (whole antithetic pairs),
+// and partials are combined in slot order, so the result does not depend on the order
+// in which threads finish.
+void run_parallel_paths(HestonContext *ctx, uint64_t first_path, int count, double *finals, double *W,
+                        double *values, double *greeks, RunStats *stats) {
+#ifdef HESTON_THREADS
+    int threads = ctx->num_threads;
+    if (threads > 1) {
+        int per_sample = (ctx->active.variance_reduction & VR_ANTITHETIC) ? 2 : 1;
+        int samples = count / per_sample;
+        pthread_mutex_lock(&pool.dispatch);
+        pthread_mutex_lock(&pool.lock);
+        pool.ctx = ctx;
+        int offset = 0;
+        for (int t = 0; t < pool.size; t++) {
+            if (t >= threads) {
+                pool.slot_paths[t] = 0;
+                continue;
+            }
+            pool.slot_first_path[t] = first_path + offset;
+            pool.slot_paths[t] = per_sample * (samples / threads + (t < samples % threads ? 1 : 0));
+            pool.slot_finals[t] = finals + offset;
+            pool.slot_W[t] = W + offset;
+            pool.slot_values[t] = values ? values + offset : NULL;
+            pool.slot_greeks[t] = greeks ? greeks + (size_t)NUM_GREEKS * offset : NULL;
+            offset += pool.slot_paths[t];
+        }
+        pool.pending = pool.size - 1;
+        pool.generation++;
+        pthread_cond_broadcast(&pool.work_ready);
+        pthread_mutex_unlock(&pool.lock);
+
+        run_slot(ctx, ctx->thread_rng[0], pool.slot_first_path[0], pool.slot_paths[0], pool.slot_finals[0],
+                 pool.slot_W[0], pool.slot_values[0], pool.slot_greeks[0], &pool.slot_stats[0]);
+
+        pthread_mutex_lock(&pool.lock);
+        while (pool.pending > 0) {
+            pthread_cond_wait(&pool.work_done, &pool.lock);
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        for (int t = 0; t < threads; t++) {
+            run_stats_merge(ctx, stats, &pool.slot_stats[t]);
+        }
+        pthread_mutex_unlock(&pool.dispatch);
+        return;
+    }
+#endif
+    RunStats slot_stats;
+    run_slot(ctx, ctx->thread_rng[0], first_path, count, finals, W, values, greeks, &slot_stats);
+    run_stats_merge(ctx, stats, &slot_stats);
+}
+
+// Set the number of threads used in the fast phase (always 1 without HESTON_THREADS).
+// The shared pool only grows, so a context asking for fewer threads leaves the other
+// contexts' workers in place.
+EMSCRIPTEN_KEEPALIVE
+void set_thread_count(HestonContext *ctx, int threads) {
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+#ifdef HESTON_THREADS
+    pthread_mutex_lock(&pool.dispatch);
+    if (threads > pool.size) {
+        pool_stop();
+        pool_start(threads);
+    }
+    ctx->num_threads = threads < pool.size ? threads : pool.size;
+    pthread_mutex_unlock(&pool.dispatch);
+#else
+    ctx->num_threads = 1;
+#endif
+}
+
+// Get number of threads used in the fast phase
+EMSCRIPTEN_KEEPALIVE
+int get_thread_count(HestonContext *ctx) {
+    return ctx->num_threads > 0 ? ctx->num_threads : 1;
+}
+
+// Create a context with the default options; its buffers are allocated on first use
+EMSCRIPTEN_KEEPALIVE
+HestonContext* heston_create_context() {
+    return (HestonContext*)calloc(1, sizeof(HestonContext));
+}
+
+// Free a context and every buffer it allocated; ctx may be NULL
+EMSCRIPTEN_KEEPALIVE
+void heston_destroy_context(HestonContext *ctx) {
+    if (!ctx) return;
+    free(ctx->all_paths);
+    free(ctx->path_arena.base);
+    free(ctx->decimated);
+    free(ctx->variance_scratch);
+    free(ctx->batch_finals);
+    free(ctx->batch_W);
+    free(ctx->batch_values);
+    free(ctx->batch_greeks);
+    free(ctx->export_stream.buffer);
+    free(ctx->export_stream.path_scratch);
+    free(ctx->rng.qmc_normals);
+    for (int t = 0; t < MAX_THREADS; t++) {
+        for (int j = 0; j < SIMD_LANES; j++) {
+            free(ctx->thread_rng[t][j].qmc_normals);
+        }
+    }
+    BrownianBridge *b = &ctx->bridge;
+    free(b->index); free(b->left); free(b->right);
+    free(b->left_weight); free(b->right_weight); free(b->std_dev);
+    free(ctx);
+}
+
+static int run_key_equal(const RunKey *a, const RunKey *b) {
+    const SimulationOptions *x = &a->options, *y = &b->options;
+    return a->S0 == b->S0 && a->v0 == b->v0 && a->r == b->r && a->theta == b->theta &&
+           a->kappa == b->kappa && a->xi == b->xi && a->rho == b->rho && a->T == b->T && a->K == b->K &&
+           a->N == b->N && x->seed == y->seed && x->percentile_mode == y->percentile_mode &&
+           x->variance_reduction == y->variance_reduction && x->scheme == y->scheme &&
+           x->qmc_replicas == y->qmc_replicas && x->greeks == y->greeks &&
+           x->payoff.style == y->payoff.style && x->payoff.put == y->payoff.put &&
+           x->payoff.barrier_type == y->payoff.barrier_type && x->payoff.barrier == y->payoff.barrier;
+}
+
+// 1 once the run's 95% half-width is within its target tolerance
+static int tolerance_met(const HestonContext *ctx) {
+    return ctx->active.target_tolerance > 0.0 && ctx->simulation_count >= CONVERGENCE_MIN_PATHS &&
+           CONFIDENCE_Z * ctx->standard_error <= ctx->active.target_tolerance;
+}
+
+// Save the current run under its key. An entry with the same key is updated unless it
+// holds more samples; otherwise the least recently used entry is replaced. Runs still
+// in the tracking phase are not saved, since their tracked sample is not kept.
+static void cache_save(HestonContext *ctx) {
+    if (ctx->cache_disabled || ctx->simulation_count == 0 || ctx->tracking_phase) return;
+
+    CachedRun *entry = &ctx->cache[0];
+    for (int i = 0; i < RESULT_CACHE_SIZE; i++) {
+        CachedRun *e = &ctx->cache[i];
+        if (e->used && run_key_equal(&e->key, &ctx->run_key)) {
+            if (e->simulation_count > ctx->simulation_count) return;
+            entry = e;
+            break;
+        }
+        if (!e->used || (entry->used && e->last_used < entry->last_used)) entry = e;
+    }
+
+    entry->used = 1;
+    entry->last_used = ++ctx->cache_clock;
+    entry->key = ctx->run_key;
+    entry->stats = ctx->stats;
+    entry->simulation_count = ctx->simulation_count;
+    entry->price = ctx->current_option_price;
+    entry->standard_error = ctx->standard_error;
+    memcpy(entry->greeks, ctx->greeks, sizeof(entry->greeks));
+    memcpy(entry->greek_errors, ctx->greek_errors, sizeof(entry->greek_errors));
+    memcpy(entry->candidates, ctx->candidates, sizeof(entry->candidates));
+    memcpy(entry->quantiles, ctx->quantiles, sizeof(entry->quantiles));
+}
+
+// Take over the saved run with the current key, if any: its estimate is available at once
+// and the next batch continues at its sample count, exactly as if it had never stopped.
+// Its percentile paths are replayed from their substreams when requested.
+static void cache_restore(HestonContext *ctx) {
+    ctx->restored_count = 0;
+    if (ctx->cache_disabled) return;
+    for (int i = 0; i < RESULT_CACHE_SIZE; i++) {
+        CachedRun *e = &ctx->cache[i];
+        if (!e->used || !run_key_equal(&e->key, &ctx->run_key)) continue;
+
+        e->last_used = ++ctx->cache_clock;
+        ctx->stats = e->stats;
+        ctx->simulation_count = e->simulation_count;
+        ctx->restored_count = e->simulation_count;
+        ctx->tracking_phase = 0;
+        ctx->current_option_price = e->price;
+        ctx->standard_error = e->standard_error;
+        memcpy(ctx->greeks, e->greeks, sizeof(ctx->greeks));
+        memcpy(ctx->greek_errors, e->greek_errors, sizeof(ctx->greek_errors));
+        memcpy(ctx->quantiles, e->quantiles, sizeof(ctx->quantiles));
+        for (int k = 0; k < NUM_PERCENTILES; k++) {
+            ctx->candidates[k].has_candidate = e->candidates[k].has_candidate;
+            ctx->candidates[k].path_index = e->candidates[k].path_index;
+            ctx->candidates[k].final_price = e->candidates[k].final_price;
+        }
+        ctx->percentile_version++;
+        ctx->converged = tolerance_met(ctx);
+        return;
+    }
+}
+
+// Little-endian fields of the export headers (every supported target is little-endian)
+static inline void export_put_u32(unsigned char *at, uint32_t x) { memcpy(at, &x, 4); }
+static inline void export_put_u64(unsigned char *at, uint64_t x) { memcpy(at, &x, 8); }
+static inline void export_put_f64(unsigned char *at, double x) { memcpy(at, &x, 8); }
+
+static inline void export_put_value(unsigned char *at, double x, int value_bytes) {
+    if (value_bytes == 8) {
+        memcpy(at, &x, 8);
+    } else {
+        float f = (float)x;
+        memcpy(at, &f, 4);
+    }
+}
+
+// Bytes of a chunk holding the given samples and paths, headers included
+static size_t export_chunk_bytes(const ExportStream *e, int samples, int paths) {
+    return EXPORT_CHUNK_HEADER_BYTES + (size_t)samples * e->columns * e->value_bytes +
+           (size_t)paths * (sizeof(uint64_t) + (size_t)e->path_points * e->value_bytes);
+}
+
+// Start of a chunk's payload, after its header
+static inline unsigned char* export_payload(ExportStream *e) {
+    return e->buffer + e->head + EXPORT_CHUNK_HEADER_BYTES;
+}
+
+// End any export of the context and free its buffers
+EMSCRIPTEN_KEEPALIVE
+void export_end(HestonContext *ctx) {
+    ExportStream *e = &ctx->export_stream;
+    free(e->buffer);
+    free(e->path_scratch);
+    memset(e, 0, sizeof(*e));
+}
+
+// Start exporting the current run from its next batch on. The chunk buffer and the path
+// replay scratch together stay within budget_bytes; the chunk capacity, in samples, is
+// what is left after the headers, rounded down to whole batch rounds. Returns it, or -1
+// when not even one round fits or the buffer cannot be allocated.
+EMSCRIPTEN_KEEPALIVE
+int export_begin(HestonContext *ctx, int flags, double budget_bytes, int path_stride, int path_points) {
+    export_end(ctx);
+    ExportStream *e = &ctx->export_stream;
+    int N = ctx->N;
+    if (N <= 0) return -1;
+
+    // Path values exist for path-dependent payoffs only
+    e->flags = flags & (EXPORT_FLOAT64 | EXPORT_PATH_VALUES);
+    if (ctx->active.payoff.style == PAYOFF_EUROPEAN) e->flags &= ~EXPORT_PATH_VALUES;
+    e->value_bytes = (e->flags & EXPORT_FLOAT64) ? 8 : 4;
+    e->columns = (e->flags & EXPORT_PATH_VALUES) ? 2 : 1;
+    if (path_stride > 0 && path_points >= 2) {
+        e->path_stride = path_stride;
+        e->path_points = path_points < N + 1 ? path_points : N + 1;
+    }
+
+    // Every sample costs its columns and, on average, 1/path_stride of a path row; one
+    // extra row covers a chunk that starts on an exported path
+    double row_bytes = e->path_stride ? sizeof(uint64_t) + (double)e->path_points * e->value_bytes : 0.0;
+    double scratch_bytes = e->path_stride ? (N + 1.0) * sizeof(double) : 0.0;
+    double fixed = EXPORT_HEADER_BYTES + EXPORT_CHUNK_HEADER_BYTES + row_bytes + scratch_bytes;
+    double per_sample = (double)e->columns * e->value_bytes + (e->path_stride ? row_bytes / e->path_stride : 0.0);
+    double capacity = floor((budget_bytes - fixed) / per_sample);
+    if (capacity > EXPORT_MAX_CHUNK) capacity = EXPORT_MAX_CHUNK;
+
+    int round = ((ctx->active.variance_reduction & VR_ANTITHETIC) ? 2 : 1) * stat_groups(ctx);
+    e->capacity = capacity >= round ? (int)capacity / round * round : 0;
+    if (e->capacity == 0) {
+        export_end(ctx);
+        return -1;
+    }
+    e->max_paths = e->path_stride ? (e->capacity + e->path_stride - 1) / e->path_stride : 0;
+
+    e->buffer = (unsigned char*)malloc(EXPORT_HEADER_BYTES + export_chunk_bytes(e, e->capacity, e->max_paths));
+    e->path_scratch = e->path_stride ? (double*)malloc((N + 1) * sizeof(double)) : NULL;
+    if (!e->buffer || (e->path_stride && !e->path_scratch)) {
+        export_end(ctx);
+        return -1;
+    }
+
+    unsigned char *h = e->buffer;
+    memset(h, 0, EXPORT_HEADER_BYTES);
+    memcpy(h, "HESTONX1", 8);
+    export_put_u32(h + 8, EXPORT_VERSION);
+    export_put_u32(h + 12, (uint32_t)e->flags);
+    export_put_u32(h + 16, (uint32_t)N);
+    export_put_u32(h + 20, (uint32_t)e->path_points);
+    export_put_u32(h + 24, (uint32_t)e->path_stride);
+    export_put_u32(h + 28, (uint32_t)e->value_bytes);
+    export_put_u64(h + 32, ctx->active.seed);
+    export_put_f64(h + 40, ctx->S0);
+    export_put_f64(h + 48, ctx->T);
+    export_put_f64(h + 56, ctx->K);
+    e->head = EXPORT_HEADER_BYTES;
+    e->active = 1;
+    return e->capacity;
+}
+
+// Samples the next batch may add before the open chunk is full: 0 while a finished chunk
+// waits for export_release, and no limit without an export
+static int export_room(const HestonContext *ctx) {
+    const ExportStream *e = &ctx->export_stream;
+    if (!e->active) return INT32_MAX;
+    return e->ready ? 0 : e->capacity - e->samples;
+}
+
+// Pack the open chunk's columns behind each other and write its header
+static void export_finish(HestonContext *ctx) {
+    ExportStream *e = &ctx->export_stream;
+    int vb = e->value_bytes;
+    unsigned char *payload = export_payload(e);
+    size_t column = (size_t)e->samples * vb;
+    size_t index_from = (size_t)e->columns * e->capacity * vb;
+    size_t index_to = (size_t)e->columns * column;
+    if (e->columns == 2) {
+        memmove(payload + column, payload + (size_t)e->capacity * vb, column);
+    }
+    if (e->paths) {
+        memmove(payload + index_to, payload + index_from, (size_t)e->paths * sizeof(uint64_t));
+        memmove(payload + index_to + (size_t)e->paths * sizeof(uint64_t),
+                payload + index_from + (size_t)e->max_paths * sizeof(uint64_t),
+                (size_t)e->paths * e->path_points * vb);
+    }
+
+    size_t bytes = export_chunk_bytes(e, e->samples, e->paths);
+    unsigned char *h = e->buffer + e->head;
+    memcpy(h, "CHNK", 4);
+    export_put_u32(h + 4, (uint32_t)e->samples);
+    export_put_u64(h + 8, e->first_path);
+    export_put_u32(h + 16, (uint32_t)e->paths);
+    export_put_u32(h + 20, (uint32_t)e->columns);
+    export_put_u64(h + 24, bytes - EXPORT_CHUNK_HEADER_BYTES);
+    e->ready = e->head + bytes;
+}
+
+// Add a batch to the open chunk (count fits, see export_room): its S_T as simulated, before
+// any moment matching, its path values, and its exported paths replayed from their
+// substreams at path_points evenly spaced steps
+static void export_append(HestonContext *ctx, uint64_t first_path, const double *finals,
+                          const double *values, int count) {
+    ExportStream *e = &ctx->export_stream;
+    int vb = e->value_bytes;
+    unsigned char *payload = export_payload(e);
+    if (e->samples == 0) e->first_path = first_path;
+
+    for (int i = 0; i < count; i++) {
+        export_put_value(payload + (size_t)(e->samples + i) * vb, finals[i], vb);
+    }
+    if (e->columns == 2) {
+        unsigned char *column = payload + (size_t)e->capacity * vb;
+        for (int i = 0; i < count; i++) {
+            export_put_value(column + (size_t)(e->samples + i) * vb, values[i], vb);
+        }
+    }
+
+    if (e->path_stride) {
+        PERF_BEGIN(start);
+        int N = ctx->N, points = e->path_points;
+        unsigned char *index = payload + (size_t)e->columns * e->capacity * vb;
+        unsigned char *rows = index + (size_t)e->max_paths * sizeof(uint64_t);
+        uint64_t end = first_path + (uint64_t)count;
+        uint64_t stride = (uint64_t)e->path_stride;
+        for (uint64_t p = (first_path + stride - 1) / stride * stride; p < end; p += stride) {
+            path_seek(ctx, &ctx->rng, p);
+            simulate_single_path(&ctx->rng, path_sign(ctx, p), e->path_scratch, ctx->variance_scratch,
+                                 ctx->S0, ctx->v0, ctx->r, ctx->theta, ctx->kappa,
+                                 ctx->xi, ctx->rho, ctx->T, N, ctx->active.scheme);
+            export_put_u64(index + (size_t)e->paths * sizeof(uint64_t), p);
+            unsigned char *row = rows + (size_t)e->paths * points * vb;
+            for (int j = 0; j < points; j++) {
+                export_put_value(row + (size_t)j * vb, e->path_scratch[(int64_t)j * N / (points - 1)], vb);
+            }
+            e->paths++;
+        }
+        PERF_END(ctx->stats.perf.copy_out_ms, start);
+    }
+
+    e->samples += count;
+    if (e->samples == e->capacity) export_finish(ctx);
+}
+
+// Length in bytes of the finished chunk waiting at export_data, or 0 if there is none.
+// With flush, a partly filled chunk is finished first (and a stream that never ran a
+// batch yields its header alone), so the export can be closed after any batch.
+EMSCRIPTEN_KEEPALIVE
+int export_ready(HestonContext *ctx, int flush) {
+    ExportStream *e = &ctx->export_stream;
+    if (!e->active) return 0;
+    if (!e->ready && flush) {
+        if (e->samples > 0) {
+            export_finish(ctx);
+        } else if (e->head) {
+            e->ready = e->head;
+        }
+    }
+    return (int)e->ready;
+}
+
+// Bytes of the finished chunk; valid until export_release
+EMSCRIPTEN_KEEPALIVE
+unsigned char* export_data(HestonContext *ctx) {
+    return ctx->export_stream.buffer;
+}
+
+// Hand the finished chunk's buffer back so the next batch can fill it
+EMSCRIPTEN_KEEPALIVE
+void export_release(HestonContext *ctx) {
+    ExportStream *e = &ctx->export_stream;
+    if (!e->ready) return;
+    e->ready = 0;
+    e->head = 0;
+    e->samples = 0;
+    e->paths = 0;
+}
+
+// Initialize simulation; a run with the same model and options as one in the result cache
+// continues from where that run stopped (see set_result_cache)
+EMSCRIPTEN_KEEPALIVE
+void initialize_simulation(HestonContext *ctx, double S0, double v0, double r, double theta, double kappa,
+                          double xi, double rho, double T, double K, int N) {
+    cache_save(ctx);
+    export_end(ctx);
+
+    // Set parameters
+    ctx->S0 = S0;
+    ctx->v0 = v0;
+    ctx->r = r;
+    ctx->theta = theta;
+    ctx->kappa = kappa;
+    ctx->xi = xi;
+    ctx->rho = rho;
+    ctx->T = T;
+    ctx->K = K;
+    ctx->N = N;
+    ctx->active = ctx->options;
+    if (ctx->active.payoff.style != PAYOFF_EUROPEAN) {
+        ctx->active.greeks = 0;
+    }
+    step_params_init(&ctx->step, ctx->active.scheme, r, theta, kappa, xi, rho, T / N);
+
+    // Reset simulation state
+    ctx->simulation_count = 0;
+    ctx->tracking_phase = 1;
+    ctx->paths_stored = 0;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->standard_error = 0.0;
+    memset(ctx->greeks, 0, sizeof(ctx->greeks));
+    memset(ctx->greek_errors, 0, sizeof(ctx->greek_errors));
+    ctx->converged = 0;
+    ctx->current_option_price = 0.0;
+
+    // Path tracking memory is allocated once and reused: only (index, price) pairs are
+    // tracked and the five percentile paths are replayed into the arena, so resetting
+    // the previous simulation is a rewind, whatever N is
+    if (!ctx->all_paths) {
+        ctx->all_paths = (PricePath*)malloc(MAX_PERCENTILE_PATHS * sizeof(PricePath));
+    }
+    memset(ctx->candidates, 0, sizeof(ctx->candidates));
+    ctx->percentile_version = 0;
+    ctx->path_checkpoints = ctx->active.path_checkpoints > N + 1 ? N + 1 : ctx->active.path_checkpoints;
+    if (ctx->path_checkpoints) {
+        // Only the checkpoint states are kept; charted windows are replayed from them
+        int K = ctx->path_checkpoints;
+        arena_reserve(&ctx->path_arena, (size_t)NUM_PERCENTILES * 2 * K);
+        ctx->percentile_paths = NULL;
+        for (int k = 0; k < NUM_PERCENTILES; k++) {
+            ctx->candidates[k].checkpoints = arena_alloc(&ctx->path_arena, 2 * (size_t)K);
+        }
+    } else {
+        // One contiguous block, percentile k at offset k * (N + 1), so all five paths can
+        // be handed to JavaScript as a single view
+        arena_reserve(&ctx->path_arena, (size_t)NUM_PERCENTILES * (N + 1));
+        ctx->percentile_paths = arena_alloc(&ctx->path_arena, (size_t)NUM_PERCENTILES * (N + 1));
+        for (int k = 0; k < NUM_PERCENTILES; k++) {
+            ctx->candidates[k].path = ctx->percentile_paths ?
+                                           ctx->percentile_paths + (size_t)k * (N + 1) : NULL;
+        }
+    }
+
+    const double quantile_levels[3] = {0.25, 0.5, 0.75};
+    for (int k = 0; k < 3; k++) {
+        p2_init(&ctx->quantiles[k], quantile_levels[k]);
+    }
+
+    if (ctx->variance_scratch_len < N + 1) {
+        free(ctx->variance_scratch);
+        ctx->variance_scratch = (double*)malloc((N + 1) * sizeof(double));
+        ctx->variance_scratch_len = ctx->variance_scratch ? N + 1 : 0;
+    }
+
+    // Reference prices exist for European payoffs only; puts follow from put-call parity
+    const PayoffSpec *payoff = &ctx->active.payoff;
+    double parity = payoff->put ? K * exp(-r * T) - S0 : 0.0;
+    if (payoff->style == PAYOFF_EUROPEAN) {
+        ctx->black_scholes_price = black_scholes_call(S0, K, r, T, sqrt(v0)) + parity;
+        ctx->analytic_price = heston_analytic_call(S0, v0, r, theta, kappa, xi, rho, T, K) + parity;
+    } else {
+        ctx->black_scholes_price = NAN;
+        ctx->analytic_price = NAN;
+    }
+
+    // The control variate uses the expected average variance over [0, T]
+    double kT = kappa * T;
+    double avg_variance = theta + (v0 - theta) * (kT > 1e-12 ? (1.0 - exp(-kT)) / kT : 1.0);
+    ctx->control_sigma = sqrt(fmax(avg_variance, 1e-12));
+    ctx->control_mean = exp(r * T) * (black_scholes_call(S0, K, r, T, ctx->control_sigma) + parity);
+
+    // Every stream shares the explicit seed as key; paths select their own substream
+    rng_seed(&ctx->rng, ctx->active.seed);
+    for (int t = 0; t < MAX_THREADS; t++) {
+        for (int j = 0; j < SIMD_LANES; j++) {
+            rng_seed(&ctx->thread_rng[t][j], ctx->active.seed);
+        }
+    }
+
+    if (ctx->active.qmc_replicas) {
+        qmc_init(ctx, N);
+    }
+
+    RunKey *key = &ctx->run_key;
+    key->S0 = S0; key->v0 = v0; key->r = r; key->theta = theta; key->kappa = kappa;
+    key->xi = xi; key->rho = rho; key->T = T; key->K = K; key->N = N;
+    key->options = ctx->active;
+    cache_restore(ctx);
+}
+
+// Discounted price estimate and its standard error from the running moments. With the
+// control variate, b = Cov(X, Y) / Var(X) is estimated from the same samples and the
+// error uses the residual variance Var(Y) - Cov(X, Y)^2 / Var(X).
+void update_option_price(HestonContext *ctx) {
+    int groups = stat_groups(ctx);
+    PayoffStats total = {0};
+    for (int g = 0; g < groups; g++) {
+        stats_merge(&total, &ctx->stats.groups[g]);
+    }
+
+    const PayoffStats *st = &total;
+    double discount = exp(-ctx->r * ctx->T);
+    double estimate = st->mean_y;
+    double residual_m2 = st->m2_y;
+    double beta = 0.0;
+
+    if ((ctx->active.variance_reduction & VR_CONTROL_VARIATE) && st->m2_x > 0.0) {
+        beta = st->c_xy / st->m2_x;
+        estimate -= beta * (st->mean_x - ctx->control_mean);
+        residual_m2 = fmax(st->m2_y - st->c_xy * beta, 0.0);
+    }
+
+    ctx->current_option_price = discount * estimate;
+    if (groups > 1) {
+        // QMC points are not independent, so the error comes from the spread of the
+        // independently scrambled replicas' estimates
+        double sum = 0.0, sum_sq = 0.0;
+        for (int g = 0; g < groups; g++) {
+            const PayoffStats *rg = &ctx->stats.groups[g];
+            double e = rg->mean_y - beta * (rg->mean_x - ctx->control_mean);
+            sum += e;
+            sum_sq += e * e;
+        }
+        double mean = sum / groups;
+        double var = fmax(sum_sq / groups - mean * mean, 0.0) * groups / (groups - 1.0);
+        ctx->standard_error = st->n > 0.0 ? discount * sqrt(var / groups) : 0.0;
+    } else {
+        ctx->standard_error = st->n > 1.0 ? discount * sqrt(residual_m2 / (st->n - 1.0) / st->n) : 0.0;
+    }
+
+    for (int k = 0; k < NUM_GREEKS; k++) {
+        const PayoffStats *gs = &ctx->stats.greeks[k];
+        ctx->greeks[k] = discount * gs->mean_y;
+        ctx->greek_errors[k] = gs->n > 1.0 ? discount * sqrt(gs->m2_y / (gs->n - 1.0) / gs->n) : 0.0;
+    }
+
+    if (tolerance_met(ctx)) {
+        ctx->converged = 1;
+    }
+}
+
+// Run a batch of simulations
+EMSCRIPTEN_KEEPALIVE
+void run_simulation_batch(HestonContext *ctx, int batch_size) {
+    if (batch_size <= 0 || ctx->converged) return;
+    PERF_BEGIN(batch_start);
+
+    // Antithetic batches are rounded up to whole pairs, QMC batches to whole rounds of
+    // replicas so every replica holds the same number of samples
+    int per_sample = (ctx->active.variance_reduction & VR_ANTITHETIC) ? 2 : 1;
+    int round = per_sample * stat_groups(ctx);
+    batch_size = (batch_size + round - 1) / round * round;
+
+    // While exporting, a batch ends where the open chunk is full, and none runs until a
+    // finished chunk has been released (round divides the chunk capacity)
+    int room = export_room(ctx);
+    if (room == 0) return;
+    if (batch_size > room) batch_size = room;
+    int streaming = ctx->active.percentile_mode == PERCENTILE_STREAMING;
+    int tracking = ctx->tracking_phase;
+
+    // Pick the kernels specialized for this run's scheme, payoff and antithetic mode once,
+    // so no step loop branches on them. step.scheme may differ from active.scheme (QE
+    // falls back to full truncation without vol of vol).
+    int scheme = ctx->step.scheme;
+    int style = ctx->active.payoff.style;
+    ctx->path_kernel = PATH_KERNELS[scheme][style];
+    ctx->group_kernel = GROUP_KERNELS[scheme][per_sample == 2][style];
+
+    // Only final prices are simulated, split across the thread pool, and collected in
+    // path order for percentile tracking and moment matching
+    if (ctx->batch_finals_len < batch_size) {
+        free(ctx->batch_finals);
+        free(ctx->batch_W);
+        ctx->batch_finals = (double*)malloc(batch_size * sizeof(double));
+        ctx->batch_W = (double*)malloc(batch_size * sizeof(double));
+        ctx->batch_finals_len = batch_size;
+        if (!ctx->batch_finals || !ctx->batch_W) {
+            ctx->batch_finals_len = 0;
+            return;
+        }
+    }
+    double *finals = ctx->batch_finals;
+    double *W = ctx->batch_W;
+
+    double *values = NULL;
+    if (ctx->active.payoff.style != PAYOFF_EUROPEAN) {
+        if (ctx->batch_values_len < batch_size) {
+            free(ctx->batch_values);
+            ctx->batch_values = (double*)malloc(batch_size * sizeof(double));
+            ctx->batch_values_len = ctx->batch_values ? batch_size : 0;
+            if (!ctx->batch_values) return;
+        }
+        values = ctx->batch_values;
+    }
+
+    double *greeks = NULL;
+    if (ctx->active.greeks) {
+        if (ctx->batch_greeks_len < batch_size) {
+            free(ctx->batch_greeks);
+            ctx->batch_greeks = (double*)malloc((size_t)NUM_GREEKS * batch_size * sizeof(double));
+            ctx->batch_greeks_len = ctx->batch_greeks ? batch_size : 0;
+        }
+        greeks = ctx->batch_greeks;
+    }
+
+    uint64_t first_path = (uint64_t)ctx->simulation_count;
+    run_parallel_paths(ctx, first_path, batch_size, finals, W, values, greeks, &ctx->stats);
+    ctx->simulation_count += batch_size;
+    if (ctx->export_stream.active) {
+        export_append(ctx, first_path, finals, values, batch_size);
+    }
+
+    // Moment matching: scale the batch so the sample mean of S_T equals E[S_T] = S0 e^{rT}.
+    // Path-dependent payoffs are accumulated unscaled.
+    if (ctx->active.variance_reduction & VR_MOMENT_MATCHING) {
+        double mean_S = 0.0;
+        for (int i = 0; i < batch_size; i++) {
+            mean_S += finals[i];
+        }
+        mean_S /= batch_size;
+        double scale = mean_S > 0.0 ? ctx->S0 * exp(ctx->r * ctx->T) / mean_S : 1.0;
+        PERF_BEGIN(payoff_start);
+        accumulate_path_stats(ctx, ctx->stats.groups, first_path, finals, W, values, batch_size, scale);
+        PERF_END(ctx->stats.perf.payoff_ms, payoff_start);
+    }
+
+    PERF_BEGIN(percentile_start);
+    if (streaming) {
+        track_streaming_percentiles(ctx, first_path, finals, batch_size);
+    } else if (tracking) {
+        record_tracked_paths(ctx, first_path, finals, batch_size);
+    }
+
+    // Check if we should exit tracking phase
+    if (tracking && ctx->simulation_count >= PERCENTILE_TRACKING_LIMIT) {
+        ctx->tracking_phase = 0;
+        if (!streaming) {
+            select_stored_percentiles(ctx);
+        }
+    }
+    PERF_END(ctx->stats.perf.percentile_ms, percentile_start);
+
+    update_option_price(ctx);
+    PERF_END(ctx->stats.perf.batch_ms, batch_start);
+}
+
+// Copy the performance counters of the current run to out (NUM_PERF_STATS doubles in
+// PERF_* order). Returns 1 in HESTON_PERF builds and 0 otherwise, with out all zeros.
+EMSCRIPTEN_KEEPALIVE
+int get_perf_stats(HestonContext *ctx, double *out) {
+    memset(out, 0, NUM_PERF_STATS * sizeof(double));
+#ifdef HESTON_PERF
+    const PerfCounters *perf = &ctx->stats.perf;
+    double paths = ctx->simulation_count;
+    out[PERF_RNG_MS] = perf->rng_ms;
+    out[PERF_STEP_MS] = perf->step_ms;
+    out[PERF_PAYOFF_MS] = perf->payoff_ms;
+    out[PERF_COPY_OUT_MS] = perf->copy_out_ms;
+    out[PERF_PERCENTILE_MS] = perf->percentile_ms;
+    out[PERF_BATCH_MS] = perf->batch_ms;
+    out[PERF_PATHS] = paths;
+    out[PERF_STEPS] = paths * ctx->N;
+    out[PERF_DRAWS] = perf->draws;
+    if (perf->batch_ms > 0.0) {
+        out[PERF_PATHS_PER_SEC] = 1e3 * paths / perf->batch_ms;
+        out[PERF_STEPS_PER_SEC] = 1e3 * paths * ctx->N / perf->batch_ms;
+    }
+    return 1;
+#else
+    (void)ctx;
+    return 0;
+#endif
+}
+
+// Keep up to RESULT_CACHE_SIZE finished or stopped runs (1, the default) or none (0),
+// which also empties the cache. Takes effect at the next initialize_simulation.
+EMSCRIPTEN_KEEPALIVE
+void set_result_cache(HestonContext *ctx, int enabled) {
+    ctx->cache_disabled = !enabled;
+    if (!enabled) {
+        memset(ctx->cache, 0, sizeof(ctx->cache));
+    }
+}
+
+// Get the number of samples the current run took over from the result cache (0 for a run
+// that started from zero)
+EMSCRIPTEN_KEEPALIVE
+int get_restored_count(HestonContext *ctx) {
+    return ctx->restored_count;
+}
+
+// Set the seed used by the next initialize_simulation (JS numbers carry 53 bits exactly)
+EMSCRIPTEN_KEEPALIVE
+void set_random_seed(HestonContext *ctx, double seed) {
+    ctx->options.seed = (uint64_t)seed;
+}
+
+// Get current simulation count
+EMSCRIPTEN_KEEPALIVE
+int get_simulation_count(HestonContext *ctx) {
+    return ctx->simulation_count;
+}
+
+// Get current option price
+EMSCRIPTEN_KEEPALIVE
+double get_option_price(HestonContext *ctx) {
+    return ctx->current_option_price;
+}
+
+// Get the standard error of the current option price
+EMSCRIPTEN_KEEPALIVE
+double get_standard_error(HestonContext *ctx) {
+    return ctx->standard_error;
+}
+
+// Stop automatically once the 95% confidence half-width is at most `tolerance`
+// (0 disables); takes effect at the next initialize_simulation
+EMSCRIPTEN_KEEPALIVE
+void set_target_tolerance(HestonContext *ctx, double tolerance) {
+    ctx->options.target_tolerance = tolerance > 0.0 ? tolerance : 0.0;
+}
+
+// Check whether the run has reached its target tolerance
+EMSCRIPTEN_KEEPALIVE
+int is_converged(HestonContext *ctx) {
+    return ctx->converged;
+}
+
+// Price European options (calls or puts, as set by set_payoff) on a strike x maturity
+// grid from one set of num_paths paths, using the model parameters, time-step density
+// (N steps over the longest maturity), seed and antithetic setting of the last
+// initialize_simulation. maturities must be strictly increasing. Prices go to
+// out_prices[m * num_strikes + k] for maturity m and strike k; out_std_errors (same
+// layout) may be NULL. Returns the number of paths simulated, or -1 on invalid input or
+// when a path-dependent payoff is active.
+EMSCRIPTEN_KEEPALIVE
+int price_option_grid(HestonContext *ctx, const double *strikes, int num_strikes, const double *maturities,
+                      int num_maturities, int num_paths, double *out_prices, double *out_std_errors) {
+    const PayoffSpec *payoff = &ctx->active.payoff;
+    if (!strikes || !maturities || !out_prices || num_strikes <= 0 || num_maturities <= 0 ||
+        num_paths <= 0 || ctx->N <= 0 || payoff->style != PAYOFF_EUROPEAN) {
+        return -1;
+    }
+    for (int m = 0; m < num_maturities; m++) {
+        if (maturities[m] <= (m > 0 ? maturities[m - 1] : 0.0)) return -1;
+    }
+
+    int cells = num_strikes * num_maturities;
+    int per_sample = (ctx->active.variance_reduction & VR_ANTITHETIC) ? 2 : 1;
+    int *steps = (int*)malloc(num_maturities * sizeof(int));
+    double *observed = (double*)malloc(per_sample * num_maturities * sizeof(double));
+    PayoffStats *stats = (PayoffStats*)calloc(cells, sizeof(PayoffStats));
+    if (!steps || !observed || !stats) {
+        free(steps);
+        free(observed);
+        free(stats);
+        return -1;
+    }
+
+    double t_max = maturities[num_maturities - 1];
+    for (int m = 0; m < num_maturities; m++) {
+        double span = maturities[m] - (m > 0 ? maturities[m - 1] : 0.0);
+        long n = lround(ctx->N * span / t_max);
+        steps[m] = n < 1 ? 1 : (int)n;
+    }
+
+    // Every payoff of a path is accumulated before the next path is generated
+    int samples = (num_paths + per_sample - 1) / per_sample;
+    for (int s = 0; s < samples; s++) {
+        for (int j = 0; j < per_sample; j++) {
+            uint64_t path = (uint64_t)s * per_sample + j;
+            rng_seek(&ctx->rng, path_substream(ctx, path), 0);
+            simulate_observed_prices(&ctx->rng, path_sign(ctx, path), ctx->S0, ctx->v0,
+                                     ctx->r, ctx->theta, ctx->kappa, ctx->xi,
+                                     ctx->rho, ctx->active.scheme, maturities, steps, num_maturities,
+                                     observed + j * num_maturities);
+        }
+        for (int m = 0; m < num_maturities; m++) {
+            for (int k = 0; k < num_strikes; k++) {
+                double y = 0.0;
+                for (int j = 0; j < per_sample; j++) {
+                    y += payoff_amount(payoff, observed[j * num_maturities + m], strikes[k]);
+                }
+                stats_add(&stats[m * num_strikes + k], y / per_sample, 0.0);
+            }
+        }
+    }
+
+    for (int m = 0; m < num_maturities; m++) {
+        double discount = exp(-ctx->r * maturities[m]);
+        for (int k = 0; k < num_strikes; k++) {
+            const PayoffStats *c = &stats[m * num_strikes + k];
+            out_prices[m * num_strikes + k] = discount * c->mean_y;
+            if (out_std_errors) {
+                out_std_errors[m * num_strikes + k] = c->n > 1.0 ?
+                    discount * sqrt(c->m2_y / (c->n - 1.0) / c->n) : 0.0;
+            }
+        }
+    }
+
+    free(steps);
+    free(observed);
+    free(stats);
+    return samples * per_sample;
+}
+
+// One sample of the level-`level` MLMC correction: the payoff on 2 * coarse_steps steps
+// minus the payoff on coarse_steps steps, with each coarse normal the scaled sum of the
+// two fine normals it spans, so both paths follow the same Brownian motion. Level 0 is
+// the plain payoff on coarse_steps steps.
+static double mlmc_sample(HestonContext *ctx, RngStream *rng, const StepParams *fine,
+                          const StepParams *coarse, int coarse_steps, int level) {
+    double S_c = ctx->S0, v_c = ctx->v0;
+    if (level == 0) {
+        for (int n = 0; n < coarse_steps; n++) {
+            double z1 = normal_random(rng);
+            double z2 = normal_random(rng);
+            heston_step(coarse, z1, z2, &S_c, &v_c);
+        }
+        return payoff_amount(&ctx->active.payoff, S_c, ctx->K);
+    }
+
+    double S_f = S_c, v_f = v_c;
+    for (int n = 0; n < coarse_steps; n++) {
+        double a1 = normal_random(rng), a2 = normal_random(rng);
+        double b1 = normal_random(rng), b2 = normal_random(rng);
+        heston_step(fine, a1, a2, &S_f, &v_f);
+        heston_step(fine, b1, b2, &S_f, &v_f);
+        heston_step(coarse, (a1 + b1) * M_SQRT1_2, (a2 + b2) * M_SQRT1_2, &S_c, &v_c);
+    }
+    return payoff_amount(&ctx->active.payoff, S_f, ctx->K) - payoff_amount(&ctx->active.payoff, S_c, ctx->K);
+}
+
+// Multilevel Monte Carlo (Giles, 2008) price of the initialized option to a target RMSE.
+// Level l simulates base_steps * 2^l steps coupled with half as many; samples per level
+// follow N_l ~ sqrt(V_l / C_l) from the observed correction variances V_l and costs C_l,
+// and levels are added (up to max_level) until the estimated weak error of the finest
+// one is below target_rmse / sqrt(2). Returns the number of levels used, or -1 on
+// invalid input or when a path-dependent payoff is active. out_summary receives {price, standard error, bias estimate, cost in path
+// steps}; out_levels, if given, receives {samples, mean, variance} per level (discounted).
+EMSCRIPTEN_KEEPALIVE
+int price_mlmc(HestonContext *ctx, double target_rmse, int base_steps, int max_level, double *out_summary,
+               double *out_levels) {
+    if (!out_summary || !(target_rmse > 0.0) || base_steps <= 0 || max_level < 0 ||
+        max_level >= MLMC_MAX_LEVELS || ctx->N <= 0 || ctx->active.payoff.style != PAYOFF_EUROPEAN) {
+        return -1;
+    }
+
+    double discount = exp(-ctx->r * ctx->T);
+    double eps = target_rmse / discount;  // In undiscounted payoff units
+    PayoffStats stats[MLMC_MAX_LEVELS] = {{0}};
+    StepParams steps[MLMC_MAX_LEVELS];
+    double extra[MLMC_MAX_LEVELS] = {0};
+    double cost[MLMC_MAX_LEVELS];
+    for (int l = 0; l <= max_level; l++) {
+        step_params_init(&steps[l], ctx->active.scheme, ctx->r, ctx->theta, ctx->kappa,
+                         ctx->xi, ctx->rho, ctx->T / ((double)base_steps * (1 << l)));
+        cost[l] = (double)base_steps * (l ? 3 << (l - 1) : 1);  // Fine plus coarse steps
+    }
+
+    int L = max_level < 2 ? max_level : 2;
+    for (int l = 0; l <= L; l++) extra[l] = MLMC_INITIAL_SAMPLES;
+
+    double bias = 0.0;
+    for (;;) {
+        // Level l sample i reads substream (l + 1) * 2^40 + i, far above the main run's
+        for (int l = 0; l <= L; l++) {
+            int coarse_steps = base_steps * (l ? 1 << (l - 1) : 1);
+            for (long long i = 0; i < (long long)extra[l]; i++) {
+                uint64_t stream = ((uint64_t)(l + 1) << 40) + (uint64_t)stats[l].n;
+                rng_seek(&ctx->rng, stream, 0);
+                stats_add(&stats[l], mlmc_sample(ctx, &ctx->rng, &steps[l], l ? &steps[l - 1] : &steps[0],
+                                                 coarse_steps, l), 0.0);
+            }
+            extra[l] = 0;
+        }
+
+        double sum = 0.0;
+        for (int l = 0; l <= L; l++) {
+            double V = stats[l].n > 1.0 ? stats[l].m2_y / (stats[l].n - 1.0) : 0.0;
+            sum += sqrt(V * cost[l]);
+        }
+        int pending = 0;
+        for (int l = 0; l <= L; l++) {
+            double V = stats[l].n > 1.0 ? stats[l].m2_y / (stats[l].n - 1.0) : 0.0;
+            double target = ceil(2.0 / (eps * eps) * sqrt(V / cost[l]) * sum);
+            if (target > stats[l].n) {
+                extra[l] = target - stats[l].n;
+                pending = 1;
+            }
+        }
+        if (pending) continue;
+
+        // Weak order 1: the next correction would be about half of this one
+        bias = fmax(fabs(stats[L].mean_y), L > 0 ? 0.5 * fabs(stats[L - 1].mean_y) : 0.0);
+        if (bias <= eps / M_SQRT2 || L == max_level) break;
+        L++;
+        extra[L] = MLMC_INITIAL_SAMPLES;
+    }
+
+    double price = 0.0, variance = 0.0, total_cost = 0.0;
+    for (int l = 0; l <= L; l++) {
+        double V = stats[l].n > 1.0 ? stats[l].m2_y / (stats[l].n - 1.0) : 0.0;
+        price += stats[l].mean_y;
+        variance += V / stats[l].n;
+        total_cost += stats[l].n * cost[l];
+        if (out_levels) {
+            out_levels[3 * l] = stats[l].n;
+            out_levels[3 * l + 1] = discount * stats[l].mean_y;
+            out_levels[3 * l + 2] = discount * discount * V;
+        }
+    }
+    out_summary[0] = discount * price;
+    out_summary[1] = discount * sqrt(variance);
+    out_summary[2] = discount * bias;
+    out_summary[3] = total_cost;
+    return L + 1;
+}
+
+// Undiscounted European payoff of one Milstein or full-truncation path and, by reverse-mode
+// differentiation of its step loop, the payoff's derivatives with respect to
+// v0, theta, kappa, xi and rho in sens[SENS_V0 ..]. The forward pass records only the
+// variance before each step in tape (N doubles); ln S enters every step linearly, so
+// its adjoint is constant along the path. The backward pass regenerates the normals
+// from the path's substream a block at a time.
+static double adjoint_path(HestonContext *ctx, RngStream *rng, uint64_t stream, double z_sign,
+                           const StepParams *p, int N, double *tape, double *sens) {
+    const int chunk = RNG_BLOCK / 2;  // Steps per block of normals
+    double S = ctx->S0, v = ctx->v0;
+    rng_seek(rng, stream, 0);
+    for (int i = 0; i < N; i++) {
+        double z1 = z_sign * normal_random(rng);
+        double z2 = z_sign * normal_random(rng);
+        tape[i] = v;
+        heston_step(p, z1, z2, &S, &v);
+    }
+
+    double K = ctx->K;
+    // d payoff / d ln S_T, and so d ln S_i for every i
+    double x_bar = ctx->active.payoff.put ? (S < K ? -S : 0.0) : (S > K ? S : 0.0);
+    double v_bar = 0.0;              // d payoff / d v_i
+    double theta_bar = 0.0, kappa_bar = 0.0, xi_bar = 0.0, rho_adj = 0.0;
+    double milstein = p->scheme == SCHEME_MILSTEIN;
+    double dZv_drho_z2 = p->rho_bar > 1e-12 ? -p->rho / p->rho_bar : 0.0;
+
+    double z[RNG_BLOCK];
+    for (int start = ((N - 1) / chunk) * chunk; start >= 0; start -= chunk) {
+        int end = start + chunk < N ? start + chunk : N;
+        rng_seek(rng, stream, 2 * (uint64_t)start);
+        for (int j = 0; j < 2 * (end - start); j++) {
+            z[j] = z_sign * normal_random(rng);
+        }
+
+        for (int i = end - 1; i >= start; i--) {
+            double z1 = z[2 * (i - start)], z2 = z[2 * (i - start) + 1];
+            double a = tape[i];
+            double c = fmax(a, 0.0);
+            double positive = a > 0.0;
+            double sq = sqrt(c * p->dt);
+            double ds_da = positive ? 0.5 * p->sqrt_dt / sqrt(c) : 0.0;
+            double Z_v = p->rho * z1 + p->rho_bar * z2;
+
+            // v' = a + kappa (theta - c) dt + xi sq Z_v + milstein (xi^2 dt / 4)(Z_v^2 - 1)
+            theta_bar += v_bar * p->kappa * p->dt;
+            kappa_bar += v_bar * (p->theta - c) * p->dt;
+            xi_bar += v_bar * (Z_v * sq + milstein * 0.5 * p->xi * p->dt * (Z_v * Z_v - 1.0));
+            rho_adj += v_bar * (p->xi * sq + 2.0 * p->milstein * Z_v) * (z1 + dZv_drho_z2 * z2);
+
+            // ln S' = ln S + (r - v_drift / 2) dt + z1 sq, v_drift = a (Milstein) or c
+            double dv_da = 1.0 - p->kappa * p->dt * positive + p->xi * Z_v * ds_da;
+            double dx_da = -0.5 * p->dt * (milstein ? 1.0 : positive) + z1 * ds_da;
+            v_bar = v_bar * dv_da + x_bar * dx_da;
+        }
+    }
+
+    sens[SENS_V0] = v_bar;
+    sens[SENS_THETA] = theta_bar;
+    sens[SENS_KAPPA] = kappa_bar;
+    sens[SENS_XI] = xi_bar;
+    sens[SENS_RHO] = rho_adj;
+    return payoff_amount(&ctx->active.payoff, S, K);
+}
+
+// Price the initialized option together with dC/d{v0, theta, kappa, xi, rho} from
+// num_paths paths, by adjoint differentiation of each path (see adjoint_path), at about
+// three times the cost of pricing alone. out_values and out_std_errors (may be NULL) get
+// NUM_SENSITIVITIES entries in SENS_* order. Paths read the same substreams as the main
+// run; antithetic variates are honoured. Returns the number of paths simulated, or -1
+// on invalid input, for the QE scheme, which has no adjoint here, or when a
+// path-dependent payoff is active.
+EMSCRIPTEN_KEEPALIVE
+int price_sensitivities(HestonContext *ctx, int num_paths, double *out_values, double *out_std_errors) {
+    int N = ctx->N;
+    if (!out_values || num_paths <= 0 || N <= 0 || !ctx->variance_scratch) return -1;
+
+    const StepParams *p = &ctx->step;
+    if (p->scheme == SCHEME_QE || ctx->active.payoff.style != PAYOFF_EUROPEAN) return -1;
+
+    int per_sample = (ctx->active.variance_reduction & VR_ANTITHETIC) ? 2 : 1;
+    int samples = (num_paths + per_sample - 1) / per_sample;
+    PayoffStats stats[NUM_SENSITIVITIES] = {{0}};
+    for (int s = 0; s < samples; s++) {
+        double sum[NUM_SENSITIVITIES] = {0};
+        for (int j = 0; j < per_sample; j++) {
+            uint64_t path = (uint64_t)s * per_sample + j;
+            double sens[NUM_SENSITIVITIES];
+            sens[SENS_PRICE] = adjoint_path(ctx, &ctx->rng, path_substream(ctx, path), path_sign(ctx, path),
+                                            p, N, ctx->variance_scratch, sens);
+            for (int k = 0; k < NUM_SENSITIVITIES; k++) {
+                sum[k] += sens[k];
+            }
+        }
+        for (int k = 0; k < NUM_SENSITIVITIES; k++) {
+            stats_add(&stats[k], sum[k] / per_sample, 0.0);
+        }
+    }
+
+    double discount = exp(-ctx->r * ctx->T);
+    for (int k = 0; k < NUM_SENSITIVITIES; k++) {
+        out_values[k] = discount * stats[k].mean_y;
+        if (out_std_errors) {
+            out_std_errors[k] = stats[k].n > 1.0 ?
+                discount * sqrt(stats[k].m2_y / (stats[k].n - 1.0) / stats[k].n) : 0.0;
+        }
+    }
+    return samples * per_sample;
+}
+
+typedef struct {
+    double K, T, price;
+} MarketQuote;
+
+static int compare_quote_maturity(const void *a, const void *b) {
+    double ta = ((const MarketQuote*)a)->T, tb = ((const MarketQuote*)b)->T;
+    return (ta > tb) - (ta < tb);
+}
+
+// Residuals model - (market - offset) of quotes sorted by maturity, and their Jacobian
+// (CALIB_PARAMS per quote); each maturity is priced as one slice. Returns the sum of squares.
+static double calibration_residuals(HestonContext *ctx, const double *params, const MarketQuote *quotes, int n,
+                                    const double *offset, double *strikes, double *model, double *residuals,
+                                    double *jac, double *work) {
+    for (int start = 0; start < n; ) {
+        int end = start;
+        while (end < n && quotes[end].T == quotes[start].T) {
+            strikes[end - start] = quotes[end].K;
+            end++;
+        }
+        lewis_maturity_slice(params, ctx->S0, ctx->r, quotes[start].T, strikes, end - start,
+                             model + start, jac + (size_t)CALIB_PARAMS * start, work);
+        start = end;
+    }
+    double sum_sq = 0.0;
+    for (int i = 0; i < n; i++) {
+        residuals[i] = model[i] - (quotes[i].price - (offset ? offset[i] : 0.0));
+        sum_sq += residuals[i] * residuals[i];
+    }
+    return sum_sq;
+}
+
+// Solve the CALIB_PARAMS x CALIB_PARAMS system A x = b by Gaussian elimination with
+// partial pivoting (A and b are overwritten). Returns 0 if A is singular.
+static int solve_dense(double A[CALIB_PARAMS][CALIB_PARAMS], double *b, double *x) {
+    const int n = CALIB_PARAMS;
+    for (int c = 0; c < n; c++) {
+        int pivot = c;
+        for (int r = c + 1; r < n; r++) {
+            if (fabs(A[r][c]) > fabs(A[pivot][c])) pivot = r;
+        }
+        if (fabs(A[pivot][c]) < 1e-300) return 0;
+        if (pivot != c) {
+            for (int k = 0; k < n; k++) {
+                double t = A[c][k]; A[c][k] = A[pivot][k]; A[pivot][k] = t;
+            }
+            double t = b[c]; b[c] = b[pivot]; b[pivot] = t;
+        }
+        for (int r = c + 1; r < n; r++) {
+            double f = A[r][c] / A[c][c];
+            for (int k = c; k < n; k++) A[r][k] -= f * A[c][k];
+            b[r] -= f * b[c];
+        }
+    }
+    for (int r = n - 1; r >= 0; r--) {
+        double sum = b[r];
+        for (int k = r + 1; k < n; k++) sum -= A[r][k] * x[k];
+        x[r] = sum / A[r][r];
+    }
+    return 1;
+}
+
+// Levenberg-Marquardt fit of params to the quotes, starting from params; steps are
+// projected onto the CALIB_LOWER/CALIB_UPPER box. buffers holds (6 + 3 CALIB_PARAMS) n
+// doubles. Returns the iterations taken.
+static int calibrate_levenberg_marquardt(HestonContext *ctx, double *params, const MarketQuote *quotes, int n,
+                                         const double *offset, double *buffers) {
+    double *strikes = buffers;
+    double *model = strikes + n;
+    double *residuals = model + n;
+    double *jac = residuals + n;
+    double *trial_residuals = jac + (size_t)CALIB_PARAMS * n;
+    double *trial_jac = trial_residuals + n;
+    double *work = trial_jac + (size_t)CALIB_PARAMS * n;
+
+    double cost = calibration_residuals(ctx, params, quotes, n, offset, strikes, model, residuals, jac, work);
+    double lambda = 1e-3;
+    int iteration = 0;
+    while (iteration < CALIB_MAX_ITERATIONS && lambda < 1e12) {
+        iteration++;
+        double A[CALIB_PARAMS][CALIB_PARAMS] = {{0}}, g[CALIB_PARAMS] = {0}, step[CALIB_PARAMS];
+        for (int i = 0; i < n; i++) {
+            const double *row = jac + (size_t)CALIB_PARAMS * i;
+            for (int a = 0; a < CALIB_PARAMS; a++) {
+                g[a] -= row[a] * residuals[i];
+                for (int b = 0; b < CALIB_PARAMS; b++) A[a][b] += row[a] * row[b];
+            }
+        }
+
+        // Retry with more damping until a step lowers the cost
+        int accepted = 0;
+        while (!accepted && lambda < 1e12) {
+            double M[CALIB_PARAMS][CALIB_PARAMS], rhs[CALIB_PARAMS], trial[CALIB_PARAMS];
+            memcpy(M, A, sizeof(M));
+            memcpy(rhs, g, sizeof(rhs));
+            for (int a = 0; a < CALIB_PARAMS; a++) M[a][a] += lambda * fmax(A[a][a], 1e-12);
+            if (!solve_dense(M, rhs, step)) {
+                lambda *= 4.0;
+                continue;
+            }
+            for (int a = 0; a < CALIB_PARAMS; a++) {
+                trial[a] = fmin(fmax(params[a] + step[a], CALIB_LOWER[a]), CALIB_UPPER[a]);
+            }
+            double trial_cost = calibration_residuals(ctx, trial, quotes, n, offset, strikes, model,
+                                                      trial_residuals, trial_jac, work);
+            if (trial_cost < cost) {
+                double gain = cost - trial_cost;
+                memcpy(params, trial, sizeof(trial));
+                memcpy(residuals, trial_residuals, n * sizeof(double));
+                memcpy(jac, trial_jac, (size_t)CALIB_PARAMS * n * sizeof(double));
+                cost = trial_cost;
+                lambda = fmax(lambda / 3.0, 1e-12);
+                accepted = 1;
+                if (gain <= 1e-12 * cost + 1e-28) return iteration;
+            } else {
+                lambda *= 4.0;
+            }
+        }
+    }
+    return iteration;
+}
+
+// Fit v0, theta, kappa, xi and rho to num_quotes market call prices, given as (K, T, price)
+// triples, with S0 and r held at the initialized values. The objective is the sum of
+// squared price errors of the semi-analytic pricer, minimized by Levenberg-Marquardt from
+// the current parameters with analytic gradients. With mc_paths > 0 the fit is then
+// refined against the Monte Carlo model: each quote's target is shifted by its Monte
+// Carlo minus analytic price at the current fit (price_option_grid, one path set per
+// maturity, at the current scheme and N, always for calls whatever the payoff) and the
+// analytic fit repeated, CALIB_MC_PASSES times. The fitted parameters replace the
+// simulation's, which is re-initialized. out_result receives the five parameters and the
+// RMS error against the final targets. Returns the total iterations, or -1 on invalid
+// input or if the Monte Carlo pricing fails (the simulation is then left unchanged).
+EMSCRIPTEN_KEEPALIVE
+int calibrate_heston(HestonContext *ctx, const double *quote_data, int num_quotes, int mc_paths, double *out_result) {
+    if (!quote_data || !out_result || num_quotes <= 0 || ctx->N <= 0) return -1;
+
+    int n = num_quotes;
+    MarketQuote *quotes = (MarketQuote*)malloc(n * sizeof(MarketQuote));
+    double *buffers = (double*)malloc((size_t)(6 + 3 * CALIB_PARAMS) * n * sizeof(double));
+    double *offset = (double*)calloc(n, sizeof(double));
+    double *mc_prices = (double*)malloc(n * sizeof(double));
+    int valid = quotes && buffers && offset && mc_prices;
+    for (int i = 0; valid && i < n; i++) {
+        quotes[i].K = quote_data[3 * i];
+        quotes[i].T = quote_data[3 * i + 1];
+        quotes[i].price = quote_data[3 * i + 2];
+        valid = quotes[i].K > 0.0 && quotes[i].T > 0.0;
+    }
+    if (!valid) {
+        free(quotes);
+        free(buffers);
+        free(offset);
+        free(mc_prices);
+        return -1;
+    }
+    qsort(quotes, n, sizeof(MarketQuote), compare_quote_maturity);
+
+    double params[CALIB_PARAMS] = {ctx->v0, ctx->theta, ctx->kappa, ctx->xi, ctx->rho};
+    for (int a = 0; a < CALIB_PARAMS; a++) {
+        params[a] = fmin(fmax(params[a], CALIB_LOWER[a]), CALIB_UPPER[a]);
+    }
+    int iterations = calibrate_levenberg_marquardt(ctx, params, quotes, n, NULL, buffers);
+
+    double *strikes = buffers, *model = buffers + n, *residuals = buffers + 2 * n;
+    double *jac = buffers + 3 * n, *work = jac + (size_t)CALIB_PARAMS * n;
+    int refined = 0, priced = 1;
+    // The quotes are calls, so the refinement prices calls whatever payoff the run has
+    double model_saved[CALIB_PARAMS] = {ctx->v0, ctx->theta, ctx->kappa, ctx->xi, ctx->rho};
+    PayoffSpec payoff_saved = ctx->active.payoff;
+    ctx->active.payoff.style = PAYOFF_EUROPEAN;
+    ctx->active.payoff.put = 0;
+    for (int pass = 0; mc_paths > 0 && pass < CALIB_MC_PASSES; pass++) {
+        ctx->v0 = params[0];
+        ctx->theta = params[1];
+        ctx->kappa = params[2];
+        ctx->xi = params[3];
+        ctx->rho = params[4];
+        for (int start = 0; priced && start < n; ) {
+            int end = start;
+            while (end < n && quotes[end].T == quotes[start].T) {
+                strikes[end - start] = quotes[end].K;
+                end++;
+            }
+            priced = price_option_grid(ctx, strikes, end - start, &quotes[start].T, 1, mc_paths,
+                                       mc_prices + start, NULL) >= 0;
+            start = end;
+        }
+        if (!priced) break;
+        refined = 1;
+        calibration_residuals(ctx, params, quotes, n, NULL, strikes, model, residuals, jac, work);
+        for (int i = 0; i < n; i++) {
+            offset[i] = mc_prices[i] - model[i];
+        }
+        iterations += calibrate_levenberg_marquardt(ctx, params, quotes, n, offset, buffers);
+    }
+    ctx->active.payoff = payoff_saved;
+    if (!priced) {
+        ctx->v0 = model_saved[0];
+        ctx->theta = model_saved[1];
+        ctx->kappa = model_saved[2];
+        ctx->xi = model_saved[3];
+        ctx->rho = model_saved[4];
+        free(quotes);
+        free(buffers);
+        free(offset);
+        free(mc_prices);
+        return -1;
+    }
+
+    double cost = calibration_residuals(ctx, params, quotes, n, refined ? offset : NULL, strikes, model,
+                                        residuals, jac, work);
+    for (int a = 0; a < CALIB_PARAMS; a++) {
+        out_result[a] = params[a];
+    }
+    out_result[CALIB_PARAMS] = sqrt(cost / n);
+
+    initialize_simulation(ctx, ctx->S0, params[0], ctx->r, params[1], params[2], params[3], params[4],
+                          ctx->T, ctx->K, ctx->N);
+    free(quotes);
+    free(buffers);
+    free(offset);
+    free(mc_prices);
+    return iterations;
+}
+
+// Get Black-Scholes price
+EMSCRIPTEN_KEEPALIVE
+double get_black_scholes_price(HestonContext *ctx) {
+    return ctx->black_scholes_price;
+}
+
+// Get semi-analytic Heston price for the initialized parameters
+EMSCRIPTEN_KEEPALIVE
+double get_analytic_price(HestonContext *ctx) {
+    return ctx->analytic_price;
+}
+
+// Replay a candidate's full path from its substream if it is not already built
+double* build_candidate_path(HestonContext *ctx, PercentileCandidate *c) {
+    if (!c->has_candidate || !c->path || !ctx->variance_scratch) return NULL;
+    if (!c->built || c->built_index != c->path_index) {
+        PERF_BEGIN(start);
+        path_seek(ctx, &ctx->rng, c->path_index);
+        simulate_single_path(&ctx->rng, path_sign(ctx, c->path_index), c->path, ctx->variance_scratch,
+                             ctx->S0, ctx->v0, ctx->r, ctx->theta, ctx->kappa,
+                             ctx->xi, ctx->rho, ctx->T, ctx->N, ctx->active.scheme);
+        c->built = 1;
+        c->built_index = c->path_index;
+        PERF_END(ctx->stats.perf.copy_out_ms, start);
+    }
+    return c->path;
+}
+
+// Step of checkpoint j of a run with K = path_checkpoints checkpoints; the first and last
+// are steps 0 and N
+static inline int checkpoint_step(const HestonContext *ctx, int j) {
+    return (int)((int64_t)j * ctx->N / (ctx->path_checkpoints - 1));
+}
+
+// A replay of one percentile path, step by step: read from the stored path, or stepped
+// from (S, v) on the path's own substream
+typedef struct {
+    const double *path;  // Whole path, or NULL to step
+    double S, v;
+    double z_sign;
+    int step;            // Step the replay is at
+} PathReplay;
+
+static inline double replay_next(HestonContext *ctx, PathReplay *r) {
+    r->step++;
+    if (r->path) return r->path[r->step];
+    double z1 = r->z_sign * normal_random(&ctx->rng);
+    double z2 = r->z_sign * normal_random(&ctx->rng);
+    heston_step(&ctx->step, z1, z2, &r->S, &r->v);
+    return r->S;
+}
+
+// Record candidate c's (S, v) at every checkpoint step by replaying the path once
+static int build_candidate_checkpoints(HestonContext *ctx, PercentileCandidate *c) {
+    if (!c->has_candidate || !c->checkpoints) return 0;
+    if (c->built && c->built_index == c->path_index) return 1;
+    PERF_BEGIN(start);
+    int K = ctx->path_checkpoints;
+    PathReplay r = { NULL, ctx->S0, ctx->v0, path_sign(ctx, c->path_index), 0 };
+    path_seek(ctx, &ctx->rng, c->path_index);
+    c->checkpoints[0] = r.S;
+    c->checkpoints[K] = r.v;
+    for (int j = 1; j < K; j++) {
+        int target = checkpoint_step(ctx, j);
+        while (r.step < target) replay_next(ctx, &r);
+        c->checkpoints[j] = r.S;
+        c->checkpoints[K + j] = r.v;
+    }
+    c->built = 1;
+    c->built_index = c->path_index;
+    PERF_END(ctx->stats.perf.copy_out_ms, start);
+    return 1;
+}
+
+// Start a replay of candidate c at step `step`: from the stored path, or from the last
+// checkpoint at or before it, with the substream sought to that checkpoint's draws
+static int replay_begin(HestonContext *ctx, PercentileCandidate *c, int step, PathReplay *r) {
+    if (!ctx->path_checkpoints) {
+        double *path = build_candidate_path(ctx, c);
+        if (!path) return 0;
+        *r = (PathReplay){ path, path[step], 0.0, 1.0, step };
+        return 1;
+    }
+    if (!build_candidate_checkpoints(ctx, c)) return 0;
+    int K = ctx->path_checkpoints;
+    int j = (int)((int64_t)step * (K - 1) / ctx->N);
+    while (j > 0 && checkpoint_step(ctx, j) > step) j--;
+    while (j + 1 < K && checkpoint_step(ctx, j + 1) <= step) j++;
+    *r = (PathReplay){ NULL, c->checkpoints[j], c->checkpoints[K + j], path_sign(ctx, c->path_index),
+                       checkpoint_step(ctx, j) };
+    path_seek_step(ctx, &ctx->rng, c->path_index, r->step);
+    while (r->step < step) replay_next(ctx, r);
+    return 1;
+}
+
+// Set how percentile paths are chosen (PERCENTILE_STORED or PERCENTILE_STREAMING);
+// takes effect at the next initialize_simulation
+EMSCRIPTEN_KEEPALIVE
+void set_percentile_mode(HestonContext *ctx, int mode) {
+    ctx->options.percentile_mode = mode == PERCENTILE_STREAMING ? PERCENTILE_STREAMING : PERCENTILE_STORED;
+}
+
+// Keep percentile paths whole (0) or only as their (S, v) states at `checkpoints` evenly
+// spaced steps (at least 2, at most N+1), from which get_decimated_window replays any
+// window; takes effect at the next initialize_simulation. get_percentile_path(s) then
+// return NULL.
+EMSCRIPTEN_KEEPALIVE
+void set_path_checkpoints(HestonContext *ctx, int checkpoints) {
+    ctx->options.path_checkpoints = checkpoints <= 0 ? 0 : (checkpoints < 2 ? 2 : checkpoints);
+}
+
+// Set the variance reduction techniques (VR_* flags, combinable); takes effect at the
+// next initialize_simulation
+EMSCRIPTEN_KEEPALIVE
+void set_variance_reduction(HestonContext *ctx, int flags) {
+    ctx->options.variance_reduction = flags & (VR_ANTITHETIC | VR_CONTROL_VARIATE | VR_MOMENT_MATCHING);
+}
+
+// Use randomized quasi-Monte Carlo with `replicas` independently Owen-scrambled Sobol
+// point sets (2 .. QMC_MAX_REPLICAS), or pseudo-random sampling with 0; takes effect at
+// the next initialize_simulation
+EMSCRIPTEN_KEEPALIVE
+void set_qmc_replicas(HestonContext *ctx, int replicas) {
+    if (replicas <= 0) {
+        ctx->options.qmc_replicas = 0;
+    } else {
+        ctx->options.qmc_replicas = replicas < 2 ? 2 : (replicas > QMC_MAX_REPLICAS ? QMC_MAX_REPLICAS : replicas);
+    }
+}
+
+// Estimate delta, vega (dC/dv0) and gamma from the priced paths (1) or not (0); takes
+// effect at the next initialize_simulation. Greek runs use the scalar kernel and only
+// apply to European payoffs.
+EMSCRIPTEN_KEEPALIVE
+void set_greeks(HestonContext *ctx, int enabled) {
+    ctx->options.greeks = enabled ? 1 : 0;
+}
+
+// Price the option described by style (PAYOFF_*), option_type (OPTION_*) and, for
+// PAYOFF_BARRIER, barrier_type (BARRIER_*) with barrier level `barrier`; takes effect
+// at the next initialize_simulation. Grids, MLMC and sensitivities price the European
+// call or put and return -1 for path-dependent styles; calibration always fits calls.
+EMSCRIPTEN_KEEPALIVE
+void set_payoff(HestonContext *ctx, int style, int option_type, int barrier_type, double barrier) {
+    PayoffSpec *payoff = &ctx->options.payoff;
+    payoff->style = style >= PAYOFF_EUROPEAN && style <= PAYOFF_LOOKBACK ? style : PAYOFF_EUROPEAN;
+    payoff->put = option_type == OPTION_PUT;
+    payoff->barrier_type = barrier_type & (BARRIER_UP | BARRIER_IN);
+    payoff->barrier = barrier;
+}
+
+// Get a Greek (GREEK_*) of the current run and its standard error
+EMSCRIPTEN_KEEPALIVE
+double get_greek(HestonContext *ctx, int greek) {
+    return greek >= 0 && greek < NUM_GREEKS ? ctx->greeks[greek] : 0.0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+double get_greek_standard_error(HestonContext *ctx, int greek) {
+    return greek >= 0 && greek < NUM_GREEKS ? ctx->greek_errors[greek] : 0.0;
+}
+
+// Set the variance discretization (SCHEME_*); takes effect at the next initialize_simulation
+EMSCRIPTEN_KEEPALIVE
+void set_discretization_scheme(HestonContext *ctx, int scheme) {
+    ctx->options.scheme = (scheme == SCHEME_FULL_TRUNCATION || scheme == SCHEME_QE) ? scheme : SCHEME_MILSTEIN;
+}
+
+// Get percentile path data (replayed from the chosen path's substream on first request)
+EMSCRIPTEN_KEEPALIVE
+double* get_percentile_path(HestonContext *ctx, int percentile) {
+    if (ctx->tracking_phase) return NULL;
+    int k;
+    switch (percentile) {
+        case 0: k = 0; break;
+        case 25: k = 1; break;
+        case 50: k = 2; break;
+        case 75: k = 3; break;
+        case 100: k = 4; break;
+        default: return NULL;
+    }
+    return build_candidate_path(ctx, &ctx->candidates[k]);
+}
+
+// Get all five percentile paths (0, 25, 50, 75, 100) as one block of 5 * (N+1) doubles,
+// path k starting at k * (N+1); NULL while tracking or if any path is unavailable
+EMSCRIPTEN_KEEPALIVE
+double* get_percentile_paths(HestonContext *ctx) {
+    if (ctx->tracking_phase || !ctx->percentile_paths) return NULL;
+    for (int k = 0; k < NUM_PERCENTILES; k++) {
+        if (!build_candidate_path(ctx, &ctx->candidates[k])) return NULL;
+    }
+    return ctx->percentile_paths;
+}
+
+// Get a counter that changes whenever the set of percentile paths changes, so callers
+// can skip redrawing identical paths
+EMSCRIPTEN_KEEPALIVE
+int get_percentile_version(HestonContext *ctx) {
+    return ctx->percentile_version;
+}
+
+// Get the percentile paths over steps i0..i1 of the time window [t_start, t_end], reduced
+// to at most max_points points each for charting. Interior steps are split into equal
+// buckets; each bucket keeps its minimum and maximum in time order, and both endpoints
+// are kept, so every peak and trough survives. Layout: [M, y_min, y_max], then for path
+// k = 0..4 at offset 3 + 2kM: M times (years) followed by M prices. Windows of at most
+// max_points steps are returned whole. With path checkpoints the paths are replayed from
+// the checkpoint before the window, so a window costs its own steps plus at most
+// N / (path_checkpoints - 1), whatever its resolution.
+EMSCRIPTEN_KEEPALIVE
+double* get_decimated_window(HestonContext *ctx, double t_start, double t_end, int max_points) {
+    if (ctx->tracking_phase) return NULL;
+
+    int N = ctx->N;
+    double dt = ctx->T / N;
+    // The tolerance keeps window edges that fall on a step (such as 0 and T) on it
+    int i0 = (int)fmax(0.0, fmin(floor(t_start / dt + 1e-9), N - 1.0));
+    int i1 = (int)fmax(i0 + 1.0, fmin(ceil(t_end / dt - 1e-9), (double)N));
+    int interior = i1 - i0 - 1;
+    int buckets = max_points < 4 ? 1 : (max_points - 2) / 2;
+    int whole = i1 - i0 + 1 <= max_points || interior <= 2 * buckets;
+    int M = whole ? i1 - i0 + 1 : 2 * buckets + 2;
+    size_t len = 3 + (size_t)NUM_PERCENTILES * 2 * M;
+    if (ctx->decimated_len < len) {
+        free(ctx->decimated);
+        ctx->decimated = (double*)malloc(len * sizeof(double));
+        ctx->decimated_len = ctx->decimated ? len : 0;
+        if (!ctx->decimated) return NULL;
+    }
+
+    // Build every path (or its checkpoints) first, so the replays below only read them
+    for (int k = 0; k < NUM_PERCENTILES; k++) {
+        PercentileCandidate *c = &ctx->candidates[k];
+        if (ctx->path_checkpoints ? !build_candidate_checkpoints(ctx, c) : !build_candidate_path(ctx, c)) {
+            return NULL;
+        }
+    }
+
+    PERF_BEGIN(start);
+    double y_min = INFINITY, y_max = -INFINITY;
+    for (int k = 0; k < NUM_PERCENTILES; k++) {
+        // Replays share ctx->rng, so each path is finished before the next one starts
+        PathReplay replay, *r = &replay;
+        if (!replay_begin(ctx, &ctx->candidates[k], i0, r)) return NULL;
+        double *t_out = ctx->decimated + 3 + (size_t)k * 2 * M;
+        double *y_out = t_out + M;
+        int m = 0;
+
+        t_out[m] = i0 * dt;
+        y_out[m++] = r->S;
+        if (whole) {
+            for (int i = i0 + 1; i <= i1; i++) {
+                t_out[m] = i * dt;
+                y_out[m++] = replay_next(ctx, r);
+            }
+        } else {
+            for (int b = 0; b < buckets; b++) {
+                int lo = i0 + 1 + (int)((long long)b * interior / buckets);
+                int hi = i0 + 1 + (int)((long long)(b + 1) * interior / buckets);
+                int i_min = lo, i_max = lo;
+                double s_min = replay_next(ctx, r), s_max = s_min;
+                for (int i = lo + 1; i < hi; i++) {
+                    double S = replay_next(ctx, r);
+                    if (S < s_min) { s_min = S; i_min = i; }
+                    if (S > s_max) { s_max = S; i_max = i; }
+                }
+                int max_first = i_max < i_min;
+                t_out[m] = (max_first ? i_max : i_min) * dt;
+                y_out[m++] = max_first ? s_max : s_min;
+                t_out[m] = (max_first ? i_min : i_max) * dt;
+                y_out[m++] = max_first ? s_min : s_max;
+            }
+            t_out[m] = i1 == N ? ctx->T : i1 * dt;
+            y_out[m++] = replay_next(ctx, r);
+        }
+
+        for (int i = 0; i < m; i++) {
+            y_min = fmin(y_min, y_out[i]);
+            y_max = fmax(y_max, y_out[i]);
+        }
+    }
+
+    ctx->decimated[0] = M;
+    ctx->decimated[1] = y_min;
+    ctx->decimated[2] = y_max;
+    PERF_END(ctx->stats.perf.copy_out_ms, start);
+    return ctx->decimated;
+}
+
+// Get the whole percentile paths reduced to at most max_points points each for charting
+// (get_decimated_window over [0, T])
+EMSCRIPTEN_KEEPALIVE
+double* get_decimated_paths(HestonContext *ctx, int max_points) {
+    return get_decimated_window(ctx, 0.0, ctx->T, max_points);
+}
+
 // Get number of time steps
 EMSCRIPTEN_KEEPALIVE
-int get_time_steps() {
-    return sim_state.N;
+int get_time_steps(HestonContext *ctx) {
+    return ctx->N;
 }
 
 // Check if still in tracking phase
 EMSCRIPTEN_KEEPALIVE
-int is_tracking_phase() {
-    return sim_state.tracking_phase;
+int is_tracking_phase(HestonContext *ctx) {
+    return ctx->tracking_phase;
 }
@@ -0,0 +1,176 @@
+// Public interface of the Heston Monte Carlo engine (heston.c), shared by the WebAssembly
+// build and the native library, CLI and benchmark. Each simulation lives in a context
+// from heston_create_context: configure it with the set_* calls, start it with
+// initialize_simulation, then advance it with run_simulation_batch. Contexts are
+// independent and can be interleaved freely; each one keeps its buffers between runs
+// until heston_destroy_context. A context must not be used from two threads at once,
+// and calls on different contexts from different threads take turns on the thread pool.
+#ifndef HESTON_H
+#define HESTON_H
+
+// Symbols exported from the native shared library; Emscripten builds mark the same
+// functions EMSCRIPTEN_KEEPALIVE instead
+#ifndef HESTON_API
+#if defined(__GNUC__) && !defined(__EMSCRIPTEN__)
+#define HESTON_API __attribute__((visibility("default")))
+#else
+#define HESTON_API
+#endif
+#endif
+
+// Percentile path modes
+#define PERCENTILE_STORED 0     // Exact percentiles of the first PERCENTILE_TRACKING_LIMIT paths
+#define PERCENTILE_STREAMING 1  // P² estimates over the whole run; only five paths are kept
+
+// Variance reduction flags (combinable)
+#define VR_ANTITHETIC 1       // Paths 2s and 2s+1 share substream s with opposite signs
+#define VR_CONTROL_VARIATE 2  // Black-Scholes call on the same Brownian path as control
+#define VR_MOMENT_MATCHING 4  // Rescale each batch's S_T so its mean is S0 e^{rT}
+
+// Discretization schemes for the variance process
+#define SCHEME_MILSTEIN 0         // Milstein with truncated drift and diffusion (default)
+#define SCHEME_FULL_TRUNCATION 1  // Full-truncation Euler (Lord, Koekkoek & van Dijk, 2010)
+#define SCHEME_QE 2               // Andersen's Quadratic-Exponential with central log-price step
+
+// Payoffs: a call pays max(A - K, 0) and a put max(K - A, 0) on the path value A.
+// Monitoring uses the simulation's own step dates t_i = iT/N.
+#define PAYOFF_EUROPEAN 0          // A = S_T
+#define PAYOFF_ASIAN_ARITHMETIC 1  // A = mean of S(t_1) .. S(t_N)
+#define PAYOFF_ASIAN_GEOMETRIC 2   // A = geometric mean of S(t_1) .. S(t_N)
+#define PAYOFF_BARRIER 3           // A = S_T, paid only if the barrier condition holds
+#define PAYOFF_LOOKBACK 4          // Fixed strike: A = max S(t_i) (call) or min S(t_i) (put), i = 0..N
+#define OPTION_CALL 0
+#define OPTION_PUT 1
+
+// Barrier types. The barrier H is hit when S(t_i) >= H (up) or S(t_i) <= H (down) at
+// some i = 0..N; knock-out options pay only if it is never hit, knock-in only if it is.
+#define BARRIER_UP 1  // Flag: up barrier (otherwise down)
+#define BARRIER_IN 2  // Flag: knock-in (otherwise knock-out)
+#define BARRIER_DOWN_OUT 0
+#define BARRIER_UP_OUT BARRIER_UP
+#define BARRIER_DOWN_IN BARRIER_IN
+#define BARRIER_UP_IN (BARRIER_UP | BARRIER_IN)
+
+// Greeks accumulated alongside the price
+#define GREEK_DELTA 0
+#define GREEK_VEGA 1   // dC/dv0 (with respect to the initial variance)
+#define GREEK_GAMMA 2
+#define NUM_GREEKS 3
+
+// Adjoint sensitivities: price, then dC/d{v0, theta, kappa, xi, rho}
+#define SENS_PRICE 0
+#define SENS_V0 1
+#define SENS_THETA 2
+#define SENS_KAPPA 3
+#define SENS_XI 4
+#define SENS_RHO 5
+#define NUM_SENSITIVITIES 6
+
+// Calibration fits (v0, theta, kappa, xi, rho)
+#define CALIB_PARAMS 5
+
+// Performance counters of get_perf_stats, accumulated over the current run (including the
+// part restored from the result cache). They are only compiled in with HESTON_PERF. Phase
+// times are in milliseconds summed over threads, so with several threads they can add up
+// to more than PERF_BATCH_MS.
+#define PERF_RNG_MS 0         // Philox draws, inverse-CDF transforms and QMC points
+#define PERF_STEP_MS 1        // Step kernels, without the draws made inside them
+#define PERF_PAYOFF_MS 2      // Payoff, control variate and Greek accumulation
+#define PERF_COPY_OUT_MS 3    // Replaying and decimating the percentile paths for the caller
+#define PERF_PERCENTILE_MS 4  // Percentile tracking, including the sort that ends it
+#define PERF_BATCH_MS 5       // Wall time in run_simulation_batch
+#define PERF_PATHS 6
+#define PERF_STEPS 7          // Path-steps
+#define PERF_DRAWS 8          // Normals produced
+#define PERF_PATHS_PER_SEC 9  // Over PERF_BATCH_MS
+#define PERF_STEPS_PER_SEC 10
+#define NUM_PERF_STATS 11
+
+// Streaming export flags (combinable). Values are float32 unless EXPORT_FLOAT64 is set.
+#define EXPORT_FLOAT64 1      // Write every value as float64
+#define EXPORT_PATH_VALUES 2  // Add the path value A of path-dependent payoffs (NaN: barrier not paid)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HestonContext HestonContext;
+
+// Contexts start with the default options (seed 0, plain Monte Carlo, Milstein, one
+// thread). heston_create_context returns NULL when out of memory.
+HESTON_API HestonContext* heston_create_context(void);
+HESTON_API void heston_destroy_context(HestonContext *ctx);
+
+// Run options; each takes effect at the next initialize_simulation. The thread pool is
+// shared by all contexts and grows to the largest thread count any context asks for.
+HESTON_API void set_random_seed(HestonContext *ctx, double seed);
+HESTON_API void set_percentile_mode(HestonContext *ctx, int mode);
+HESTON_API void set_path_checkpoints(HestonContext *ctx, int checkpoints);
+HESTON_API void set_variance_reduction(HestonContext *ctx, int flags);
+HESTON_API void set_qmc_replicas(HestonContext *ctx, int replicas);
+HESTON_API void set_greeks(HestonContext *ctx, int enabled);
+HESTON_API void set_payoff(HestonContext *ctx, int style, int option_type, int barrier_type, double barrier);
+HESTON_API void set_discretization_scheme(HestonContext *ctx, int scheme);
+HESTON_API void set_target_tolerance(HestonContext *ctx, double tolerance);
+HESTON_API void set_thread_count(HestonContext *ctx, int threads);
+HESTON_API int get_thread_count(HestonContext *ctx);
+
+// Result cache (on by default): initialize_simulation saves the run it replaces, and a
+// later run with the same model and options continues it instead of starting from zero
+HESTON_API void set_result_cache(HestonContext *ctx, int enabled);
+
+// Main run
+HESTON_API void initialize_simulation(HestonContext *ctx, double S0, double v0, double r, double theta,
+                                      double kappa, double xi, double rho, double T, double K, int N);
+HESTON_API void run_simulation_batch(HestonContext *ctx, int batch_size);
+HESTON_API int get_simulation_count(HestonContext *ctx);
+HESTON_API double get_option_price(HestonContext *ctx);
+HESTON_API double get_standard_error(HestonContext *ctx);
+HESTON_API int is_converged(HestonContext *ctx);
+HESTON_API int get_restored_count(HestonContext *ctx);
+HESTON_API double get_greek(HestonContext *ctx, int greek);
+HESTON_API double get_greek_standard_error(HestonContext *ctx, int greek);
+HESTON_API double get_black_scholes_price(HestonContext *ctx);
+HESTON_API double get_analytic_price(HestonContext *ctx);
+HESTON_API int get_perf_stats(HestonContext *ctx, double *out);
+
+// Percentile paths
+HESTON_API double* get_percentile_path(HestonContext *ctx, int percentile);
+HESTON_API double* get_percentile_paths(HestonContext *ctx);
+HESTON_API int get_percentile_version(HestonContext *ctx);
+HESTON_API double* get_decimated_paths(HestonContext *ctx, int max_points);
+// The same layout for the steps covering [t_start, t_end] only, replayed at full resolution
+HESTON_API double* get_decimated_window(HestonContext *ctx, double t_start, double t_end, int max_points);
+HESTON_API int get_time_steps(HestonContext *ctx);
+HESTON_API int is_tracking_phase(HestonContext *ctx);
+
+// Streaming export of the current run's terminal prices and every path_stride-th path
+// (path_points evenly spaced points each) into chunks of a binary columnar format (see
+// README). export_begin sizes one reusable chunk buffer to budget_bytes and returns its
+// capacity in paths, or -1. A batch then stops at the end of the open chunk, and none runs
+// while a finished chunk waits: export_ready returns its length (flush also finishes a
+// partly filled chunk), export_data its bytes, and export_release hands the buffer back.
+// The export ends with export_end or the next initialize_simulation.
+HESTON_API int export_begin(HestonContext *ctx, int flags, double budget_bytes, int path_stride, int path_points);
+HESTON_API int export_ready(HestonContext *ctx, int flush);
+HESTON_API unsigned char* export_data(HestonContext *ctx);
+HESTON_API void export_release(HestonContext *ctx);
+HESTON_API void export_end(HestonContext *ctx);
+
+// One-off pricing with the model of the last initialize_simulation
+HESTON_API double heston_analytic_call(double S0, double v0, double r, double theta, double kappa,
+                                       double xi, double rho, double T, double K);
+HESTON_API int price_option_grid(HestonContext *ctx, const double *strikes, int num_strikes,
+                                 const double *maturities, int num_maturities, int num_paths,
+                                 double *out_prices, double *out_std_errors);
+HESTON_API int price_mlmc(HestonContext *ctx, double target_rmse, int base_steps, int max_level,
+                          double *out_summary, double *out_levels);
+HESTON_API int price_sensitivities(HestonContext *ctx, int num_paths, double *out_values, double *out_std_errors);
+HESTON_API int calibrate_heston(HestonContext *ctx, const double *quote_data, int num_quotes, int mc_paths,
+                                double *out_result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,158 +1,898 @@
-class HestonSimulationJS {
+// JavaScript engine for browsers without WebAssembly. It is a port of heston.c's
+// pseudo-random core: Philox4x32-10 substreams with the same inverse-CDF normals, the same
+// step schemes, payoffs, variance reduction, Greeks and percentile tracking. A seed
+// therefore draws the same paths as the WebAssembly engine, up to floating-point
+// rounding (native/compare_fallback.js checks this). Hot loops run on Float64Array
+// scratch buffers that are reused from batch to batch. Not ported: QMC (runs use
+// pseudo-random sampling), the semi-analytic pricer, grids, MLMC, calibration and
+// adjoint sensitivities.
+
+// Constants of heston.c and heston.h
+const MAX_PERCENTILE_PATHS = 1000;
+const PERCENTILE_TRACKING_LIMIT = 1000;
+const NUM_PERCENTILES = 5;
+const CONFIDENCE_Z = 1.959963984540054;
+const CONVERGENCE_MIN_PATHS = 1000;
+const RNG_BLOCK = 64;
+const QE_PSI_CRITICAL = 1.5;
+const GREEK_BUMP = 0.01;
+const PERCENTILE_STREAMING = 1;
+const VR_ANTITHETIC = 1;
+const VR_CONTROL_VARIATE = 2;
+const VR_MOMENT_MATCHING = 4;
+const SCHEME_MILSTEIN = 0;
+const SCHEME_FULL_TRUNCATION = 1;
+const SCHEME_QE = 2;
+const PAYOFF_EUROPEAN = 0;
+const PAYOFF_ASIAN_ARITHMETIC = 1;
+const PAYOFF_ASIAN_GEOMETRIC = 2;
+const PAYOFF_BARRIER = 3;
+const PAYOFF_LOOKBACK = 4;
+const BARRIER_UP = 1;
+const BARRIER_IN = 2;
+const NUM_GREEKS = 3;
+
+// Philox4x32-10 (Salmon et al., 2011)
+const PHILOX_M0 = 0xD2511F53;
+const PHILOX_M1 = 0xCD9E8D57;
+const PHILOX_W0 = 0x9E3779B9;
+const PHILOX_W1 = 0xBB67AE85;
+const PHILOX_M0_HI = PHILOX_M0 >>> 16, PHILOX_M0_LO = PHILOX_M0 & 0xffff;
+const PHILOX_M1_HI = PHILOX_M1 >>> 16, PHILOX_M1_LO = PHILOX_M1 & 0xffff;
+const TWO_32 = 4294967296;
+
+// The ten rounds on (c0, c1, c2, c3) with the round keys of keys[2 r], keys[2 r + 1].
+// All words are int32 (bit patterns of the uint32 words) so the JIT stays on integer
+// arithmetic: the high word of M c comes from 16-bit halves of c, with every partial sum
+// below 2^32, so it is exact modulo 2^32.
+function philox4x32_10(c0, c1, c2, c3, keys, out) {
+    for (let round = 0; round < 20; round += 2) {
+        const a0 = c0 >>> 16, b0 = c0 & 0xffff, a2 = c2 >>> 16, b2 = c2 & 0xffff;
+        let m = (Math.imul(PHILOX_M0_HI, b0) + (Math.imul(PHILOX_M0_LO, b0) >>> 16)) | 0;
+        let n = (Math.imul(PHILOX_M0_LO, a0) + (m & 0xffff)) | 0;
+        const hi0 = (Math.imul(PHILOX_M0_HI, a0) + (m >>> 16) + (n >>> 16)) | 0;
+        m = (Math.imul(PHILOX_M1_HI, b2) + (Math.imul(PHILOX_M1_LO, b2) >>> 16)) | 0;
+        n = (Math.imul(PHILOX_M1_LO, a2) + (m & 0xffff)) | 0;
+        const hi1 = (Math.imul(PHILOX_M1_HI, a2) + (m >>> 16) + (n >>> 16)) | 0;
+        const lo0 = Math.imul(PHILOX_M0, c0);
+        const lo1 = Math.imul(PHILOX_M1, c2);
+        c0 = hi1 ^ c1 ^ keys[round];
+        c2 = hi0 ^ c3 ^ keys[round + 1];
+        c1 = lo1;
+        c3 = lo0;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// 64 random bits to a uniform in (0, 1): the top 53 bits plus one half
+function uniformFromBits(lo, hi) {
+    return (((hi >>> 0) * 2097152 + (lo >>> 11)) + 0.5) * (1 / 9007199254740992);
+}
+
+// Inverse normal CDF (Acklam's rational approximation), coefficient for coefficient as in heston.c
+const ICDF_A = [-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00];
+const ICDF_B = [-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                6.680131188771972e+01, -1.328068155288572e+01];
+const ICDF_C = [-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00];
+const ICDF_D = [7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                3.754408661907416e+00];
+const ICDF_P_LOW = 0.02425;
+
+function inverseNormCdfTail(p) {
+    const q = Math.sqrt(-2.0 * Math.log(p < 0.5 ? p : 1.0 - p));
+    const x = (((((ICDF_C[0] * q + ICDF_C[1]) * q + ICDF_C[2]) * q + ICDF_C[3]) * q + ICDF_C[4]) * q + ICDF_C[5]) /
+              ((((ICDF_D[0] * q + ICDF_D[1]) * q + ICDF_D[2]) * q + ICDF_D[3]) * q + 1.0);
+    return p < 0.5 ? x : -x;
+}
+
+// erfc(x) for x >= 0: the positive series erf(x) = 2/sqrt(pi) e^{-x^2} sum (2x^2)^n x / (2n+1)!!
+// below 3, the continued fraction e^{-x^2}/sqrt(pi) / (x + (1/2)/(x + 1/(x + (3/2)/(x + ...))))
+// above. Agrees with the C library to about 1e-12 relative, which is the error of 1 - erf
+// near x = 3.
+function erfcPositive(x) {
+    if (x < 3) {
+        const x2 = 2 * x * x;
+        let term = x, sum = x;
+        for (let n = 1; term > 1e-17 * sum; n++) {
+            term *= x2 / (2 * n + 1);
+            sum += term;
+        }
+        return 1 - 2 / Math.sqrt(Math.PI) * Math.exp(-x * x) * sum;
+    }
+    let f = x;
+    for (let k = 60; k >= 1; k--) {
+        f = x + 0.5 * k / f;
+    }
+    return Math.exp(-x * x) / Math.sqrt(Math.PI) / f;
+}
+
+function erfc(x) {
+    return x < 0 ? 2 - erfcPositive(-x) : erfcPositive(x);
+}
+
+function normCdf(x) {
+    return 0.5 * erfc(-x / Math.sqrt(2.0));
+}
+
+function blackScholesCall(S0, K, r, T, sigma) {
+    const d1 = (Math.log(S0 / K) + (r + 0.5 * sigma * sigma) * T) / (sigma * Math.sqrt(T));
+    const d2 = d1 - sigma * Math.sqrt(T);
+    return S0 * normCdf(d1) - K * Math.exp(-r * T) * normCdf(d2);
+}
+
+// RngStream of heston.c: one Philox key per run, substream = path, RNG_BLOCK normals per refill
+class PhiloxStream {
     constructor() {
-        this.state = {
-            S0: 100, v0: 0.04, r: 0.05, theta: 0.1, kappa: 1.0,
-            xi: 0.2, rho: -0.5, T: 1.0, K: 100, N: 1000,
-            simulationCount: 0,
-            trackingPhase: true,
-            allPaths: [],
-            totalPayoffs: 0,
-            currentOptionPrice: 0,
-            blackScholesPrice: 0
-        };
-        this.hasSpare = false;
-        this.spare = 0;
+        this.keys = new Int32Array(20);  // Round keys of the seed
+        this.stream = 0;
+        this.counter = 0;
+        this.next = RNG_BLOCK;
+        this.normals = new Float64Array(RNG_BLOCK);
+        this.uniforms = new Float64Array(RNG_BLOCK);
+        this.block = new Int32Array(4);
     }
 
-    random() {
-        return Math.random();
+    // The seed is the Philox key; JS numbers carry seeds up to 2^53 exactly, like set_random_seed
+    seed(seed) {
+        let k0 = seed % TWO_32, k1 = Math.floor(seed / TWO_32);
+        for (let round = 0; round < 20; round += 2) {
+            this.keys[round] = k0;
+            this.keys[round + 1] = k1;
+            k0 = (k0 + PHILOX_W0) % TWO_32;
+            k1 = (k1 + PHILOX_W1) % TWO_32;
+        }
+        this.seek(0, 0);
+    }
+
+    // Jump to normal number `position` of substream `stream`
+    seek(stream, position) {
+        this.stream = stream;
+        this.counter = Math.floor(position / 2);
+        this.next = RNG_BLOCK;
+        if (position % 2) {
+            this.refill();
+            this.next = 1;
+        }
     }
 
-    normalRandom() {
-        if (this.hasSpare) {
-            this.hasSpare = false;
-            return this.spare;
+    // The central approximation over the whole block, then the tails patched
+    refill() {
+        const u = this.uniforms, z = this.normals, out = this.block, keys = this.keys;
+        const s0 = this.stream % TWO_32, s1 = Math.floor(this.stream / TWO_32);
+        let lo = this.counter % TWO_32, hi = Math.floor(this.counter / TWO_32);
+        for (let j = 0; j < RNG_BLOCK; j += 2) {
+            philox4x32_10(lo, hi, s0, s1, keys, out);
+            u[j] = uniformFromBits(out[0], out[1]);
+            u[j + 1] = uniformFromBits(out[2], out[3]);
+            if (++lo === TWO_32) {
+                lo = 0;
+                hi++;
+            }
+        }
+        this.counter += RNG_BLOCK / 2;
+        for (let j = 0; j < RNG_BLOCK; j++) {
+            const q = u[j] - 0.5;
+            const r = q * q;
+            z[j] = (((((ICDF_A[0] * r + ICDF_A[1]) * r + ICDF_A[2]) * r + ICDF_A[3]) * r + ICDF_A[4]) * r + ICDF_A[5]) * q /
+                   (((((ICDF_B[0] * r + ICDF_B[1]) * r + ICDF_B[2]) * r + ICDF_B[3]) * r + ICDF_B[4]) * r + 1.0);
         }
-        this.hasSpare = true;
-        const u = this.random();
-        const v = this.random();
-        const mag = Math.sqrt(-2.0 * Math.log(u));
-        this.spare = mag * Math.cos(2.0 * Math.PI * v);
-        return mag * Math.sin(2.0 * Math.PI * v);
+        for (let j = 0; j < RNG_BLOCK; j++) {
+            if (u[j] < ICDF_P_LOW || u[j] > 1.0 - ICDF_P_LOW) {
+                z[j] = inverseNormCdfTail(u[j]);
+            }
+        }
+        this.next = 0;
     }
 
-    normalCDF(x) {
-        return 0.5 * (1.0 + this.erf(x / Math.sqrt(2.0)));
+    normal() {
+        if (this.next >= RNG_BLOCK) this.refill();
+        return this.normals[this.next++];
     }
+}
 
-    erf(x) {
-        const a1 = 0.254829592, a2 = -0.284496736, a3 = 1.421413741,
-              a4 = -1.453152027, a5 = 1.061405429, p = 0.3275911;
-        const sign = x < 0 ? -1 : 1;
-        x = Math.abs(x);
-        const t = 1.0 / (1.0 + p * x);
-        const y = 1.0 - (((((a5 * t + a4) * t) + a3) * t + a2) * t + a1) * t * Math.exp(-x * x);
-        return sign * y;
+// step_params_init of heston.c
+function stepParams(scheme, r, theta, kappa, xi, rho, dt) {
+    if (scheme === SCHEME_QE && xi < 1e-6) scheme = SCHEME_FULL_TRUNCATION;
+    const e = Math.exp(-kappa * dt);
+    const oneMinusE = kappa * dt > 1e-8 ? 1.0 - e : kappa * dt;
+    const kSafe = kappa > 1e-12 ? kappa : 1e-12;
+    const p = {
+        scheme, dt, sqrtDt: Math.sqrt(dt), halfDt: 0.5 * dt, r, theta, kappa, xi, rho,
+        rhoBar: Math.sqrt(1 - rho * rho), rDt: r * dt, kappaDt: kappa * dt,
+        milstein: scheme === SCHEME_MILSTEIN ? (xi * xi / 4.0) * dt : 0.0,
+        qeDecay: e,
+        qeC1: xi * xi * e * oneMinusE / kSafe,
+        qeC2: theta * xi * xi * oneMinusE * oneMinusE / (2.0 * kSafe),
+        qeK0: 0, qeK1: 0, qeK2: 0, qeK3: 0, qeK4: 0
+    };
+    if (scheme === SCHEME_QE) {
+        p.qeK0 = -rho * kappa * theta * dt / xi;
+        p.qeK1 = 0.5 * dt * (kappa * rho / xi - 0.5) - rho / xi;
+        p.qeK2 = 0.5 * dt * (kappa * rho / xi - 0.5) + rho / xi;
+        p.qeK3 = 0.5 * dt * (1 - rho * rho);
+        p.qeK4 = p.qeK3;
     }
+    return p;
+}
 
-    blackScholesCall(S0, K, r, T, sigma) {
-        if (sigma === 0) return 0;
-        const d1 = (Math.log(S0 / K) + (r + 0.5 * sigma * sigma) * T) / (sigma * Math.sqrt(T));
-        const d2 = d1 - sigma * Math.sqrt(T);
-        return S0 * this.normalCDF(d1) - K * Math.exp(-r * T) * this.normalCDF(d2);
+function qeVarianceStep(p, v, z) {
+    const m = p.theta + (v - p.theta) * p.qeDecay;
+    const s2 = v * p.qeC1 + p.qeC2;
+    const psi = s2 / (m * m);
+    if (psi <= QE_PSI_CRITICAL) {
+        const invPsi = 2.0 / psi;
+        const b2 = invPsi - 1.0 + Math.sqrt(invPsi) * Math.sqrt(invPsi - 1.0);
+        const a = m / (1.0 + b2);
+        const bz = Math.sqrt(b2) + z;
+        return a * bz * bz;
     }
+    const probZero = (psi - 1.0) / (psi + 1.0);
+    const beta = (1.0 - probZero) / m;
+    const tail = 0.5 * erfc(z / Math.sqrt(2.0));
+    return tail >= 1.0 - probZero ? 0.0 : Math.log((1.0 - probZero) / tail) / beta;
+}
 
-    simulateSinglePath(S0, v0, r, theta, kappa, xi, rho, T, N) {
-        const dt = T / N;
-        const S = new Array(N + 1);
-        const v = new Array(N + 1);
-        S[0] = S0; v[0] = v0;
-        for (let i = 1; i <= N; i++) {
-            const Z_S = this.normalRandom();
-            const Z_v = rho * Z_S + Math.sqrt(1 - rho * rho) * this.normalRandom();
-            v[i] = v[i-1] + kappa * (theta - Math.max(v[i-1], 0)) * dt + 
-                   Z_v * xi * Math.sqrt(Math.max(v[i-1], 0) * dt) + 
-                   (xi * xi / 4.0) * ((Z_v * Z_v - 1.0) * dt);
-            S[i] = S[i-1] * Math.exp((r - v[i-1] / 2.0) * dt + Z_S * Math.sqrt(Math.max(v[i-1], 0) * dt));
+// heston_scheme_step: advance sv = [S, v] by one step and return the increment of the
+// Brownian motion paired with S
+function hestonStep(p, z1, z2, sv) {
+    const vPrev = sv[1];
+    if (p.scheme === SCHEME_QE) {
+        const vNext = qeVarianceStep(p, vPrev, z1);
+        sv[0] = sv[0] * Math.exp(p.rDt + p.qeK0 + p.qeK1 * vPrev + p.qeK2 * vNext +
+                                 Math.sqrt(p.qeK3 * vPrev + p.qeK4 * vNext) * z2);
+        sv[1] = vNext;
+        return (p.rho * z1 + p.rhoBar * z2) * p.sqrtDt;
+    }
+    const zV = p.rho * z1 + p.rhoBar * z2;
+    const vClamped = Math.max(vPrev, 0.0);
+    const sqrtVDt = Math.sqrt(vClamped * p.dt);
+    sv[1] = vPrev + p.kappaDt * (p.theta - vClamped) + zV * p.xi * sqrtVDt + p.milstein * (zV * zV - 1.0);
+    const vDrift = p.scheme === SCHEME_MILSTEIN ? vPrev : vClamped;
+    sv[0] = sv[0] * Math.exp(p.rDt - vDrift * p.halfDt + z1 * sqrtVDt);
+    return z1 * p.sqrtDt;
+}
+
+// Undiscounted payoff on path value A; NaN (a barrier path that does not pay) pays 0
+function payoffAmount(payoff, A, K) {
+    if (Number.isNaN(A)) return 0.0;
+    return payoff.put ? Math.max(K - A, 0.0) : Math.max(A - K, 0.0);
+}
+
+// Welford moments [n, meanY, meanX, m2Y, m2X, cXY] (PayoffStats)
+function statsAdd(st, y, x) {
+    st[0] += 1.0;
+    const dy = y - st[1];
+    const dx = x - st[2];
+    st[1] += dy / st[0];
+    st[2] += dx / st[0];
+    st[3] += dy * (y - st[1]);
+    st[4] += dx * (x - st[2]);
+    st[5] += dx * (y - st[1]);
+}
+
+function statsMerge(into, from) {
+    if (from[0] === 0.0) return;
+    if (into[0] === 0.0) {
+        into.set(from);
+        return;
+    }
+    const n = into[0] + from[0];
+    const dy = from[1] - into[1];
+    const dx = from[2] - into[2];
+    const w = into[0] * from[0] / n;
+    into[3] += from[3] + dy * dy * w;
+    into[4] += from[4] + dx * dx * w;
+    into[5] += from[5] + dx * dy * w;
+    into[1] += dy * from[0] / n;
+    into[2] += dx * from[0] / n;
+    into[0] = n;
+}
+
+// P² streaming quantile estimator (Jain & Chlamtac, 1985), as p2_* in heston.c
+class P2Quantile {
+    constructor(p) {
+        this.p = p;
+        this.count = 0;
+        this.q = new Float64Array(5);
+        this.n = Float64Array.of(1, 2, 3, 4, 5);
+        this.np = Float64Array.of(1, 1 + 2 * p, 1 + 4 * p, 3 + 2 * p, 5);
+        this.dn = Float64Array.of(0, p / 2, p, (1 + p) / 2, 1);
+    }
+
+    update(x) {
+        const q = this.q, n = this.n;
+        if (this.count < 5) {
+            q[this.count++] = x;
+            for (let i = this.count - 1; i > 0 && q[i] < q[i - 1]; i--) {
+                const t = q[i]; q[i] = q[i - 1]; q[i - 1] = t;
+            }
+            return;
         }
-        return S;
+        let k;
+        if (x < q[0]) { q[0] = x; k = 0; }
+        else if (x < q[1]) k = 0;
+        else if (x < q[2]) k = 1;
+        else if (x < q[3]) k = 2;
+        else if (x <= q[4]) k = 3;
+        else { q[4] = x; k = 3; }
+        for (let i = k + 1; i < 5; i++) n[i] += 1.0;
+        for (let i = 0; i < 5; i++) this.np[i] += this.dn[i];
+        for (let i = 1; i <= 3; i++) {
+            const d = this.np[i] - n[i];
+            if ((d >= 1.0 && n[i + 1] - n[i] > 1.0) || (d <= -1.0 && n[i - 1] - n[i] < -1.0)) {
+                const s = d > 0 ? 1 : -1;
+                const qp = q[i] + s / (n[i + 1] - n[i - 1]) *
+                           ((n[i] - n[i - 1] + s) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+                            (n[i + 1] - n[i] - s) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+                if (q[i - 1] < qp && qp < q[i + 1]) {
+                    q[i] = qp;
+                } else {
+                    q[i] = q[i] + s * (q[i + s] - q[i]) / (n[i + s] - n[i]);
+                }
+                n[i] += s;
+            }
+        }
+        this.count++;
+    }
+
+    estimate() {
+        if (this.count >= 5) return this.q[2];
+        if (this.count === 0) return 0.0;
+        return this.q[Math.floor(this.p * (this.count - 1) + 0.5)];
+    }
+}
+
+class HestonSimulationJS {
+    constructor() {
+        this.options = {
+            seed: 0, percentileMode: 0, pathCheckpoints: 0, varianceReduction: 0, tolerance: 0,
+            scheme: SCHEME_MILSTEIN, greeks: 0, payoff: { style: PAYOFF_EUROPEAN, put: false, barrierType: 0, barrier: 0 }
+        };
+        this.active = this.options;
+        this.rng = new PhiloxStream();
+        this.sv = new Float64Array(2);       // [S, v] of the path being stepped
+        this.pathOut = new Float64Array(2);  // S_T and W_T of the last kernel call
+        this.greekOut = new Float64Array(3); // W_T, d ln S_T / d v0 and the score
+        this.slotStats = new Float64Array(6);
+        this.slotGreeks = [new Float64Array(6), new Float64Array(6), new Float64Array(6)];
+        this.finals = new Float64Array(0);
+        this.W = new Float64Array(0);
+        this.values = new Float64Array(0);
+        this.batchGreeks = new Float64Array(0);
+        this.trackedIndex = new Float64Array(MAX_PERCENTILE_PATHS);
+        this.trackedFinal = new Float64Array(MAX_PERCENTILE_PATHS);
+        this.variance = new Float64Array(0);
+        this.decimated = new Float64Array(0);
+        this.candidates = [];
+        for (let k = 0; k < NUM_PERCENTILES; k++) {
+            this.candidates.push({ has: false, index: 0, final: 0, path: new Float64Array(0),
+                                   checkpoints: new Float64Array(0), built: -1 });
+        }
+        this.replay = { path: null, zSign: 1.0, step: 0 };  // PathReplay, with S and v in sv
+        this.initializeSimulation(100, 0.04, 0.05, 0.1, 1.0, 0.2, -0.5, 1.0, 100, 1000);
+    }
+
+    // Run options; each takes effect at the next initializeSimulation, as in heston.c
+    setRandomSeed(seed) { this.options.seed = Math.max(0, Math.floor(seed) || 0); }
+    setPercentileMode(mode) { this.options.percentileMode = mode === PERCENTILE_STREAMING ? 1 : 0; }
+    setPathCheckpoints(checkpoints) {
+        this.options.pathCheckpoints = checkpoints > 0 ? Math.max(2, Math.floor(checkpoints)) : 0;
+    }
+    setVarianceReduction(flags) {
+        this.options.varianceReduction = flags & (VR_ANTITHETIC | VR_CONTROL_VARIATE | VR_MOMENT_MATCHING);
+    }
+    setTargetTolerance(tolerance) { this.options.tolerance = tolerance > 0 ? tolerance : 0; }
+    setDiscretizationScheme(scheme) {
+        this.options.scheme = scheme === SCHEME_FULL_TRUNCATION || scheme === SCHEME_QE ? scheme : SCHEME_MILSTEIN;
+    }
+    setGreeks(enabled) { this.options.greeks = enabled ? 1 : 0; }
+    setPayoff(style, optionType, barrierType, barrier) {
+        this.options.payoff = {
+            style: style >= PAYOFF_EUROPEAN && style <= PAYOFF_LOOKBACK ? style : PAYOFF_EUROPEAN,
+            put: optionType === 1,
+            barrierType: barrierType & (BARRIER_UP | BARRIER_IN),
+            barrier
+        };
+    }
+
+    initializeSimulation(S0, v0, r, theta, kappa, xi, rho, T, K, N) {
+        Object.assign(this, { S0, v0, r, theta, kappa, xi, rho, T, K, N });
+        const active = { ...this.options, payoff: { ...this.options.payoff } };
+        if (active.payoff.style !== PAYOFF_EUROPEAN) active.greeks = 0;
+        this.active = active;
+        this.step = stepParams(active.scheme, r, theta, kappa, xi, rho, T / N);
+        this.antithetic = (active.varianceReduction & VR_ANTITHETIC) !== 0;
+
+        this.simulationCount = 0;
+        this.trackingPhase = true;
+        this.pathsStored = 0;
+        this.stats = new Float64Array(6);
+        this.greekStats = [new Float64Array(6), new Float64Array(6), new Float64Array(6)];
+        this.greeks = new Float64Array(NUM_GREEKS);
+        this.greekErrors = new Float64Array(NUM_GREEKS);
+        this.price = 0;
+        this.standardError = 0;
+        this.converged = false;
+
+        // Percentile paths (or their checkpoints) are replayed into buffers that only grow
+        this.percentileVersion = 0;
+        this.pathCheckpoints = Math.min(active.pathCheckpoints, N + 1);
+        const checkpoints = this.pathCheckpoints;
+        this.candidates.forEach(c => {
+            c.has = false;
+            c.built = -1;
+            if (checkpoints && c.checkpoints.length < 2 * checkpoints) c.checkpoints = new Float64Array(2 * checkpoints);
+            if (!checkpoints && c.path.length < N + 1) c.path = new Float64Array(N + 1);
+        });
+        if (this.variance.length < N + 1) this.variance = new Float64Array(N + 1);
+        this.quantiles = [new P2Quantile(0.25), new P2Quantile(0.5), new P2Quantile(0.75)];
+
+        const payoff = active.payoff;
+        const parity = payoff.put ? K * Math.exp(-r * T) - S0 : 0;
+        this.blackScholesPrice = payoff.style === PAYOFF_EUROPEAN ?
+            blackScholesCall(S0, K, r, T, Math.sqrt(v0)) + parity : NaN;
+        const kT = kappa * T;
+        const avgVariance = theta + (v0 - theta) * (kT > 1e-12 ? (1 - Math.exp(-kT)) / kT : 1);
+        this.controlSigma = Math.sqrt(Math.max(avgVariance, 1e-12));
+        this.controlMean = Math.exp(r * T) * (blackScholesCall(S0, K, r, T, this.controlSigma) + parity);
+        this.rng.seed(active.seed);
+    }
+
+    // path_seek without QMC: antithetic pairs share substream path / 2
+    pathSeek(path) {
+        this.rng.seek(this.antithetic ? Math.floor(path / 2) : path, 0);
+    }
+
+    pathSign(path) {
+        return this.antithetic && path % 2 === 1 ? -1.0 : 1.0;
     }
 
-    simulateFinalPrice(S0, v0, r, theta, kappa, xi, rho, T, N) {
-        const dt = T / N;
-        let S = S0, v = v0;
+    // path_value_kernel: the payoff's path value A, with S_T and W_T in pathOut
+    pathValue(zSign) {
+        const p = this.step, rng = this.rng, sv = this.sv, payoff = this.active.payoff, N = this.N;
+        const style = payoff.style;
+        const dir = (style === PAYOFF_BARRIER ? (payoff.barrierType & BARRIER_UP) : !payoff.put) ? 1.0 : -1.0;
+        const H = payoff.barrier;
+        let acc = style === PAYOFF_LOOKBACK ? dir * this.S0 : 0.0;
+        let hit = style === PAYOFF_BARRIER && dir * (this.S0 - H) >= 0.0;
+        let W = 0.0;
+        sv[0] = this.S0;
+        sv[1] = this.v0;
         for (let i = 1; i <= N; i++) {
-            const Z_S = this.normalRandom();
-            const Z_v = rho * Z_S + Math.sqrt(1 - rho * rho) * this.normalRandom();
-            const v_prev = v;
-            v = v + kappa * (theta - Math.max(v, 0)) * dt + 
-                Z_v * xi * Math.sqrt(Math.max(v, 0) * dt) + 
-                (xi * xi / 4.0) * ((Z_v * Z_v - 1.0) * dt);
-            S = S * Math.exp((r - v_prev / 2.0) * dt + Z_S * Math.sqrt(Math.max(v_prev, 0) * dt));
+            const z1 = zSign * rng.normal();
+            const z2 = zSign * rng.normal();
+            W += hestonStep(p, z1, z2, sv);
+            if (style === PAYOFF_ASIAN_ARITHMETIC) acc += sv[0];
+            else if (style === PAYOFF_ASIAN_GEOMETRIC) acc += Math.log(sv[0]);
+            else if (style === PAYOFF_LOOKBACK) acc = Math.max(acc, dir * sv[0]);
+            else if (style === PAYOFF_BARRIER) hit = hit || dir * (sv[0] - H) >= 0.0;
         }
+        const S = sv[0];
+        this.pathOut[0] = S;
+        this.pathOut[1] = W;
+        switch (style) {
+            case PAYOFF_ASIAN_ARITHMETIC: return acc / N;
+            case PAYOFF_ASIAN_GEOMETRIC: return Math.exp(acc / N);
+            case PAYOFF_LOOKBACK: return dir * acc;
+            case PAYOFF_BARRIER: return hit === ((payoff.barrierType & BARRIER_IN) !== 0) ? S : NaN;
+            default: return S;
+        }
+    }
+
+    // simulate_final_price from (S0, v0) on the current substream position
+    finalPrice(zSign, S0, v0) {
+        const p = this.step, rng = this.rng, sv = this.sv;
+        sv[0] = S0;
+        sv[1] = v0;
+        for (let i = 1; i <= this.N; i++) {
+            const z1 = zSign * rng.normal();
+            const z2 = zSign * rng.normal();
+            hestonStep(p, z1, z2, sv);
+        }
+        return sv[0];
+    }
+
+    // simulate_final_price_greeks: S_T, with W_T, d ln S_T / d v0 (NaN under QE) and the
+    // likelihood-ratio score of ln S_0 in greekOut
+    finalPriceGreeks(zSign) {
+        const p = this.step, rng = this.rng, sv = this.sv;
+        let W = 0.0, dx = 0.0, dv = 1.0, num = 0.0, den = 0.0;
+        sv[0] = this.S0;
+        sv[1] = this.v0;
+        for (let i = 1; i <= this.N; i++) {
+            const z1 = zSign * rng.normal();
+            const z2 = zSign * rng.normal();
+            const vPrev = sv[1];
+            W += hestonStep(p, z1, z2, sv);
+            if (p.scheme === SCHEME_QE) {
+                const a = Math.sqrt(p.qeK3 * vPrev + p.qeK4 * sv[1]);
+                num += a * z2;
+                den += a * a;
+                continue;
+            }
+            const vClamped = Math.max(vPrev, 0.0);
+            const a = p.rhoBar * Math.sqrt(vClamped * p.dt);
+            num += a * (p.rhoBar * z1 - p.rho * z2);
+            den += a * a;
+            if (vPrev > 0.0) {
+                const zV = p.rho * z1 + p.rhoBar * z2;
+                const halfInvSqrt = 0.5 * p.sqrtDt / Math.sqrt(vPrev);
+                dx += (z1 * halfInvSqrt - p.halfDt) * dv;
+                dv *= 1.0 - p.kappaDt + zV * p.xi * halfInvSqrt;
+            } else if (p.scheme === SCHEME_MILSTEIN) {
+                dx -= p.halfDt * dv;
+            }
+        }
+        this.greekOut[0] = W;
+        this.greekOut[1] = p.scheme === SCHEME_QE ? NaN : dx;
+        this.greekOut[2] = den > 0.0 ? num / den : 0.0;
+        return sv[0];
+    }
+
+    // simulate_path_greeks: S_T of `path`, its Greek contributions at greeks[offset ..]
+    pathGreeks(path, greeks, offset) {
+        const zSign = this.pathSign(path);
+        const S0 = this.S0, v0 = this.v0, K = this.K, payoff = this.active.payoff;
+        this.pathSeek(path);
+        const S = this.finalPriceGreeks(zSign);
+        const dlogSdv0 = this.greekOut[1], score = this.greekOut[2];
+        const slope = payoff.put ? -(S < K ? 1.0 : 0.0) : (S > K ? 1.0 : 0.0);
+        greeks[offset] = slope * S / S0;
+        if (!Number.isNaN(dlogSdv0)) {
+            greeks[offset + 1] = slope * S * dlogSdv0;
+        } else {
+            const h = GREEK_BUMP * v0;
+            this.pathSeek(path);
+            const up = this.finalPrice(zSign, S0, v0 + h);
+            this.pathSeek(path);
+            const down = this.finalPrice(zSign, S0, v0 - h);
+            greeks[offset + 1] = (payoffAmount(payoff, up, K) - payoffAmount(payoff, down, K)) / (2.0 * h);
+        }
+        if (score !== 0.0) {
+            greeks[offset + 2] = slope * S / (S0 * S0) * (score - 1.0);
+        } else {
+            const h = GREEK_BUMP * S0;
+            const ratio = S / S0;
+            greeks[offset + 2] = (payoffAmount(payoff, (S0 + h) * ratio, K) - 2.0 * payoffAmount(payoff, S, K) +
+                                  payoffAmount(payoff, (S0 - h) * ratio, K)) / (h * h);
+        }
+        this.pathOut[1] = this.greekOut[0];
         return S;
     }
 
-    initializeSimulation(S0, v0, r, theta, kappa, xi, rho, T, K, N) {
-        this.state = {
-            S0, v0, r, theta, kappa, xi, rho, T, K, N,
-            simulationCount: 0,
-            trackingPhase: true,
-            allPaths: [],
-            totalPayoffs: 0,
-            currentOptionPrice: 0,
-            blackScholesPrice: this.blackScholesCall(S0, K, r, T, Math.sqrt(v0))
-        };
-        this.hasSpare = false;
-        this.spare = 0;
+    // simulate_paths on one slot: finals, W, path values and Greeks of count paths
+    simulatePaths(firstPath, count, values, greeks) {
+        const finals = this.finals, W = this.W;
+        for (let i = 0; i < count; i++) {
+            const path = firstPath + i;
+            if (greeks) {
+                finals[i] = this.pathGreeks(path, greeks, NUM_GREEKS * i);
+            } else {
+                this.pathSeek(path);
+                const value = this.pathValue(this.pathSign(path));
+                finals[i] = this.pathOut[0];
+                if (values) values[i] = value;
+            }
+            W[i] = this.pathOut[1];
+        }
+    }
+
+    // accumulate_path_stats: antithetic pairs count as one sample
+    accumulatePathStats(st, values, count, scale) {
+        const K = this.K, S0 = this.S0, payoff = this.active.payoff;
+        const perSample = this.antithetic ? 2 : 1;
+        const control = (this.active.varianceReduction & VR_CONTROL_VARIATE) !== 0;
+        const sigma = this.controlSigma;
+        const drift = (this.r - 0.5 * sigma * sigma) * this.T;
+        for (let i = 0; i + perSample <= count; i += perSample) {
+            let y = 0.0, x = 0.0;
+            for (let j = i; j < i + perSample; j++) {
+                y += payoffAmount(payoff, values ? values[j] : scale * this.finals[j], K);
+                if (control) x += payoffAmount(payoff, S0 * Math.exp(drift + sigma * this.W[j]), K);
+            }
+            statsAdd(st, y / perSample, x / perSample);
+        }
+    }
+
+    accumulateGreekStats(stats, greeks, count) {
+        const perSample = this.antithetic ? 2 : 1;
+        for (let i = 0; i + perSample <= count; i += perSample) {
+            for (let k = 0; k < NUM_GREEKS; k++) {
+                let y = 0.0;
+                for (let j = i; j < i + perSample; j++) y += greeks[NUM_GREEKS * j + k];
+                statsAdd(stats[k], y / perSample, 0.0);
+            }
+        }
+    }
+
+    // Grow the batch buffers to hold count paths; they are kept for later batches
+    reserveBatch(count) {
+        if (this.finals.length >= count) return;
+        this.finals = new Float64Array(count);
+        this.W = new Float64Array(count);
+        this.values = new Float64Array(count);
+        this.batchGreeks = new Float64Array(NUM_GREEKS * count);
     }
 
     runSimulationBatch(batchSize) {
-        for (let i = 0; i < batchSize; i++) {
-            if (this.state.trackingPhase && this.state.simulationCount < 1000) {
-                const path = this.simulateSinglePath(
-                    this.state.S0, this.state.v0, this.state.r, this.state.theta,
-                    this.state.kappa, this.state.xi, this.state.rho, this.state.T, this.state.N
-                );
-                if (this.state.allPaths.length < 1000) {
-                    this.state.allPaths.push({
-                        path: path,
-                        finalPrice: path[this.state.N]
-                    });
+        if (batchSize <= 0 || this.converged) return;
+        const perSample = this.antithetic ? 2 : 1;
+        batchSize = Math.ceil(batchSize / perSample) * perSample;
+        this.reserveBatch(batchSize);
+        const values = this.active.payoff.style !== PAYOFF_EUROPEAN ? this.values : null;
+        const greeks = this.active.greeks ? this.batchGreeks : null;
+        const matching = (this.active.varianceReduction & VR_MOMENT_MATCHING) !== 0;
+        const firstPath = this.simulationCount;
+
+        // One slot of run_parallel_paths: its own moments, merged into the run's
+        this.simulatePaths(firstPath, batchSize, values, greeks);
+        this.slotStats.fill(0);
+        this.slotGreeks.forEach(st => st.fill(0));
+        if (!matching) this.accumulatePathStats(this.slotStats, values, batchSize, 1.0);
+        if (greeks) this.accumulateGreekStats(this.slotGreeks, greeks, batchSize);
+        statsMerge(this.stats, this.slotStats);
+        for (let k = 0; k < NUM_GREEKS; k++) statsMerge(this.greekStats[k], this.slotGreeks[k]);
+        this.simulationCount += batchSize;
+
+        if (matching) {
+            let meanS = 0.0;
+            for (let i = 0; i < batchSize; i++) meanS += this.finals[i];
+            meanS /= batchSize;
+            const scale = meanS > 0.0 ? this.S0 * Math.exp(this.r * this.T) / meanS : 1.0;
+            this.accumulatePathStats(this.stats, values, batchSize, scale);
+        }
+
+        const streaming = this.active.percentileMode === PERCENTILE_STREAMING;
+        if (streaming) {
+            this.trackStreamingPercentiles(firstPath, batchSize);
+        } else if (this.trackingPhase) {
+            for (let i = 0; i < batchSize && this.pathsStored < MAX_PERCENTILE_PATHS; i++) {
+                if (firstPath + i >= PERCENTILE_TRACKING_LIMIT) break;
+                this.trackedIndex[this.pathsStored] = firstPath + i;
+                this.trackedFinal[this.pathsStored++] = this.finals[i];
+            }
+        }
+        if (this.trackingPhase && this.simulationCount >= PERCENTILE_TRACKING_LIMIT) {
+            this.trackingPhase = false;
+            if (!streaming) this.selectStoredPercentiles();
+        }
+        this.updateOptionPrice();
+    }
+
+    // track_streaming_percentiles: keep the path nearest each P² estimate
+    trackStreamingPercentiles(firstPath, count) {
+        const c = this.candidates;
+        for (let i = 0; i < count; i++) {
+            const x = this.finals[i];
+            for (let k = 0; k < 3; k++) this.quantiles[k].update(x);
+            for (let k = 0; k < NUM_PERCENTILES; k++) {
+                let better;
+                if (!c[k].has) {
+                    better = true;
+                } else if (k === 0) {
+                    better = x < c[k].final;
+                } else if (k === NUM_PERCENTILES - 1) {
+                    better = x > c[k].final;
+                } else {
+                    const target = this.quantiles[k - 1].estimate();
+                    better = Math.abs(x - target) < Math.abs(c[k].final - target);
                 }
-                const payoff = Math.max(path[this.state.N] - this.state.K, 0);
-                this.state.totalPayoffs += payoff;
-                if (this.state.simulationCount === 999) {
-                    this.state.trackingPhase = false;
-                    this.state.allPaths.sort((a, b) => a.finalPrice - b.finalPrice);
+                if (better) {
+                    c[k].has = true;
+                    c[k].index = firstPath + i;
+                    c[k].final = x;
+                    this.percentileVersion++;
                 }
-            } else {
-                const finalPrice = this.simulateFinalPrice(
-                    this.state.S0, this.state.v0, this.state.r, this.state.theta,
-                    this.state.kappa, this.state.xi, this.state.rho, this.state.T, this.state.N
-                );
-                const payoff = Math.max(finalPrice - this.state.K, 0);
-                this.state.totalPayoffs += payoff;
             }
-            this.state.simulationCount++;
         }
-        this.state.currentOptionPrice = Math.exp(-this.state.r * this.state.T) * 
-                                      (this.state.totalPayoffs / this.state.simulationCount);
     }
 
-    getSimulationCount() { return this.state.simulationCount; }
-    getOptionPrice() { return this.state.currentOptionPrice; }
-    getBlackScholesPrice() { return this.state.blackScholesPrice; }
+    // select_stored_percentiles: min, quartiles and max of the tracked sample
+    selectStoredPercentiles() {
+        const n = this.pathsStored;
+        if (n === 0) return;
+        const order = Array.from({ length: n }, (_, i) => i);
+        order.sort((a, b) => this.trackedFinal[a] - this.trackedFinal[b]);
+        const ranks = [0, Math.floor(n / 4), Math.floor(n / 2), Math.floor(3 * n / 4), n - 1];
+        ranks.forEach((rank, k) => {
+            const c = this.candidates[k];
+            c.has = true;
+            c.index = this.trackedIndex[order[rank]];
+            c.final = this.trackedFinal[order[rank]];
+        });
+        this.percentileVersion++;
+    }
 
-    getPercentilePath(percentile) {
-        if (!this.state.trackingPhase && this.state.allPaths.length > 0) {
-            const pathCount = this.state.allPaths.length;
-            let idx;
-            switch (percentile) {
-                case 0: idx = 0; break;
-                case 25: idx = Math.floor(pathCount * 0.25); break;
-                case 50: idx = Math.floor(pathCount * 0.5); break;
-                case 75: idx = Math.floor(pathCount * 0.75); break;
-                case 100: idx = pathCount - 1; break;
-                default: return null;
+    updateOptionPrice() {
+        const st = this.stats;
+        const discount = Math.exp(-this.r * this.T);
+        let estimate = st[1], residual = st[3];
+        if ((this.active.varianceReduction & VR_CONTROL_VARIATE) && st[4] > 0.0) {
+            const beta = st[5] / st[4];
+            estimate -= beta * (st[2] - this.controlMean);
+            residual = Math.max(st[3] - st[5] * beta, 0.0);
+        }
+        this.price = discount * estimate;
+        this.standardError = st[0] > 1.0 ? discount * Math.sqrt(residual / (st[0] - 1.0) / st[0]) : 0.0;
+        for (let k = 0; k < NUM_GREEKS; k++) {
+            const gs = this.greekStats[k];
+            this.greeks[k] = discount * gs[1];
+            this.greekErrors[k] = gs[0] > 1.0 ? discount * Math.sqrt(gs[3] / (gs[0] - 1.0) / gs[0]) : 0.0;
+        }
+        if (this.active.tolerance > 0 && this.simulationCount >= CONVERGENCE_MIN_PATHS &&
+            CONFIDENCE_Z * this.standardError <= this.active.tolerance) {
+            this.converged = true;
+        }
+    }
+
+    // build_candidate_path: replay a candidate's full path from its substream
+    buildCandidatePath(c) {
+        if (!c.has) return null;
+        if (c.built !== c.index) {
+            const p = this.step, rng = this.rng, sv = this.sv, S = c.path, v = this.variance;
+            const zSign = this.pathSign(c.index);
+            this.pathSeek(c.index);
+            S[0] = this.S0;
+            v[0] = this.v0;
+            for (let i = 1; i <= this.N; i++) {
+                const z1 = zSign * rng.normal();
+                const z2 = zSign * rng.normal();
+                sv[0] = S[i - 1];
+                sv[1] = v[i - 1];
+                hestonStep(p, z1, z2, sv);
+                S[i] = sv[0];
+                v[i] = sv[1];
             }
-            return this.state.allPaths[idx].path;
+            c.built = c.index;
+        }
+        return c.path;
+    }
+
+    checkpointStep(j) {
+        return Math.floor(j * this.N / (this.pathCheckpoints - 1));
+    }
+
+    // replay_next: the next price of the replay, from the stored path or stepped
+    replayNext(r) {
+        r.step++;
+        if (r.path) return r.path[r.step];
+        const z1 = r.zSign * this.rng.normal();
+        const z2 = r.zSign * this.rng.normal();
+        hestonStep(this.step, z1, z2, this.sv);
+        return this.sv[0];
+    }
+
+    // build_candidate_checkpoints: (S, v) at every checkpoint step, S first
+    buildCandidateCheckpoints(c) {
+        if (!c.has) return false;
+        if (c.built === c.index) return true;
+        const K = this.pathCheckpoints, cp = c.checkpoints, sv = this.sv, r = this.replay;
+        r.path = null;
+        r.zSign = this.pathSign(c.index);
+        r.step = 0;
+        this.pathSeek(c.index);
+        sv[0] = this.S0;
+        sv[1] = this.v0;
+        cp[0] = sv[0];
+        cp[K] = sv[1];
+        for (let j = 1; j < K; j++) {
+            const target = this.checkpointStep(j);
+            while (r.step < target) this.replayNext(r);
+            cp[j] = sv[0];
+            cp[K + j] = sv[1];
+        }
+        c.built = c.index;
+        return true;
+    }
+
+    // replay_begin: this.replay at `step` of candidate c, with its price returned
+    replayBegin(c, step) {
+        const r = this.replay, sv = this.sv;
+        if (!this.pathCheckpoints) {
+            r.path = this.buildCandidatePath(c);
+            r.step = step;
+            return r.path[step];
         }
-        return null;
+        this.buildCandidateCheckpoints(c);
+        const K = this.pathCheckpoints;
+        let j = Math.floor(step * (K - 1) / this.N);
+        while (j > 0 && this.checkpointStep(j) > step) j--;
+        while (j + 1 < K && this.checkpointStep(j + 1) <= step) j++;
+        r.path = null;
+        r.zSign = this.pathSign(c.index);
+        r.step = this.checkpointStep(j);
+        sv[0] = c.checkpoints[j];
+        sv[1] = c.checkpoints[K + j];
+        this.rng.seek(this.antithetic ? Math.floor(c.index / 2) : c.index, 2 * r.step);
+        while (r.step < step) this.replayNext(r);
+        return sv[0];
+    }
+
+    getPercentilePath(percentile) {
+        if (this.trackingPhase || this.pathCheckpoints) return null;
+        const k = [0, 25, 50, 75, 100].indexOf(percentile);
+        if (k < 0) return null;
+        const path = this.buildCandidatePath(this.candidates[k]);
+        return path ? path.subarray(0, this.N + 1) : null;
+    }
+
+    // get_decimated_window: steps i0..i1 covering [tStart, tEnd] as [M, yMin, yMax], then
+    // per percentile M times and M prices, with each of (maxPoints - 2) / 2 buckets of the
+    // interior steps reduced to its minimum and maximum
+    getDecimatedWindow(tStart, tEnd, maxPoints) {
+        if (this.trackingPhase || this.candidates.some(c => !c.has)) return null;
+        const N = this.N;
+        const dt = this.T / N;
+        const i0 = Math.max(0, Math.min(Math.floor(tStart / dt + 1e-9), N - 1));
+        const i1 = Math.max(i0 + 1, Math.min(Math.ceil(tEnd / dt - 1e-9), N));
+        const interior = i1 - i0 - 1;
+        const buckets = maxPoints < 4 ? 1 : Math.floor((maxPoints - 2) / 2);
+        const whole = i1 - i0 + 1 <= maxPoints || interior <= 2 * buckets;
+        const M = whole ? i1 - i0 + 1 : 2 * buckets + 2;
+        const len = 3 + NUM_PERCENTILES * 2 * M;
+        if (this.decimated.length < len) this.decimated = new Float64Array(len);
+        const out = this.decimated, r = this.replay;
+        let yMin = Infinity, yMax = -Infinity;
+        this.candidates.forEach((c, k) => {
+            const t = 3 + k * 2 * M, y = t + M;
+            let m = 0;
+            out[t + m] = i0 * dt;
+            out[y + m++] = this.replayBegin(c, i0);
+            if (whole) {
+                for (let i = i0 + 1; i <= i1; i++) {
+                    out[t + m] = i * dt;
+                    out[y + m++] = this.replayNext(r);
+                }
+            } else {
+                for (let b = 0; b < buckets; b++) {
+                    const lo = i0 + 1 + Math.floor(b * interior / buckets);
+                    const hi = i0 + 1 + Math.floor((b + 1) * interior / buckets);
+                    let iMin = lo, iMax = lo;
+                    let sMin = this.replayNext(r), sMax = sMin;
+                    for (let i = lo + 1; i < hi; i++) {
+                        const S = this.replayNext(r);
+                        if (S < sMin) { sMin = S; iMin = i; }
+                        if (S > sMax) { sMax = S; iMax = i; }
+                    }
+                    const maxFirst = iMax < iMin;
+                    out[t + m] = (maxFirst ? iMax : iMin) * dt;
+                    out[y + m++] = maxFirst ? sMax : sMin;
+                    out[t + m] = (maxFirst ? iMin : iMax) * dt;
+                    out[y + m++] = maxFirst ? sMin : sMax;
+                }
+                out[t + m] = i1 === N ? this.T : i1 * dt;
+                out[y + m++] = this.replayNext(r);
+            }
+            for (let i = 0; i < m; i++) {
+                yMin = Math.min(yMin, out[y + i]);
+                yMax = Math.max(yMax, out[y + i]);
+            }
+        });
+        out[0] = M;
+        out[1] = yMin;
+        out[2] = yMax;
+        return out.subarray(0, len);
+    }
+
+    getDecimatedPaths(maxPoints) {
+        return this.getDecimatedWindow(0, this.T, maxPoints);
     }
 
-    getTimeSteps() { return this.state.N; }
-    isTrackingPhase() { return this.state.trackingPhase; }
+    // The finals of the last batch, indexed by path (native/compare_fallback.js)
+    getBatchFinals(count) { return this.finals.subarray(0, count); }
+
+    getSimulationCount() { return this.simulationCount; }
+    getOptionPrice() { return this.price; }
+    getStandardError() { return this.standardError; }
+    isConverged() { return this.converged ? 1 : 0; }
+    getGreek(greek) { return this.greeks[greek]; }
+    getGreekStandardError(greek) { return this.greekErrors[greek]; }
+    getBlackScholesPrice() { return this.blackScholesPrice; }
+    getPercentileVersion() { return this.percentileVersion; }
+    getTimeSteps() { return this.N; }
+    isTrackingPhase() { return this.trackingPhase ? 1 : 0; }
 }
 
-window.HestonSimulationJS = HestonSimulationJS;
\ No newline at end of file
+self.HestonSimulationJS = HestonSimulationJS;
@@ -0,0 +1,496 @@
+// Simulation engine host. Runs as a dedicated Web Worker so batches never block the UI
+// thread; the same runner also works in-page when workers are unavailable (file://).
+//
+// Messages in:  { type: 'init', webgpu, perf }, { type: 'start', params }, { type: 'stop' }, { type: 'reset' },
+//               { type: 'priceGrid', id, strikes, maturities, numPaths },
+//               { type: 'priceMlmc', id, targetRmse, baseSteps, maxLevel },
+//               { type: 'priceSensitivities', id, numPaths },
+//               { type: 'calibrate', id, params, quotes, mcPaths }, { type: 'exportAck' },
+//               { type: 'zoom', start, end } (charted time window; no end for the whole run)
+// Messages out: { type: 'ready', engine, threads }, { type: 'progress', snapshot }, { type: 'paths', paths },
+//               { type: 'reset' }, { type: 'grid', id, result }, { type: 'mlmc', id, result },
+//               { type: 'sensitivities', id, result }, { type: 'calibration', id, result },
+//               { type: 'exportChunk', chunk, final, error }
+
+const BATCH_BUDGET_MS = 8;     // Target duration of one runSimulationBatch call
+const SLICE_MS = 24;           // Simulate this long before yielding to the message queue
+const SNAPSHOT_INTERVAL_MS = 100;
+const TRACKING_PATHS = 1000;   // Paths in the percentile tracking phase
+const MAX_BATCH_PATHS = 1 << 20;
+const PERCENTILES = [0, 25, 50, 75, 100];
+const DEFAULT_CHART_POINTS = 1000;
+const GREEKS = ['delta', 'vega', 'gamma'];  // In GREEK_* order
+const EXPORT_MAX_IN_FLIGHT = 2;  // Export chunks posted ahead of the page's exportAck
+
+// Reference prices are NaN for path-dependent payoffs, which have no closed form
+function finiteOrNull(x) {
+    return Number.isFinite(x) ? x : null;
+}
+
+// Sizes batches to a time budget from the measured throughput in path-steps per
+// millisecond, so the step count N is part of every estimate. Overruns shrink the
+// estimate immediately; faster batches raise it gradually and at most 4x at a time,
+// since timers in workers can be coarse.
+class BatchSizer {
+    constructor(budgetMs, initialRate) {
+        this.budgetMs = budgetMs;
+        this.rate = initialRate;
+    }
+
+    size(N, maxPaths) {
+        const paths = Math.floor(this.budgetMs * this.rate / N);
+        return Math.max(1, Math.min(paths, maxPaths, MAX_BATCH_PATHS));
+    }
+
+    record(paths, N, elapsedMs) {
+        if (paths <= 0) return;
+        const measured = elapsedMs > 0 ? (paths * N) / elapsedMs : Infinity;
+        if (measured < this.rate) {
+            this.rate = measured;
+        } else {
+            this.rate = Math.min(0.5 * (this.rate + measured), 4 * this.rate);
+        }
+    }
+
+    pathsPerSecond(N) {
+        return 1000 * this.rate / N;
+    }
+}
+
+class SimulationRunner {
+    // loadScript(src) resolves once the script's globals are defined; post(message, transfer)
+    // delivers a message to the page
+    constructor(loadScript, post) {
+        this.loadScript = loadScript;
+        this.post = post;
+        this.simulation = null;
+        this.engine = null;
+        this.running = false;
+        this.runId = 0;  // Bumped by start(), so a loop awaiting a GPU batch can tell it is stale
+        this.params = null;
+        this.lastSnapshot = 0;
+        this.pathsSent = false;
+        this.pathsVersion = null;
+        this.pathWindow = null;  // { start, end } of the zoomed chart, or null for [0, T]
+        this.perf = false;     // Add performance counters to snapshots (init message)
+        this.marshalMs = 0;    // Time spent handing paths to the page this run
+        this.exporting = false;       // The run streams export chunks (params.export)
+        this.exportInFlight = 0;
+        this.exportWaiting = false;   // Paused until an exportAck frees a chunk slot
+        this.pathLimit = Infinity;    // Paths after which an export run stops
+        this.trackingSizer = null;
+        this.fastSizer = null;
+        this.scheduleNext = this.createScheduler();
+    }
+
+    // A MessageChannel round trip yields to pending messages without the 4ms clamp
+    // that nested setTimeout calls get
+    createScheduler() {
+        if (typeof MessageChannel !== 'undefined') {
+            const channel = new MessageChannel();
+            channel.port1.onmessage = () => this.runLoop();
+            return () => channel.port2.postMessage(null);
+        }
+        return () => setTimeout(() => this.runLoop(), 0);
+    }
+
+    async handleMessage(message) {
+        switch (message.type) {
+            case 'init':
+                this.perf = !!message.perf;
+                await this.loadEngine(!!message.webgpu);
+                this.post({
+                    type: 'ready',
+                    engine: this.engine,
+                    threads: typeof this.simulation.getThreadCount === 'function' ? this.simulation.getThreadCount() : 1
+                });
+                break;
+            case 'start':
+                this.start(message.params);
+                break;
+            case 'stop':
+                if (this.running) {
+                    this.running = false;
+                    this.finishExport();
+                    this.postSnapshot('stopped');
+                }
+                break;
+            case 'reset':
+                this.running = false;
+                this.finishExport();
+                this.post({ type: 'reset' });
+                break;
+            case 'zoom':
+                this.zoom(message.start, message.end);
+                break;
+            case 'exportAck':
+                this.exportInFlight = Math.max(0, this.exportInFlight - 1);
+                if (this.exportWaiting && this.exportInFlight < EXPORT_MAX_IN_FLIGHT) {
+                    this.exportWaiting = false;
+                    if (this.running) this.scheduleNext();
+                }
+                break;
+            case 'priceGrid':
+                this.post({
+                    type: 'grid',
+                    id: message.id,
+                    result: typeof this.simulation.priceOptionGrid === 'function' ?
+                        this.simulation.priceOptionGrid(message.strikes, message.maturities, message.numPaths) : null
+                });
+                break;
+            case 'priceMlmc':
+                this.post({
+                    type: 'mlmc',
+                    id: message.id,
+                    result: typeof this.simulation.priceMlmc === 'function' ?
+                        this.simulation.priceMlmc(message.targetRmse, message.baseSteps, message.maxLevel) : null
+                });
+                break;
+            case 'priceSensitivities':
+                this.post({
+                    type: 'sensitivities',
+                    id: message.id,
+                    result: typeof this.simulation.priceSensitivities === 'function' ?
+                        this.simulation.priceSensitivities(message.numPaths) : null
+                });
+                break;
+            case 'calibrate':
+                this.running = false;
+                this.finishExport();
+                this.configure(message.params);
+                this.post({
+                    type: 'calibration',
+                    id: message.id,
+                    result: typeof this.simulation.calibrate === 'function' ?
+                        this.simulation.calibrate(message.quotes, message.mcPaths) : null
+                });
+                break;
+        }
+    }
+
+    // The threaded build needs SharedArrayBuffer, which is only available on
+    // cross-origin isolated pages (COOP/COEP headers). With webgpu set, the WebAssembly
+    // engine is wrapped in the WebGPU backend when an adapter is available.
+    async loadEngine(webgpu) {
+        await this.loadCpuEngine();
+        if (webgpu && this.engine !== 'js') {
+            try {
+                await this.loadScript('webgpu-simulation.js');
+                const gpu = await WebGPUSimulation.create(this.simulation);
+                if (gpu) {
+                    this.simulation = gpu;
+                    this.engine = 'webgpu';
+                }
+            } catch (error) {
+                console.warn("WebGPU not available, using the CPU engine:", error);
+            }
+        }
+
+        // Conservative first guesses; the estimates carry over between runs. The WebGPU
+        // backend leaves the tracking phase to its CPU engine.
+        const cpuRate = this.engine === 'js' ? 2000 : 5000;
+        this.trackingSizer = new BatchSizer(BATCH_BUDGET_MS, cpuRate);
+        this.fastSizer = new BatchSizer(BATCH_BUDGET_MS, this.engine === 'webgpu' ? 50000 : cpuRate);
+    }
+
+    async loadCpuEngine() {
+        await this.loadScript('wasm-simulation.js');
+
+        if (self.crossOriginIsolated) {
+            try {
+                await this.loadScript('simulation-mt.js');
+                const Module = await HestonModuleMT({ mainScriptUrlOrBlob: 'simulation-mt.js' });
+                this.simulation = new WasmSimulation(Module);
+                this.simulation.setThreadCount(navigator.hardwareConcurrency || 1);
+                this.engine = 'wasm-mt';
+                return;
+            } catch (error) {
+                console.warn("Threaded WebAssembly not available, using single-threaded build:", error);
+            }
+        }
+
+        try {
+            await this.loadScript('simulation.js');
+            const Module = await HestonModule();
+            this.simulation = new WasmSimulation(Module);
+            this.engine = 'wasm';
+        } catch (error) {
+            console.warn("WebAssembly not available, falling back to JavaScript:", error);
+            await this.loadScript('simulation-fallback.js');
+            this.simulation = new HestonSimulationJS();
+            this.engine = 'js';
+        }
+    }
+
+    // Apply the run options and initialize the engine for params
+    configure(params) {
+        const sim = this.simulation;
+        if (typeof sim.setRandomSeed === 'function') {
+            sim.setRandomSeed(params.seed);
+        }
+        if (typeof sim.setPercentileMode === 'function') {
+            sim.setPercentileMode(params.percentileMode);
+        }
+        if (typeof sim.setPathCheckpoints === 'function') {
+            sim.setPathCheckpoints(params.pathCheckpoints || 0);
+        }
+        if (typeof sim.setVarianceReduction === 'function') {
+            sim.setVarianceReduction(params.varianceReduction);
+        }
+        if (typeof sim.setTargetTolerance === 'function') {
+            sim.setTargetTolerance(params.tolerance);
+        }
+        if (typeof sim.setDiscretizationScheme === 'function') {
+            sim.setDiscretizationScheme(params.scheme);
+        }
+        if (typeof sim.setQmcReplicas === 'function') {
+            sim.setQmcReplicas(params.qmcReplicas);
+        }
+        if (typeof sim.setGreeks === 'function') {
+            sim.setGreeks(params.greeks ? 1 : 0);
+        }
+        if (typeof sim.setPayoff === 'function' && params.payoff) {
+            const payoff = params.payoff;
+            sim.setPayoff(payoff.style, payoff.put ? 1 : 0, payoff.barrierType, payoff.barrier);
+        }
+        sim.initializeSimulation(
+            params.S0, params.v0, params.r, params.theta, params.kappa,
+            params.xi, params.rho, params.T, params.K, params.N
+        );
+    }
+
+    start(params) {
+        this.finishExport();
+        this.configure(params);
+        if (params.export) this.beginExport(params.export);
+        this.params = params;
+        this.pathsSent = false;
+        this.pathsVersion = null;
+        this.pathWindow = null;
+        this.marshalMs = 0;
+        this.running = true;
+        this.runId++;
+        this.postSnapshot('running');
+        this.scheduleNext();
+    }
+
+    isConverged() {
+        return typeof this.simulation.isConverged === 'function' && this.simulation.isConverged() !== 0;
+    }
+
+    // Stream the run through the engine's export (see WasmSimulation.exportBegin). Chunks
+    // are posted as they fill, and the run pauses while EXPORT_MAX_IN_FLIGHT of them await
+    // the page's exportAck, so a slow consumer holds back the simulation rather than
+    // piling chunks up in memory. With options.maxPaths the run stops after that many paths.
+    beginExport(options) {
+        const sim = this.simulation;
+        this.exportInFlight = 0;
+        this.exportWaiting = false;
+        this.exporting = typeof sim.exportBegin === 'function' && sim.exportBegin(options) > 0;
+        this.pathLimit = this.exporting && options.maxPaths > 0 ? options.maxPaths : Infinity;
+        if (!this.exporting) {
+            this.post({ type: 'exportChunk', chunk: null, final: true, error: 'Export is not available with this engine' });
+        }
+    }
+
+    // Post the finished export chunk, if any; with final also the partly filled one, which
+    // closes the stream (final is sent even without a chunk)
+    postExportChunk(final) {
+        const chunk = this.simulation.exportChunk(final);
+        if (!chunk && !final) return;
+        if (chunk) this.exportInFlight++;
+        this.post({ type: 'exportChunk', chunk, final }, chunk ? [chunk.buffer] : []);
+    }
+
+    // Close the export of a run that ended (converged, reached maxPaths, stopped or replaced)
+    finishExport() {
+        if (!this.exporting) return;
+        this.postExportChunk(true);
+        this.simulation.exportEnd();
+        this.exporting = false;
+        this.exportWaiting = false;
+        this.pathLimit = Infinity;
+    }
+
+    // Converged, or the export's path count is reached
+    isFinished() {
+        return this.isConverged() || this.simulation.getSimulationCount() >= this.pathLimit;
+    }
+
+    // Engines may return a promise from runSimulationBatch (the WebGPU backend does);
+    // it is awaited, and a start, stop or reset that arrives meanwhile ends this loop
+    async runLoop() {
+        if (!this.running || this.exportWaiting) return;
+
+        const runId = this.runId;
+        const sim = this.simulation;
+        const N = this.params.N;
+        const sliceEnd = performance.now() + SLICE_MS;
+        do {
+            // Tracking batches stop at the phase boundary so each sizer only ever
+            // measures its own kind of batch
+            const tracking = sim.isTrackingPhase();
+            const sizer = tracking ? this.trackingSizer : this.fastSizer;
+            const count = sim.getSimulationCount();
+            const batchSize = sizer.size(N, Math.min(tracking ? TRACKING_PATHS - count : MAX_BATCH_PATHS,
+                                                     this.pathLimit - count));
+
+            const batchStart = performance.now();
+            const pending = sim.runSimulationBatch(batchSize);
+            if (pending) {
+                try {
+                    await pending;
+                } catch (error) {
+                    console.error("Simulation batch failed:", error);
+                    this.running = false;
+                    this.finishExport();
+                }
+                if (!this.running || runId !== this.runId) return;
+            }
+            sizer.record(sim.getSimulationCount() - count, N, performance.now() - batchStart);
+            if (this.exporting) {
+                this.postExportChunk(false);
+                if (this.exportInFlight >= EXPORT_MAX_IN_FLIGHT) {
+                    this.exportWaiting = true;
+                    break;
+                }
+            }
+        } while (performance.now() < sliceEnd && !this.isFinished());
+
+        if (this.isFinished()) {
+            const converged = this.isConverged();
+            this.running = false;
+            this.finishExport();
+            this.postSnapshot(converged ? 'converged' : 'stopped');
+            return;
+        }
+        if (performance.now() - this.lastSnapshot >= SNAPSHOT_INTERVAL_MS) {
+            this.postSnapshot('running');
+        }
+        if (!this.exportWaiting) this.scheduleNext();
+    }
+
+    // Chart the percentile paths over [start, end] from now on and send them right away,
+    // stopped or not; engines with path checkpoints replay only that window, at the
+    // chart's resolution
+    zoom(start, end) {
+        this.pathWindow = end > start ? { start, end } : null;
+        if (!this.params) return;
+        const begin = performance.now();
+        this.pathsSent = false;
+        this.pathsVersion = null;
+        const paths = this.collectPaths();
+        this.marshalMs += performance.now() - begin;
+        if (paths) this.post({ type: 'paths', paths }, [paths.buffer]);
+    }
+
+    // Paths are only sent when the percentile set changed since the last snapshot. They
+    // travel as one Float64Array in the get_decimated_paths layout ([M, yMin, yMax], then
+    // per path M times and M prices), reduced to the chart's resolution over the zoomed
+    // window, and its buffer is transferred rather than cloned.
+    collectPaths() {
+        const sim = this.simulation;
+        if (sim.isTrackingPhase()) return null;
+
+        const hasVersion = typeof sim.getPercentileVersion === 'function';
+        const version = hasVersion ? sim.getPercentileVersion() : null;
+        if (hasVersion ? version === this.pathsVersion : (this.pathsSent && this.params.percentileMode !== 1)) {
+            return null;
+        }
+
+        const points = this.params.chartPoints || DEFAULT_CHART_POINTS;
+        const range = this.pathWindow;
+        let view = null;
+        if (range && typeof sim.getDecimatedWindow === 'function') {
+            view = sim.getDecimatedWindow(range.start, range.end, points);
+        } else if (typeof sim.getDecimatedPaths === 'function') {
+            view = sim.getDecimatedPaths(points);
+        }
+        const block = view ? view.slice() : this.packFullPaths();
+        if (!block) return null;
+        this.pathsSent = true;
+        this.pathsVersion = version;
+        return block;
+    }
+
+    // Same layout at full resolution, for engines without get_decimated_paths
+    packFullPaths() {
+        const sim = this.simulation;
+        const paths = PERCENTILES.map(p => sim.getPercentilePath(p));
+        if (paths.some(path => !path)) return null;
+
+        const M = sim.getTimeSteps() + 1;
+        const dt = this.params.T / (M - 1);
+        const block = new Float64Array(3 + 2 * PERCENTILES.length * M);
+        let yMin = Infinity;
+        let yMax = -Infinity;
+        paths.forEach((path, k) => {
+            const offset = 3 + 2 * k * M;
+            for (let i = 0; i < M; i++) {
+                block[offset + i] = i * dt;
+                block[offset + M + i] = path[i];
+                yMin = Math.min(yMin, path[i]);
+                yMax = Math.max(yMax, path[i]);
+            }
+        });
+        block[0] = M;
+        block[1] = yMin;
+        block[2] = yMax;
+        return block;
+    }
+
+    // { delta: { value, standardError }, ... }, or null when not estimated (the engine
+    // only estimates Greeks for European payoffs)
+    collectGreeks() {
+        const sim = this.simulation;
+        const european = !this.params.payoff || this.params.payoff.style === 0;
+        if (!this.params.greeks || !european || typeof sim.getGreek !== 'function') return null;
+        const greeks = {};
+        GREEKS.forEach((name, k) => {
+            greeks[name] = { value: sim.getGreek(k), standardError: sim.getGreekStandardError(k) };
+        });
+        return greeks;
+    }
+
+    // The engine's counters (null when they are compiled out) with the time spent reading
+    // paths out of the engine and packing them for the page
+    collectPerf() {
+        const sim = this.simulation;
+        if (!this.perf) return null;
+        const engine = typeof sim.getPerfStats === 'function' ? sim.getPerfStats() : null;
+        return { engine, marshalMs: this.marshalMs };
+    }
+
+    postSnapshot(status) {
+        const sim = this.simulation;
+        this.lastSnapshot = performance.now();
+        const paths = this.collectPaths();
+        this.marshalMs += performance.now() - this.lastSnapshot;
+        this.post({
+            type: 'progress',
+            snapshot: {
+                status,
+                count: sim.getSimulationCount(),
+                price: sim.getOptionPrice(),
+                standardError: typeof sim.getStandardError === 'function' ? sim.getStandardError() : null,
+                analyticPrice: typeof sim.getAnalyticPrice === 'function' ? finiteOrNull(sim.getAnalyticPrice()) : null,
+                greeks: this.collectGreeks(),
+                blackScholesPrice: finiteOrNull(sim.getBlackScholesPrice()),
+                tracking: !!sim.isTrackingPhase(),
+                timeSteps: sim.getTimeSteps(),
+                restored: typeof sim.getRestoredCount === 'function' ? sim.getRestoredCount() : 0,
+                pathsPerSecond: this.fastSizer.pathsPerSecond(sim.getTimeSteps()),
+                perf: this.collectPerf(),
+                paths
+            }
+        }, paths ? [paths.buffer] : []);
+    }
+}
+
+if (typeof WorkerGlobalScope !== 'undefined' && self instanceof WorkerGlobalScope) {
+    const runner = new SimulationRunner(
+        async (src) => importScripts(src),
+        (message, transfer) => self.postMessage(message, transfer || [])
+    );
+    self.onmessage = (event) => runner.handleMessage(event.data);
+}
@@ -0,0 +1,330 @@
+// WebAssembly wrapper class
+class WasmSimulation {
+    // Each instance owns one engine context, so several simulations can share a module
+    // (and its heap and thread pool); call destroy() to release it. Exports the binary
+    // lacks are left undefined, along with the methods built on them, so callers can test
+    // for optional features with typeof.
+    constructor(module) {
+        this.module = module;
+        if (typeof module._heston_create_context !== 'function') {
+            throw new Error('This WebAssembly build predates engine contexts; rebuild it with build.sh');
+        }
+        this.context = module.ccall('heston_create_context', 'number', [], []);
+        if (!this.context) throw new Error('heston_create_context failed');
+        const bind = (name, returnType, argTypes) => {
+            if (typeof module['_' + name] !== 'function') return undefined;
+            const fn = module.cwrap(name, returnType, ['number', ...argTypes]);
+            return (...args) => fn(this.context, ...args);
+        };
+        this.initializeSimulation = bind('initialize_simulation', null,
+            ['number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number']);
+        this.runSimulationBatch = bind('run_simulation_batch', null, ['number']);
+        this.getSimulationCount = bind('get_simulation_count', 'number', []);
+        this.getOptionPrice = bind('get_option_price', 'number', []);
+        this.getBlackScholesPrice = bind('get_black_scholes_price', 'number', []);
+        this.getAnalyticPrice = bind('get_analytic_price', 'number', []);
+        this.hestonAnalyticCall = module.cwrap('heston_analytic_call', 'number',
+            ['number', 'number', 'number', 'number', 'number', 'number', 'number', 'number', 'number']);
+        this.getPercentilePathPtr = bind('get_percentile_path', 'number', ['number']);
+        this.getPercentilePathsPtr = bind('get_percentile_paths', 'number', []);
+        this.getDecimatedPathsPtr = bind('get_decimated_paths', 'number', ['number']);
+        this.getDecimatedWindowPtr = bind('get_decimated_window', 'number', ['number', 'number', 'number']);
+        this.getPercentileVersion = bind('get_percentile_version', 'number', []);
+        this.pathsView = null;
+        this.getTimeSteps = bind('get_time_steps', 'number', []);
+        this.isTrackingPhase = bind('is_tracking_phase', 'number', []);
+        this.setThreadCount = bind('set_thread_count', null, ['number']);
+        this.getThreadCount = bind('get_thread_count', 'number', []);
+        this.setRandomSeed = bind('set_random_seed', null, ['number']);
+        this.setPercentileMode = bind('set_percentile_mode', null, ['number']);
+        this.setPathCheckpoints = bind('set_path_checkpoints', null, ['number']);
+        this.setVarianceReduction = bind('set_variance_reduction', null, ['number']);
+        this.getStandardError = bind('get_standard_error', 'number', []);
+        this.setTargetTolerance = bind('set_target_tolerance', null, ['number']);
+        this.isConverged = bind('is_converged', 'number', []);
+        this.setResultCache = bind('set_result_cache', null, ['number']);
+        this.getRestoredCount = bind('get_restored_count', 'number', []);
+        this.setDiscretizationScheme = bind('set_discretization_scheme', null, ['number']);
+        this.setQmcReplicas = bind('set_qmc_replicas', null, ['number']);
+        this.setGreeks = bind('set_greeks', null, ['number']);
+        this.setPayoff = bind('set_payoff', null, ['number', 'number', 'number', 'number']);
+        this.getGreek = bind('get_greek', 'number', ['number']);
+        this.getGreekStandardError = bind('get_greek_standard_error', 'number', ['number']);
+        this.priceOptionGridRaw = bind('price_option_grid', 'number',
+            ['number', 'number', 'number', 'number', 'number', 'number', 'number']);
+        this.priceMlmcRaw = bind('price_mlmc', 'number', ['number', 'number', 'number', 'number', 'number']);
+        this.priceSensitivitiesRaw = bind('price_sensitivities', 'number', ['number', 'number', 'number']);
+        this.calibrateRaw = bind('calibrate_heston', 'number', ['number', 'number', 'number', 'number']);
+        this.getPerfStatsRaw = bind('get_perf_stats', 'number', ['number']);
+        this.exportBeginRaw = bind('export_begin', 'number', ['number', 'number', 'number', 'number']);
+        this.exportReady = bind('export_ready', 'number', ['number']);
+        this.exportDataPtr = bind('export_data', 'number', []);
+        this.exportRelease = bind('export_release', null, []);
+        this.exportEnd = bind('export_end', null, []);
+
+        const wrappers = {
+            calibrate: this.calibrateRaw, getPerfStats: this.getPerfStatsRaw,
+            exportBegin: this.exportBeginRaw && this.exportEnd, exportChunk: this.exportReady,
+            priceSensitivities: this.priceSensitivitiesRaw, priceMlmc: this.priceMlmcRaw,
+            priceOptionGrid: this.priceOptionGridRaw, getPercentilePaths: this.getPercentilePathsPtr,
+            getDecimatedPaths: this.getDecimatedPathsPtr, getDecimatedWindow: this.getDecimatedWindowPtr
+        };
+        Object.keys(wrappers).forEach(name => {
+            if (!wrappers[name]) this[name] = undefined;
+        });
+    }
+
+    destroy() {
+        if (this.context) {
+            this.module.ccall('heston_destroy_context', null, ['number'], [this.context]);
+            this.context = 0;
+            this.pathsView = null;
+        }
+    }
+
+    // Fit v0, theta, kappa, xi and rho to quotes [{ K, T, price }] (S0 and r from the last
+    // initializeSimulation), optionally refined with mcPaths Monte Carlo paths per maturity.
+    // Returns { params: { v0, theta, kappa, xi, rho }, rmse, iterations } or null.
+    calibrate(quotes, mcPaths = 0) {
+        const n = quotes.length;
+        const ptr = this.module._malloc((3 * n + 6) * 8);
+        if (!ptr) return null;
+
+        try {
+            const resultPtr = ptr + 3 * n * 8;
+            quotes.forEach((q, i) => {
+                this.module.setValue(ptr + (3 * i) * 8, q.K, 'double');
+                this.module.setValue(ptr + (3 * i + 1) * 8, q.T, 'double');
+                this.module.setValue(ptr + (3 * i + 2) * 8, q.price, 'double');
+            });
+            const iterations = this.calibrateRaw(ptr, n, mcPaths, resultPtr);
+            if (iterations < 0) return null;
+
+            const read = (k) => this.module.getValue(resultPtr + k * 8, 'double');
+            return {
+                params: { v0: read(0), theta: read(1), kappa: read(2), xi: read(3), rho: read(4) },
+                rmse: read(5),
+                iterations
+            };
+        } finally {
+            this.module._free(ptr);
+        }
+    }
+
+    // Performance counters of the current run keyed by WasmSimulation.PERF_STATS, or null
+    // when the module was built without HESTON_PERF (build.sh --perf)
+    getPerfStats() {
+        const names = WasmSimulation.PERF_STATS;
+        const ptr = this.module._malloc(names.length * 8);
+        if (!ptr) return null;
+
+        try {
+            if (!this.getPerfStatsRaw(ptr)) return null;
+            const stats = {};
+            names.forEach((name, k) => stats[name] = this.module.getValue(ptr + k * 8, 'double'));
+            return stats;
+        } finally {
+            this.module._free(ptr);
+        }
+    }
+
+    // Stream the current run's terminal prices (and with pathStride > 0 every pathStride-th
+    // path at pathPoints points) into export chunks of at most budgetBytes; see the README
+    // for the format. Returns the chunk capacity in paths, or -1.
+    exportBegin({ float64 = false, pathValues = false, budgetBytes = 16 << 20, pathStride = 0, pathPoints = 0 } = {}) {
+        const flags = (float64 ? WasmSimulation.EXPORT_FLOAT64 : 0) | (pathValues ? WasmSimulation.EXPORT_PATH_VALUES : 0);
+        return this.exportBeginRaw(flags, budgetBytes, pathStride, pathPoints);
+    }
+
+    // The finished export chunk as a Uint8Array copy, or null if none is ready (flush also
+    // finishes a partly filled one). Taking it lets the following batches refill the buffer.
+    exportChunk(flush = false) {
+        const bytes = this.exportReady(flush ? 1 : 0);
+        if (bytes <= 0 || !this.module.HEAPU8) return null;
+        const ptr = this.exportDataPtr();
+        const chunk = this.module.HEAPU8.slice(ptr, ptr + bytes);
+        this.exportRelease();
+        return chunk;
+    }
+
+    // Price and adjoint parameter sensitivities of the last initialized option. Returns
+    // { values, standardErrors }, each keyed by WasmSimulation.SENSITIVITIES, or null (QE
+    // or a path-dependent payoff).
+    priceSensitivities(numPaths) {
+        const names = WasmSimulation.SENSITIVITIES;
+        const ptr = this.module._malloc(2 * names.length * 8);
+        if (!ptr) return null;
+
+        try {
+            const errorsPtr = ptr + names.length * 8;
+            if (this.priceSensitivitiesRaw(numPaths, ptr, errorsPtr) < 0) return null;
+
+            const values = {};
+            const standardErrors = {};
+            names.forEach((name, k) => {
+                values[name] = this.module.getValue(ptr + k * 8, 'double');
+                standardErrors[name] = this.module.getValue(errorsPtr + k * 8, 'double');
+            });
+            return { values, standardErrors };
+        } finally {
+            this.module._free(ptr);
+        }
+    }
+
+    // Multilevel Monte Carlo price of the last initialized option to a target RMSE. Returns
+    // { price, standardError, bias, cost, levels: [{ samples, mean, variance }] } or null.
+    priceMlmc(targetRmse, baseSteps, maxLevel) {
+        const ptr = this.module._malloc((4 + 3 * (maxLevel + 1)) * 8);
+        if (!ptr) return null;
+
+        try {
+            const levelsPtr = ptr + 4 * 8;
+            const count = this.priceMlmcRaw(targetRmse, baseSteps, maxLevel, ptr, levelsPtr);
+            if (count < 0) return null;
+
+            const read = (offset) => this.module.getValue(ptr + offset * 8, 'double');
+            const levels = [];
+            for (let l = 0; l < count; l++) {
+                levels.push({ samples: read(4 + 3 * l), mean: read(5 + 3 * l), variance: read(6 + 3 * l) });
+            }
+            return { price: read(0), standardError: read(1), bias: read(2), cost: read(3), levels };
+        } finally {
+            this.module._free(ptr);
+        }
+    }
+
+    // Price every (strike, maturity) pair from one path set, using the parameters of the
+    // last initializeSimulation call. Returns { prices, standardErrors } as arrays of rows,
+    // one row per maturity, or null on invalid input.
+    priceOptionGrid(strikes, maturities, numPaths) {
+        const nK = strikes.length;
+        const nT = maturities.length;
+        const cells = nK * nT;
+        const ptr = this.module._malloc((nK + nT + 2 * cells) * 8);
+        if (!ptr) return null;
+
+        try {
+            const strikesPtr = ptr;
+            const maturitiesPtr = strikesPtr + nK * 8;
+            const pricesPtr = maturitiesPtr + nT * 8;
+            const errorsPtr = pricesPtr + cells * 8;
+            strikes.forEach((K, i) => this.module.setValue(strikesPtr + i * 8, K, 'double'));
+            maturities.forEach((T, i) => this.module.setValue(maturitiesPtr + i * 8, T, 'double'));
+
+            if (this.priceOptionGridRaw(strikesPtr, nK, maturitiesPtr, nT, numPaths, pricesPtr, errorsPtr) < 0) {
+                return null;
+            }
+
+            const prices = [];
+            const standardErrors = [];
+            for (let m = 0; m < nT; m++) {
+                const priceRow = [];
+                const errorRow = [];
+                for (let k = 0; k < nK; k++) {
+                    priceRow.push(this.module.getValue(pricesPtr + (m * nK + k) * 8, 'double'));
+                    errorRow.push(this.module.getValue(errorsPtr + (m * nK + k) * 8, 'double'));
+                }
+                prices.push(priceRow);
+                standardErrors.push(errorRow);
+            }
+            return { prices, standardErrors };
+        } finally {
+            this.module._free(ptr);
+        }
+    }
+
+    // All five percentile paths as one Float64Array of 5 * (N+1) doubles viewing WASM
+    // memory directly (path k at offset k * (N+1)). The view is only rebuilt when the
+    // block moves or memory grows, which detaches the old buffer. It is overwritten by
+    // the next initializeSimulation, so copy it to keep it.
+    getPercentilePaths() {
+        if (!this.module.HEAPF64) return null;
+        const ptr = this.getPercentilePathsPtr();
+        if (ptr === 0) return null;
+        const length = 5 * (this.getTimeSteps() + 1);
+        const heap = this.module.HEAPF64;
+
+        const view = this.pathsView;
+        if (!view || view.buffer !== heap.buffer || view.byteOffset !== ptr || view.length !== length) {
+            this.pathsView = heap.subarray(ptr >> 3, (ptr >> 3) + length);
+        }
+        return this.pathsView;
+    }
+
+    // Chart-resolution percentile paths in the get_decimated_paths layout: [M, yMin, yMax],
+    // then per path k at offset 3 + 2kM, M times followed by M prices. Like
+    // getPercentilePaths, the returned view aliases WASM memory.
+    getDecimatedPaths(maxPoints) {
+        if (!this.module.HEAPF64) return null;
+        const ptr = this.getDecimatedPathsPtr(maxPoints);
+        if (ptr === 0) return null;
+        const heap = this.module.HEAPF64;
+        const M = heap[ptr >> 3];
+        return heap.subarray(ptr >> 3, (ptr >> 3) + 3 + 10 * M);
+    }
+
+    // The same layout for the time window [start, end] only (get_decimated_window)
+    getDecimatedWindow(start, end, maxPoints) {
+        if (!this.module.HEAPF64) return null;
+        const ptr = this.getDecimatedWindowPtr(start, end, maxPoints);
+        if (ptr === 0) return null;
+        const heap = this.module.HEAPF64;
+        const M = heap[ptr >> 3];
+        return heap.subarray(ptr >> 3, (ptr >> 3) + 3 + 10 * M);
+    }
+
+    getPercentilePath(percentile) {
+        const ptr = this.getPercentilePathPtr(percentile);
+        if (ptr === 0) return null;
+        const N = this.getTimeSteps();
+
+        try {
+            if (this.module.getValue) {
+                const result = [];
+                for (let i = 0; i <= N; i++) {
+                    result.push(this.module.getValue(ptr + (i * 8), 'double'));
+                }
+                return result;
+            }
+
+            if (this.module.HEAPF64) {
+                const result = [];
+                for (let i = 0; i <= N; i++) {
+                    result.push(this.module.HEAPF64[(ptr >> 3) + i]);
+                }
+                return result;
+            }
+
+            let memoryBuffer = null;
+            if (this.module.wasmMemory && this.module.wasmMemory.buffer) {
+                memoryBuffer = this.module.wasmMemory.buffer;
+            } else if (this.module.memory && this.module.memory.buffer) {
+                memoryBuffer = this.module.memory.buffer;
+            } else if (this.module.exports && this.module.exports.memory && this.module.exports.memory.buffer) {
+                memoryBuffer = this.module.exports.memory.buffer;
+            }
+
+            if (memoryBuffer) {
+                const view = new Float64Array(memoryBuffer, ptr, N + 1);
+                return Array.from(view);
+            }
+
+            return null;
+
+        } catch (e) {
+            console.error("Error accessing WASM memory:", e);
+            return null;
+        }
+    }
+}
+
+// Order of price_sensitivities' outputs (SENS_* in heston.h)
+WasmSimulation.SENSITIVITIES = ['price', 'v0', 'theta', 'kappa', 'xi', 'rho'];
+// get_perf_stats layout (PERF_* in heston.h)
+WasmSimulation.PERF_STATS = ['rngMs', 'stepMs', 'payoffMs', 'copyOutMs', 'percentileMs', 'batchMs',
+                             'paths', 'steps', 'draws', 'pathsPerSecond', 'stepsPerSecond'];
+// export_begin flags (EXPORT_* in heston.h)
+WasmSimulation.EXPORT_FLOAT64 = 1;
+WasmSimulation.EXPORT_PATH_VALUES = 2;
+
+self.WasmSimulation = WasmSimulation;
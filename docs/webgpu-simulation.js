@@ -0,0 +1,535 @@
+// WebGPU compute backend. It sits beside WasmSimulation and HestonSimulationJS and wraps
+// one of them. After the CPU engine's percentile tracking phase, it simulates the
+// run's paths on the GPU, one invocation per sample (a path, or an antithetic pair).
+//
+// How the GPU run works:
+// - Each invocation runs the Milstein or full-truncation step of simulate_final_price
+//   in single precision.
+// - Normals come from Philox4x32-10 on the same substreams as heston.c, so it prices the
+//   same paths as the CPU engine, up to float rounding.
+// - Each workgroup reduces its payoffs to mean/M2 partials. Only those are read back
+//   and merged in double precision.
+//
+// Everything the GPU does not do goes to the CPU engine:
+// - tracking, chart paths, reference prices and Greeks;
+// - grids, MLMC, sensitivities and calibration;
+// - whole runs that use QE, QMC, moment matching or Greeks.
+
+const WEBGPU_WORKGROUP_SIZE = 256;
+const WEBGPU_PARTIAL_FLOATS = 8;  // Two vec4s per workgroup, see the shader
+const WEBGPU_UNIFORM_BYTES = 96;
+
+const WEBGPU_SHADER = /* wgsl */ `
+struct Params {
+    S0: f32, v0: f32, K: f32, barrier: f32,
+    dt: f32, sqrt_dt: f32, half_dt: f32, r_dt: f32,
+    kappa_dt: f32, theta: f32, xi: f32, rho: f32,
+    rho_bar: f32, milstein: f32, control_drift: f32, control_sigma: f32,
+    steps: u32, samples: u32, flags: u32, pad: u32,
+    key: vec2<u32>,           // Philox key: the run's seed
+    first_stream: vec2<u32>,  // Substream of this dispatch's first sample
+}
+
+struct PathResult {
+    payoff: f32,
+    W: f32,  // Brownian endpoint of the price driver, for the control variate
+}
+
+// Specialization constants, one pipeline per combination (see heston.c's kernel tables)
+override STYLE: u32 = 0u;  // PAYOFF_*
+override MILSTEIN: bool = true;  // Otherwise full truncation
+override ANTITHETIC: bool = false;
+override CONTROL: bool = false;
+
+const WORKGROUP_SIZE = ${WEBGPU_WORKGROUP_SIZE}u;
+const PAYOFF_ASIAN_ARITHMETIC = 1u;
+const PAYOFF_ASIAN_GEOMETRIC = 2u;
+const PAYOFF_BARRIER = 3u;
+const PAYOFF_LOOKBACK = 4u;
+const FLAG_PUT = 1u;
+const FLAG_UP = 2u;  // BARRIER_UP
+const FLAG_IN = 4u;  // BARRIER_IN
+
+@group(0) @binding(0) var<uniform> params: Params;
+// Per workgroup: (n, mean_y, mean_x, 0), (m2_y, m2_x, c_xy, 0)
+@group(0) @binding(1) var<storage, read_write> partials: array<vec4<f32>>;
+
+var<workgroup> scratch: array<vec4<f32>, WORKGROUP_SIZE>;
+
+// High word of the 64-bit product a * b (WGSL has no 64-bit integers)
+fn mul_hi(a: u32, b: u32) -> u32 {
+    let a_lo = a & 0xffffu;
+    let a_hi = a >> 16u;
+    let b_lo = b & 0xffffu;
+    let b_hi = b >> 16u;
+    let t = a_hi * b_lo + ((a_lo * b_lo) >> 16u);
+    let w = (t & 0xffffu) + a_lo * b_hi;
+    return a_hi * b_hi + (t >> 16u) + (w >> 16u);
+}
+
+fn philox(counter: vec4<u32>, key_in: vec2<u32>) -> vec4<u32> {
+    var c = counter;
+    var k = key_in;
+    for (var j = 0; j < 10; j++) {
+        let n0 = mul_hi(0xCD9E8D57u, c.z) ^ c.y ^ k.x;
+        let n2 = mul_hi(0xD2511F53u, c.x) ^ c.w ^ k.y;
+        c = vec4<u32>(n0, 0xCD9E8D57u * c.z, n2, 0xD2511F53u * c.x);
+        k += vec2<u32>(0x9E3779B9u, 0xBB67AE85u);
+    }
+    return c;
+}
+
+// Top 23 bits of the 64-bit draw whose high word is hi (uniform_from_bits keeps 53)
+fn uniform_from_high(hi: u32) -> f32 {
+    return (f32(hi >> 9u) + 0.5) * (1.0 / 8388608.0);
+}
+
+// Acklam's inverse normal CDF, as inverse_norm_cdf
+fn inverse_norm_cdf(p: f32) -> f32 {
+    if (p < 0.02425 || p > 0.97575) {
+        let q = sqrt(-2.0 * log(select(1.0 - p, p, p < 0.5)));
+        let x = (((((-7.784894002430293e-03 * q - 3.223964580411365e-01) * q - 2.400758277161838e+00) * q -
+                   2.549732539343734e+00) * q + 4.374664141464968e+00) * q + 2.938163982698783e+00) /
+                ((((7.784695709041462e-03 * q + 3.224671290700398e-01) * q + 2.445134137142996e+00) * q +
+                  3.754408661907416e+00) * q + 1.0);
+        return select(-x, x, p < 0.5);
+    }
+    let q = p - 0.5;
+    let r = q * q;
+    return (((((-3.969683028665376e+01 * r + 2.209460984245205e+02) * r - 2.759285104469687e+02) * r +
+              1.383577518672690e+02) * r - 3.066479806614716e+01) * r + 2.506628277459239e+00) * q /
+           (((((-5.447609879822406e+01 * r + 1.615858368580409e+02) * r - 1.556989798598866e+02) * r +
+              6.680131188771972e+01) * r - 1.328068155288572e+01) * r + 1.0);
+}
+
+fn payoff_amount(a: f32) -> f32 {
+    return select(max(a - params.K, 0.0), max(params.K - a, 0.0), (params.flags & FLAG_PUT) != 0u);
+}
+
+// One path of substream \`stream\` (z_sign -1: its antithetic mirror); step i reads Philox
+// counter i, whose two 64-bit halves give z1 and z2 as in rng_refill
+fn simulate_path(stream: vec2<u32>, z_sign: f32) -> PathResult {
+    var dir = select(-1.0, 1.0, (params.flags & FLAG_PUT) == 0u);
+    if (STYLE == PAYOFF_BARRIER) {
+        dir = select(-1.0, 1.0, (params.flags & FLAG_UP) != 0u);
+    }
+    var S = params.S0;
+    var v = params.v0;
+    var sum_z = 0.0;
+    var log_S = 0.0;
+    var acc = select(0.0, dir * params.S0, STYLE == PAYOFF_LOOKBACK);
+    var hit = STYLE == PAYOFF_BARRIER && dir * (params.S0 - params.barrier) >= 0.0;
+
+    for (var i = 0u; i < params.steps; i++) {
+        let bits = philox(vec4<u32>(i, 0u, stream.x, stream.y), params.key);
+        let z1 = z_sign * inverse_norm_cdf(uniform_from_high(bits.y));
+        let z2 = z_sign * inverse_norm_cdf(uniform_from_high(bits.w));
+        let Z_v = params.rho * z1 + params.rho_bar * z2;
+        sum_z += z1;
+
+        let v_clamped = max(v, 0.0);
+        let sqrt_v_dt = sqrt(v_clamped * params.dt);
+        var v_next = v + params.kappa_dt * (params.theta - v_clamped) + Z_v * params.xi * sqrt_v_dt;
+        if (MILSTEIN) {
+            v_next += params.milstein * (Z_v * Z_v - 1.0);
+        }
+        let x = params.r_dt - select(v_clamped, v, MILSTEIN) * params.half_dt + z1 * sqrt_v_dt;
+        S *= exp(x);
+        v = v_next;
+
+        if (STYLE == PAYOFF_ASIAN_ARITHMETIC) {
+            acc += S;
+        } else if (STYLE == PAYOFF_ASIAN_GEOMETRIC) {
+            log_S += x;
+            acc += log_S;
+        } else if (STYLE == PAYOFF_LOOKBACK) {
+            acc = max(acc, dir * S);
+        } else if (STYLE == PAYOFF_BARRIER) {
+            hit = hit || dir * (S - params.barrier) >= 0.0;
+        }
+    }
+
+    var a = S;
+    if (STYLE == PAYOFF_ASIAN_ARITHMETIC) {
+        a = acc / f32(params.steps);
+    } else if (STYLE == PAYOFF_ASIAN_GEOMETRIC) {
+        a = params.S0 * exp(acc / f32(params.steps));
+    } else if (STYLE == PAYOFF_LOOKBACK) {
+        a = dir * acc;
+    }
+    var payoff = payoff_amount(a);
+    if (STYLE == PAYOFF_BARRIER && hit != ((params.flags & FLAG_IN) != 0u)) {
+        payoff = 0.0;
+    }
+    return PathResult(payoff, sum_z * params.sqrt_dt);
+}
+
+// European option of the same type on the path's Brownian motion (see accumulate_path_stats)
+fn control(W: f32) -> f32 {
+    return payoff_amount(params.S0 * exp(params.control_drift + params.control_sigma * W));
+}
+
+fn reduce(lid: u32) -> vec4<f32> {
+    for (var s = WORKGROUP_SIZE / 2u; s > 0u; s = s >> 1u) {
+        if (lid < s) {
+            scratch[lid] += scratch[lid + s];
+        }
+        workgroupBarrier();
+    }
+    let total = scratch[0];
+    workgroupBarrier();
+    return total;
+}
+
+@compute @workgroup_size(WORKGROUP_SIZE)
+fn main(@builtin(global_invocation_id) gid: vec3<u32>, @builtin(local_invocation_index) lid: u32,
+        @builtin(workgroup_id) wid: vec3<u32>) {
+    let valid = gid.x < params.samples;
+    var y = 0.0;
+    var x = 0.0;
+    if (valid) {
+        var stream = params.first_stream;
+        stream.x += gid.x;
+        if (stream.x < gid.x) {
+            stream.y += 1u;
+        }
+        let a = simulate_path(stream, 1.0);
+        y = a.payoff;
+        if (CONTROL) {
+            x = control(a.W);
+        }
+        if (ANTITHETIC) {
+            let b = simulate_path(stream, -1.0);
+            y = 0.5 * (y + b.payoff);
+            if (CONTROL) {
+                x = 0.5 * (x + control(b.W));
+            }
+        }
+    }
+
+    // Two passes, so the squared deviations are taken about the workgroup's own mean
+    let n = select(0.0, 1.0, valid);
+    scratch[lid] = vec4<f32>(n, y, x, 0.0);
+    workgroupBarrier();
+    let sums = reduce(lid);
+    let mean_y = sums.y / max(sums.x, 1.0);
+    let mean_x = sums.z / max(sums.x, 1.0);
+    let dy = (y - mean_y) * n;
+    let dx = (x - mean_x) * n;
+    scratch[lid] = vec4<f32>(dy * dy, dx * dx, dx * dy, 0.0);
+    workgroupBarrier();
+    let m2 = reduce(lid);
+    if (lid == 0u) {
+        partials[2u * wid.x] = vec4<f32>(sums.x, mean_y, mean_x, 0.0);
+        partials[2u * wid.x + 1u] = vec4<f32>(m2.x, m2.y, m2.z, 0.0);
+    }
+}
+`;
+
+// CPU engine calls the GPU backend passes through unchanged
+const WEBGPU_FORWARDED = [
+    'getBlackScholesPrice', 'getAnalyticPrice', 'hestonAnalyticCall', 'getPercentilePath',
+    'getPercentileVersion', 'getDecimatedPaths', 'getDecimatedWindow', 'getTimeSteps', 'getThreadCount',
+    'setThreadCount', 'getGreek', 'getGreekStandardError', 'priceOptionGrid', 'priceMlmc', 'priceSensitivities', 'calibrate',
+    'setResultCache', 'exportChunk', 'exportEnd'
+];
+// Run options: recorded for the GPU run and passed on to the CPU engine
+const WEBGPU_OPTIONS = {
+    setRandomSeed: 'seed', setPercentileMode: 'percentileMode', setVarianceReduction: 'varianceReduction',
+    setTargetTolerance: 'tolerance', setDiscretizationScheme: 'scheme', setQmcReplicas: 'qmcReplicas',
+    setGreeks: 'greeks', setPathCheckpoints: 'pathCheckpoints'
+};
+
+class WebGPUSimulation {
+    // Resolves to a backend sharing the CPU engine `cpu`, or null without WebGPU
+    static async create(cpu) {
+        if (typeof navigator === 'undefined' || !navigator.gpu) return null;
+        const adapter = await navigator.gpu.requestAdapter({ powerPreference: 'high-performance' });
+        if (!adapter) return null;
+        const device = await adapter.requestDevice();
+        return new WebGPUSimulation(device, cpu);
+    }
+
+    constructor(device, cpu) {
+        this.device = device;
+        this.cpu = cpu;
+        this.module = device.createShaderModule({ code: WEBGPU_SHADER });
+        this.pipelines = new Map();
+
+        const maxGroups = Math.min(device.limits.maxComputeWorkgroupsPerDimension, 65535);
+        this.maxSamples = maxGroups * WEBGPU_WORKGROUP_SIZE;
+        const partialBytes = maxGroups * WEBGPU_PARTIAL_FLOATS * 4;
+        this.uniformData = new ArrayBuffer(WEBGPU_UNIFORM_BYTES);
+        this.uniforms = device.createBuffer({
+            size: WEBGPU_UNIFORM_BYTES, usage: GPUBufferUsage.UNIFORM | GPUBufferUsage.COPY_DST
+        });
+        this.partials = device.createBuffer({
+            size: partialBytes, usage: GPUBufferUsage.STORAGE | GPUBufferUsage.COPY_SRC
+        });
+        this.readback = device.createBuffer({
+            size: partialBytes, usage: GPUBufferUsage.MAP_READ | GPUBufferUsage.COPY_DST
+        });
+
+        this.options = { seed: 0, varianceReduction: 0, tolerance: 0, scheme: 0, qmcReplicas: 0, greeks: 0,
+                         pathCheckpoints: 0, payoff: { style: 0, put: 0, barrierType: 0, barrier: 0 } };
+        this.run = 0;              // Bumped by initializeSimulation; stale batches are dropped
+        this.queue = Promise.resolve();
+        this.gpuRun = false;
+        this.resetStats();
+
+        WEBGPU_FORWARDED.forEach(name => {
+            if (typeof cpu[name] === 'function') this[name] = (...args) => cpu[name](...args);
+        });
+        Object.keys(WEBGPU_OPTIONS).forEach(name => {
+            this[name] = (value) => {
+                this.options[WEBGPU_OPTIONS[name]] = value;
+                if (typeof cpu[name] === 'function') cpu[name](value);
+            };
+        });
+    }
+
+    destroy() {
+        [this.uniforms, this.partials, this.readback].forEach(buffer => buffer.destroy());
+        this.device.destroy();
+        if (typeof this.cpu.destroy === 'function') this.cpu.destroy();
+    }
+
+    setPayoff(style, optionType, barrierType, barrier) {
+        this.options.payoff = { style, put: optionType, barrierType, barrier };
+        if (typeof this.cpu.setPayoff === 'function') this.cpu.setPayoff(style, optionType, barrierType, barrier);
+    }
+
+    resetStats() {
+        this.stats = { n: 0, meanY: 0, meanX: 0, m2Y: 0, m2X: 0, cXY: 0 };
+        this.perf = { gpuMs: 0, gpuMergeMs: 0, gpuPaths: 0 };
+        this.count = 0;
+        this.price = 0;
+        this.standardError = 0;
+        this.converged = false;
+    }
+
+    initializeSimulation(S0, v0, r, theta, kappa, xi, rho, T, K, N) {
+        this.cpu.initializeSimulation(S0, v0, r, theta, kappa, xi, rho, T, K, N);
+        this.model = { S0, v0, r, theta, kappa, xi, rho, T, K, N };
+        this.run++;
+        this.resetStats();
+
+        // Configurations the shader does not cover run entirely on the CPU engine
+        const o = this.options;
+        this.gpuRun = N > 0 && (o.scheme === 0 || o.scheme === 1) && !o.qmcReplicas && !o.greeks &&
+                      !(o.varianceReduction & 4);
+        if (!this.gpuRun) return;
+
+        // Same control variate as initialize_simulation: a Black-Scholes option of the
+        // payoff's type at the expected average variance
+        const kT = kappa * T;
+        const avgVariance = theta + (v0 - theta) * (kT > 1e-12 ? (1 - Math.exp(-kT)) / kT : 1);
+        const sigma = Math.sqrt(Math.max(avgVariance, 1e-12));
+        const parity = o.payoff.put ? K * Math.exp(-r * T) - S0 : 0;
+        this.controlMean = Math.exp(r * T) * (WebGPUSimulation.blackScholesCall(S0, K, r, T, sigma) + parity);
+
+        const dt = T / N;
+        const f = new Float32Array(this.uniformData);
+        const u = new Uint32Array(this.uniformData);
+        f.set([S0, v0, K, o.payoff.barrier,
+               dt, Math.sqrt(dt), 0.5 * dt, r * dt,
+               kappa * dt, theta, xi, rho,
+               Math.sqrt(1 - rho * rho), o.scheme === 0 ? xi * xi / 4 * dt : 0, (r - 0.5 * sigma * sigma) * T, sigma]);
+        u[16] = N;
+        u[18] = (o.payoff.put ? 1 : 0) | ((o.payoff.barrierType & 3) << 1);
+        u[20] = o.seed % 4294967296;
+        u[21] = Math.floor(o.seed / 4294967296);
+
+        this.pipeline = this.getPipeline(o.payoff.style, o.scheme === 0, o.varianceReduction & 1, o.varianceReduction & 2);
+    }
+
+    // Pipelines are compiled once per specialization and kept with their bind group
+    getPipeline(style, milstein, antithetic, control) {
+        const key = `${style}/${milstein ? 1 : 0}/${antithetic ? 1 : 0}/${control ? 1 : 0}`;
+        let entry = this.pipelines.get(key);
+        if (!entry) {
+            const pipeline = this.device.createComputePipeline({
+                layout: 'auto',
+                compute: {
+                    module: this.module,
+                    entryPoint: 'main',
+                    constants: { STYLE: style, MILSTEIN: milstein ? 1 : 0, ANTITHETIC: antithetic ? 1 : 0,
+                                 CONTROL: control ? 1 : 0 }
+                }
+            });
+            const bindGroup = this.device.createBindGroup({
+                layout: pipeline.getBindGroupLayout(0),
+                entries: [
+                    { binding: 0, resource: { buffer: this.uniforms } },
+                    { binding: 1, resource: { buffer: this.partials } }
+                ]
+            });
+            entry = { pipeline, bindGroup };
+            this.pipelines.set(key, entry);
+        }
+        return entry;
+    }
+
+    // GPU batches return a promise, which the runner awaits; batches queue behind each
+    // other because they share the readback buffer
+    runSimulationBatch(batchSize) {
+        if (!this.gpuRun || this.cpu.isTrackingPhase()) {
+            return this.cpu.runSimulationBatch(batchSize);
+        }
+        if (this.converged || batchSize <= 0) return undefined;
+        const run = this.run;
+        const batch = this.queue.then(() => this.runGpuBatch(batchSize, run));
+        this.queue = batch.catch(() => {});
+        return batch;
+    }
+
+    async runGpuBatch(batchSize, run) {
+        if (run !== this.run) return;
+        // The GPU run starts again from path 0, and its first batch covers at least the
+        // tracking paths so the reported count never goes back
+        const perSample = (this.options.varianceReduction & 1) ? 2 : 1;
+        const minimum = this.count === 0 ? this.cpu.getSimulationCount() : 0;
+        const samples = Math.min(Math.ceil(Math.max(batchSize, minimum) / perSample), this.maxSamples);
+        const groups = Math.ceil(samples / WEBGPU_WORKGROUP_SIZE);
+        const firstStream = this.count / perSample;
+
+        const u = new Uint32Array(this.uniformData);
+        u[17] = samples;
+        u[22] = firstStream % 4294967296;
+        u[23] = Math.floor(firstStream / 4294967296);
+        this.device.queue.writeBuffer(this.uniforms, 0, this.uniformData);
+
+        const bytes = groups * WEBGPU_PARTIAL_FLOATS * 4;
+        const encoder = this.device.createCommandEncoder();
+        const pass = encoder.beginComputePass();
+        pass.setPipeline(this.pipeline.pipeline);
+        pass.setBindGroup(0, this.pipeline.bindGroup);
+        pass.dispatchWorkgroups(groups);
+        pass.end();
+        encoder.copyBufferToBuffer(this.partials, 0, this.readback, 0, bytes);
+        const submitted = performance.now();
+        this.device.queue.submit([encoder.finish()]);
+
+        await this.readback.mapAsync(GPUMapMode.READ, 0, bytes);
+        const partials = new Float32Array(this.readback.getMappedRange(0, bytes));
+        if (run === this.run) {
+            const mapped = performance.now();
+            this.perf.gpuMs += mapped - submitted;
+            for (let g = 0; g < groups; g++) {
+                const p = WEBGPU_PARTIAL_FLOATS * g;
+                WebGPUSimulation.mergeStats(this.stats, {
+                    n: partials[p], meanY: partials[p + 1], meanX: partials[p + 2],
+                    m2Y: partials[p + 4], m2X: partials[p + 5], cXY: partials[p + 6]
+                });
+            }
+            this.count += samples * perSample;
+            this.updatePrice();
+            this.perf.gpuMergeMs += performance.now() - mapped;
+            this.perf.gpuPaths += samples * perSample;
+        }
+        this.readback.unmap();
+    }
+
+    // update_option_price for a single statistics group
+    updatePrice() {
+        const st = this.stats;
+        const discount = Math.exp(-this.model.r * this.model.T);
+        let estimate = st.meanY;
+        let residual = st.m2Y;
+        if ((this.options.varianceReduction & 2) && st.m2X > 0) {
+            const beta = st.cXY / st.m2X;
+            estimate -= beta * (st.meanX - this.controlMean);
+            residual = Math.max(st.m2Y - st.cXY * beta, 0);
+        }
+        this.price = discount * estimate;
+        this.standardError = st.n > 1 ? discount * Math.sqrt(residual / (st.n - 1) / st.n) : 0;
+
+        const tolerance = this.options.tolerance;
+        if (tolerance > 0 && this.count >= 1000 && 1.959963984540054 * this.standardError <= tolerance) {
+            this.converged = true;
+        }
+    }
+
+    // The CPU engine reports until the first GPU batch has been merged
+    getSimulationCount() { return this.count > 0 ? this.count : this.cpu.getSimulationCount(); }
+    getOptionPrice() { return this.count > 0 ? this.price : this.cpu.getOptionPrice(); }
+    getStandardError() {
+        if (this.count > 0) return this.standardError;
+        return typeof this.cpu.getStandardError === 'function' ? this.cpu.getStandardError() : 0;
+    }
+    isConverged() {
+        if (this.count > 0) return this.converged ? 1 : 0;
+        return typeof this.cpu.isConverged === 'function' ? this.cpu.isConverged() : 0;
+    }
+    isTrackingPhase() { return this.cpu.isTrackingPhase(); }
+    // GPU runs always start from path 0, so only CPU runs continue from the result cache
+    getRestoredCount() {
+        return !this.gpuRun && typeof this.cpu.getRestoredCount === 'function' ? this.cpu.getRestoredCount() : 0;
+    }
+
+    // The GPU shader keeps no per-path prices, so an export runs the whole run on the CPU
+    // engine; it has to start before the run's first batch
+    exportBegin(options) {
+        if (this.count > 0 || typeof this.cpu.exportBegin !== 'function') return -1;
+        this.gpuRun = false;
+        return this.cpu.exportBegin(options);
+    }
+
+    // The CPU engine's counters (tracking and anything it still runs), or {} when it has
+    // none, plus the GPU run: dispatch-to-readback time, merge time and paths
+    getPerfStats() {
+        const cpu = typeof this.cpu.getPerfStats === 'function' ? this.cpu.getPerfStats() : null;
+        const stats = Object.assign(cpu || {}, this.perf);
+        if (this.perf.gpuMs > 0) stats.gpuPathsPerSecond = 1e3 * this.perf.gpuPaths / this.perf.gpuMs;
+        return stats;
+    }
+
+    // Chan et al.'s pairwise update, as stats_merge
+    static mergeStats(into, from) {
+        if (from.n === 0) return;
+        if (into.n === 0) {
+            Object.assign(into, from);
+            return;
+        }
+        const n = into.n + from.n;
+        const dy = from.meanY - into.meanY;
+        const dx = from.meanX - into.meanX;
+        const w = into.n * from.n / n;
+        into.m2Y += from.m2Y + dy * dy * w;
+        into.m2X += from.m2X + dx * dx * w;
+        into.cXY += from.cXY + dx * dy * w;
+        into.meanY += dy * from.n / n;
+        into.meanX += dx * from.n / n;
+        into.n = n;
+    }
+
+    // Standard normal CDF to double precision (Hart, 1968, as given by West, 2005)
+    static normCdf(x) {
+        const a = Math.abs(x);
+        let tail;
+        if (a > 37) {
+            tail = 0;
+        } else if (a < 7.07106781186547) {
+            const e = Math.exp(-a * a / 2);
+            const num = ((((((3.52624965998911e-02 * a + 0.700383064443688) * a + 6.37396220353165) * a +
+                            33.912866078383) * a + 112.079291497871) * a + 221.213596169931) * a + 220.206867912376);
+            const den = (((((((8.83883476483184e-02 * a + 1.75566716318264) * a + 16.064177579207) * a +
+                             86.7807322029461) * a + 296.564248779674) * a + 637.333633378831) * a +
+                          793.826512519948) * a + 440.413735824752);
+            tail = e * num / den;
+        } else {
+            const e = Math.exp(-a * a / 2);
+            tail = e / (a + 1 / (a + 2 / (a + 3 / (a + 4 / (a + 0.65))))) / 2.506628274631;
+        }
+        return x > 0 ? 1 - tail : tail;
+    }
+
+    static blackScholesCall(S0, K, r, T, sigma) {
+        if (sigma <= 0 || T <= 0) return Math.max(S0 - K * Math.exp(-r * T), 0);
+        const d1 = (Math.log(S0 / K) + (r + 0.5 * sigma * sigma) * T) / (sigma * Math.sqrt(T));
+        const d2 = d1 - sigma * Math.sqrt(T);
+        return S0 * WebGPUSimulation.normCdf(d1) - K * Math.exp(-r * T) * WebGPUSimulation.normCdf(d2);
+    }
+}
+
+self.WebGPUSimulation = WebGPUSimulation;
@@ -0,0 +1,154 @@
+// Cross-backend check of the JavaScript fallback (docs/simulation-fallback.js) against the
+// native engine: for each case, both run the same seed and options, the native CLI exports
+// its S_T in float64, and the script compares them path by path along with the price and
+// standard error, then reports the throughput of both. Results agree to rounding, not to
+// the bit: the C build may contract multiply-adds and its SIMD kernels use their own exp.
+//
+//   node native/compare_fallback.js [path/to/heston (default build/heston)] [--paths P] [--steps N]
+//
+// Exits with status 1 if any case differs by more than the tolerances below.
+'use strict';
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { execFileSync } = require('child_process');
+
+const PATH_TOLERANCE = 1e-9;   // Largest relative difference of S_T on any path
+const PRICE_TOLERANCE = 1e-8;  // Relative difference of the price and standard error
+const CLI_BATCH_PATHS = 16384;  // BATCH_PATHS of heston_cli.c, so moment matching sees the same batches
+
+function parseArguments(argv) {
+    const args = { cli: path.join(__dirname, '..', 'build', 'heston'), paths: 20000, steps: 100 };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--paths') args.paths = Number(argv[++i]);
+        else if (argv[i] === '--steps') args.steps = Number(argv[++i]);
+        else args.cli = argv[i];
+    }
+    return args;
+}
+
+// The fallback is a worker script that publishes its class on `self`
+function loadFallback() {
+    globalThis.self = globalThis;
+    require(path.join(__dirname, '..', 'docs', 'simulation-fallback.js'));
+    return globalThis.HestonSimulationJS;
+}
+
+// S_T of every exported sample, in path order (the stream format of the README)
+function readExportFinals(file) {
+    const data = fs.readFileSync(file);
+    if (data.toString('latin1', 0, 8) !== 'HESTONX1' || data.readUInt32LE(28) !== 8) {
+        throw new Error(`${file}: not a float64 export`);
+    }
+    const finals = [];
+    for (let offset = 64; offset < data.length;) {
+        const n = data.readUInt32LE(offset + 4);
+        const size = Number(data.readBigUInt64LE(offset + 24));
+        for (let i = 0; i < n; i++) finals.push(data.readDoubleLE(offset + 32 + 8 * i));
+        offset += 32 + size;
+    }
+    return Float64Array.from(finals);
+}
+
+function runNative(cli, model, c, paths, exportFile) {
+    const args = ['--paths', paths, '--N', model.N, '--seed', model.seed, '--scheme', c.scheme,
+                  '--vr', c.vr, '--payoff', c.payoff || 0, '--put', c.put || 0,
+                  '--barrier-type', c.barrierType || 0, '--barrier', c.barrier || 0];
+    for (const key of ['S0', 'K', 'r', 'T', 'v0', 'theta', 'kappa', 'xi', 'rho']) args.push('--' + key, model[key]);
+    if (exportFile) args.push('--export', exportFile, '--export-f64', 1);
+    const start = process.hrtime.bigint();
+    const out = execFileSync(cli, args.map(String), { encoding: 'utf8' });
+    const ms = Number(process.hrtime.bigint() - start) / 1e6;
+    const field = (name) => Number(new RegExp(`^${name}\\s+(\\S+)`, 'm').exec(out)[1]);
+    return { count: field('paths'), price: field('price'), standardError: field('standard_error'), ms };
+}
+
+function runFallback(HestonSimulationJS, model, c, paths, keepFinals) {
+    const sim = new HestonSimulationJS();
+    sim.setRandomSeed(model.seed);
+    sim.setPercentileMode(1);
+    sim.setVarianceReduction(c.vr);
+    sim.setDiscretizationScheme(c.scheme);
+    sim.setPayoff(c.payoff || 0, c.put || 0, c.barrierType || 0, c.barrier || 0);
+    sim.initializeSimulation(model.S0, model.v0, model.r, model.theta, model.kappa, model.xi, model.rho,
+                             model.T, model.K, model.N);
+    const finals = keepFinals ? new Float64Array(paths + 1) : null;
+    const start = process.hrtime.bigint();
+    while (sim.getSimulationCount() < paths) {
+        const count = sim.getSimulationCount();
+        sim.runSimulationBatch(Math.min(paths - count, CLI_BATCH_PATHS));
+        const done = sim.getSimulationCount() - count;
+        if (done === 0) break;
+        if (finals) finals.set(sim.getBatchFinals(done), count);
+    }
+    const ms = Number(process.hrtime.bigint() - start) / 1e6;
+    return { count: sim.getSimulationCount(), price: sim.getOptionPrice(), standardError: sim.getStandardError(),
+             finals, ms };
+}
+
+function relative(a, b) {
+    return a === b ? 0 : Math.abs(a - b) / Math.max(Math.abs(a), Math.abs(b));
+}
+
+const CASES = [
+    { name: 'Milstein', scheme: 0, vr: 0 },
+    { name: 'full truncation', scheme: 1, vr: 0 },
+    { name: 'QE', scheme: 2, vr: 0 },
+    { name: 'Milstein antithetic + CV', scheme: 0, vr: 3 },
+    { name: 'QE moment matching', scheme: 2, vr: 4 },
+    { name: 'full truncation put', scheme: 1, vr: 1, put: 1 },
+    { name: 'arithmetic Asian', scheme: 0, vr: 2, payoff: 1 },
+    { name: 'geometric Asian', scheme: 2, vr: 1, payoff: 2 },
+    { name: 'up-and-out barrier', scheme: 0, vr: 0, payoff: 3, barrierType: 1, barrier: 130 },
+    { name: 'lookback put', scheme: 1, vr: 0, payoff: 4, put: 1 }
+];
+
+function main() {
+    const args = parseArguments(process.argv.slice(2));
+    if (!fs.existsSync(args.cli)) {
+        console.error(`native CLI not found at ${args.cli}; build it or pass its path`);
+        process.exit(2);
+    }
+    const HestonSimulationJS = loadFallback();
+    const model = { S0: 100, K: 100, r: 0.05, T: 1, v0: 0.04, theta: 0.1, kappa: 1, xi: 0.2, rho: -0.5,
+                    N: args.steps, seed: 12345 };
+    const exportFile = path.join(os.tmpdir(), `heston-compare-${process.pid}.bin`);
+    let failed = false;
+
+    console.log(`${args.paths} paths, N = ${args.steps}`);
+    console.log('case                          max |dS_T|/S_T   price (native / JS)      rel. diff');
+    for (const c of CASES) {
+        const native = runNative(args.cli, model, c, args.paths, exportFile);
+        const js = runFallback(HestonSimulationJS, model, c, args.paths, true);
+        const nativeFinals = readExportFinals(exportFile);
+        let worst = nativeFinals.length === js.count ? 0 : Infinity;
+        for (let i = 0; i < nativeFinals.length && i < js.count; i++) {
+            worst = Math.max(worst, relative(nativeFinals[i], js.finals[i]));
+        }
+        // The CLI prints six decimals
+        const priceDiff = Math.abs(native.price - js.price) > 1.5e-6 ? relative(native.price, js.price) : 0;
+        const errorDiff = Math.abs(native.standardError - js.standardError) > 1.5e-6 ?
+            relative(native.standardError, js.standardError) : 0;
+        const ok = native.count === js.count && worst <= PATH_TOLERANCE &&
+                   priceDiff <= PRICE_TOLERANCE && errorDiff <= PRICE_TOLERANCE;
+        failed = failed || !ok;
+        console.log(`${c.name.padEnd(30)}${worst.toExponential(2).padStart(12)}   ` +
+                    `${native.price.toFixed(6)} / ${js.price.toFixed(6)}`.padEnd(25) +
+                    `${Math.max(priceDiff, errorDiff).toExponential(2)}  ${ok ? 'ok' : 'FAIL'}`);
+    }
+    fs.rmSync(exportFile, { force: true });
+
+    // Throughput on one thread, Milstein European, without the export
+    const benchPaths = 10 * args.paths;
+    const benchCase = CASES[0];
+    const native = runNative(args.cli, model, benchCase, benchPaths, null);
+    const js = runFallback(HestonSimulationJS, model, benchCase, benchPaths, false);
+    const nativeRate = benchPaths / native.ms * 1000;
+    const jsRate = benchPaths / js.ms * 1000;
+    console.log(`\nthroughput (${benchPaths} paths): native ${nativeRate.toFixed(0)} paths/s, ` +
+                `JS ${jsRate.toFixed(0)} paths/s, native / JS = ${(nativeRate / jsRate).toFixed(2)}`);
+    process.exit(failed ? 1 : 0);
+}
+
+main();
@@ -0,0 +1,165 @@
+// Throughput benchmark for the native build. For every combination of step count N,
+// discretization scheme and thread count it times a fixed number of paths M, then a
+// run to the target standard error, and prints one row per combination:
+//
+//   heston-bench [--N 100,1000] [--paths 100000] [--scheme 0,1,2] [--threads 1,4]
+//                [--stderr 0.01] [--vr 0] [--qmc 0]
+//
+// paths/s and ns/step are wall-clock figures (ns/step is per path-step, so it falls with
+// the thread count); time-to-stderr is the wall time until the standard error first
+// drops below --stderr, or "-" if that takes more than MAX_TARGET_PATHS paths. Builds
+// with -DHESTON_PERF=ON add a line per row splitting the fixed run's time by phase.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "heston.h"
+
+#define MAX_VALUES 16
+#define BATCH_PATHS 16384
+#define MAX_TARGET_PATHS 50000000
+
+typedef struct {
+    int values[MAX_VALUES];
+    int count;
+} IntList;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static int parse_list(const char *text, IntList *list) {
+    list->count = 0;
+    while (*text) {
+        char *end;
+        long value = strtol(text, &end, 10);
+        if (end == text || value < 0 || list->count == MAX_VALUES) return -1;
+        list->values[list->count++] = (int)value;
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        text = end;
+    }
+    return list->count > 0 ? 0 : -1;
+}
+
+// Same model as the web app's defaults
+static void initialize(HestonContext *ctx, int N) {
+    initialize_simulation(ctx, 100.0, 0.04, 0.05, 0.1, 1.0, 0.2, -0.5, 1.0, 100.0, N);
+}
+
+// Run batches until count paths have been simulated or the run converged
+static void run_paths(HestonContext *ctx, long long count) {
+    while (get_simulation_count(ctx) < count && !is_converged(ctx)) {
+        int before = get_simulation_count(ctx);
+        long long remaining = count - before;
+        run_simulation_batch(ctx, remaining < BATCH_PATHS ? (int)remaining : BATCH_PATHS);
+        if (get_simulation_count(ctx) == before) break;
+    }
+}
+
+int main(int argc, char **argv) {
+    IntList steps = { { 100, 1000 }, 2 };
+    IntList schemes = { { SCHEME_MILSTEIN, SCHEME_FULL_TRUNCATION, SCHEME_QE }, 3 };
+    IntList threads = { { 1 }, 1 };
+    long long paths = 100000;
+    double target = 0.01;
+    int vr = 0;
+    int qmc = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : "";
+        int ok = i + 1 < argc;
+        if (strcmp(argv[i], "--N") == 0) {
+            ok = parse_list(value, &steps) == 0;
+        } else if (strcmp(argv[i], "--scheme") == 0) {
+            ok = parse_list(value, &schemes) == 0;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            ok = parse_list(value, &threads) == 0;
+        } else if (strcmp(argv[i], "--paths") == 0) {
+            paths = atoll(value);
+        } else if (strcmp(argv[i], "--stderr") == 0) {
+            target = atof(value);
+        } else if (strcmp(argv[i], "--vr") == 0) {
+            vr = atoi(value);
+        } else if (strcmp(argv[i], "--qmc") == 0) {
+            qmc = atoi(value);
+        } else {
+            ok = 0;
+        }
+        if (!ok || paths <= 0) {
+            fprintf(stderr, "usage: %s [--N 100,1000] [--paths 100000] [--scheme 0,1,2] [--threads 1,4]\n"
+                            "       [--stderr 0.01] [--vr 0] [--qmc 0]\n", argv[0]);
+            return 2;
+        }
+        i++;
+    }
+
+    HestonContext *ctx = heston_create_context();
+    if (!ctx) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+    // Both runs of a row use the same model and options, so the second must not continue
+    // the first from the result cache
+    set_result_cache(ctx, 0);
+    static const char *scheme_names[] = { "milstein", "ft", "qe" };
+    printf("%6s %9s %8s %7s %12s %9s %10s %10s %12s\n",
+           "N", "paths", "scheme", "threads", "paths/s", "ns/step", "price", "stderr", "t(stderr)s");
+
+    for (int a = 0; a < steps.count; a++) {
+        for (int b = 0; b < schemes.count; b++) {
+            for (int c = 0; c < threads.count; c++) {
+                int N = steps.values[a];
+                int scheme = schemes.values[b];
+                set_thread_count(ctx, threads.values[c]);
+                set_discretization_scheme(ctx, scheme);
+                set_variance_reduction(ctx, vr);
+                set_qmc_replicas(ctx, qmc);
+                set_percentile_mode(ctx, PERCENTILE_STREAMING);
+                set_random_seed(ctx, 1);
+
+                // Fixed path count; the tracking phase is part of every run, so it is timed too
+                set_target_tolerance(ctx, 0);
+                initialize(ctx, N);
+                double start = now_seconds();
+                run_paths(ctx, paths);
+                double elapsed = now_seconds() - start;
+                int simulated = get_simulation_count(ctx);
+                double price = get_option_price(ctx);
+                double error = get_standard_error(ctx);
+                double perf[NUM_PERF_STATS];
+                int has_perf = get_perf_stats(ctx, perf);
+
+                // Time to standard error: set_target_tolerance takes a 95% half-width
+                set_target_tolerance(ctx, 1.959963984540054 * target);
+                initialize(ctx, N);
+                start = now_seconds();
+                run_paths(ctx, MAX_TARGET_PATHS);
+                double to_target = now_seconds() - start;
+
+                printf("%6d %9d %8s %7d %12.0f %9.2f %10.5f %10.5f ",
+                       N, simulated, scheme >= 0 && scheme <= 2 ? scheme_names[scheme] : "?",
+                       get_thread_count(ctx), simulated / elapsed, 1e9 * elapsed / ((double)simulated * N),
+                       price, error);
+                if (is_converged(ctx)) printf("%12.3f\n", to_target);
+                else printf("%12s\n", "-");
+                if (has_perf) {
+                    // Phase times are summed over threads; shares are of their total
+                    double total = perf[PERF_RNG_MS] + perf[PERF_STEP_MS] + perf[PERF_PAYOFF_MS] +
+                                   perf[PERF_PERCENTILE_MS];
+                    if (total <= 0.0) total = 1.0;
+                    printf("       rng %.1f%%  step %.1f%%  payoff %.1f%%  percentiles %.1f%%  "
+                           "(%.0f ms in batches, %.3g draws)\n",
+                           100.0 * perf[PERF_RNG_MS] / total, 100.0 * perf[PERF_STEP_MS] / total,
+                           100.0 * perf[PERF_PAYOFF_MS] / total, 100.0 * perf[PERF_PERCENTILE_MS] / total,
+                           perf[PERF_BATCH_MS], perf[PERF_DRAWS]);
+                }
+                fflush(stdout);
+            }
+        }
+    }
+    heston_destroy_context(ctx);
+    return 0;
+}
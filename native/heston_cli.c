@@ -0,0 +1,184 @@
+// Command-line pricer for the native build: runs one simulation to a path count or a
+// target confidence half-width and prints the estimate next to the reference prices.
+//
+//   heston [--S0 100] [--K 100] [--r 0.05] [--T 1] [--v0 0.04] [--theta 0.1] [--kappa 1]
+//          [--xi 0.2] [--rho -0.5] [--N 1000] [--paths 100000] [--tolerance 0]
+//          [--scheme 0] [--vr 0] [--qmc 0] [--greeks 0] [--seed 1] [--threads 1]
+//          [--payoff 0] [--put 0] [--barrier-type 0] [--barrier 0]
+//          [--export FILE [--export-f64 0] [--export-values 0] [--export-stride 0]
+//          [--export-points 0] [--export-mb 16]]
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "heston.h"
+
+#define BATCH_PATHS 16384
+
+typedef struct {
+    const char *name;
+    double value;
+} Option;
+
+enum { OPT_S0, OPT_K, OPT_R, OPT_T, OPT_V0, OPT_THETA, OPT_KAPPA, OPT_XI, OPT_RHO, OPT_N,
+       OPT_PATHS, OPT_TOLERANCE, OPT_SCHEME, OPT_VR, OPT_QMC, OPT_GREEKS, OPT_SEED, OPT_THREADS,
+       OPT_PAYOFF, OPT_PUT, OPT_BARRIER_TYPE, OPT_BARRIER, OPT_EXPORT_F64, OPT_EXPORT_VALUES,
+       OPT_EXPORT_STRIDE, OPT_EXPORT_POINTS, OPT_EXPORT_MB, NUM_OPTIONS };
+
+static Option options[NUM_OPTIONS] = {
+    { "S0", 100.0 }, { "K", 100.0 }, { "r", 0.05 }, { "T", 1.0 }, { "v0", 0.04 },
+    { "theta", 0.1 }, { "kappa", 1.0 }, { "xi", 0.2 }, { "rho", -0.5 }, { "N", 1000 },
+    { "paths", 100000 }, { "tolerance", 0.0 }, { "scheme", SCHEME_MILSTEIN }, { "vr", 0 },
+    { "qmc", 0 }, { "greeks", 0 }, { "seed", 1 }, { "threads", 1 }, { "payoff", PAYOFF_EUROPEAN },
+    { "put", 0 }, { "barrier-type", BARRIER_DOWN_OUT }, { "barrier", 0.0 }, { "export-f64", 0 },
+    { "export-values", 0 }, { "export-stride", 0 }, { "export-points", 0 }, { "export-mb", 16 }
+};
+
+static const char *export_path;  // --export FILE
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [--option value]...\n\noptions (defaults):\n", program);
+    for (int i = 0; i < NUM_OPTIONS; i++) {
+        fprintf(stderr, "  --%-13s %g\n", options[i].name, options[i].value);
+    }
+    fprintf(stderr, "\n--paths caps the run; with --tolerance > 0 it stops earlier once the 95%% CI\n"
+                    "half-width is below the tolerance. --scheme: 0 Milstein, 1 full truncation, 2 QE.\n"
+                    "--vr: 1 antithetic | 2 control variate | 4 moment matching. --qmc: Sobol replicas.\n"
+                    "--payoff: 0 European, 1 arithmetic Asian, 2 geometric Asian, 3 barrier, 4 lookback.\n"
+                    "--barrier-type: 0 down-out, 1 up-out, 2 down-in, 3 up-in.\n"
+                    "--export FILE streams S_T (float32, or float64 with --export-f64 1) and, with\n"
+                    "--export-values 1, the path values of path-dependent payoffs to FILE in chunks\n"
+                    "of at most --export-mb megabytes; --export-stride S also writes every S-th path\n"
+                    "at --export-points evenly spaced steps.\n");
+}
+
+static int parse_arguments(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) return -1;
+        if (strncmp(argv[i], "--", 2) != 0 || i + 1 >= argc) {
+            fprintf(stderr, "%s: expected --option value, got '%s'\n", argv[0], argv[i]);
+            return -1;
+        }
+        if (strcmp(argv[i], "--export") == 0) {
+            export_path = argv[++i];
+            continue;
+        }
+        int found = 0;
+        for (int k = 0; k < NUM_OPTIONS; k++) {
+            if (strcmp(argv[i] + 2, options[k].name) == 0) {
+                char *end;
+                options[k].value = strtod(argv[i + 1], &end);
+                if (*end != '\0') {
+                    fprintf(stderr, "%s: invalid value '%s' for --%s\n", argv[0], argv[i + 1], options[k].name);
+                    return -1;
+                }
+                found = 1;
+                break;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "%s: unknown option '%s'\n", argv[0], argv[i]);
+            return -1;
+        }
+        i++;
+    }
+    return 0;
+}
+
+// Write the chunk waiting in the export buffer, if any (flush: also a partly filled one)
+static int write_export_chunk(HestonContext *ctx, FILE *file, int flush) {
+    int bytes = export_ready(ctx, flush);
+    if (bytes <= 0) return 0;
+    if (fwrite(export_data(ctx), 1, (size_t)bytes, file) != (size_t)bytes) return -1;
+    export_release(ctx);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (parse_arguments(argc, argv) != 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    double o[NUM_OPTIONS];
+    for (int i = 0; i < NUM_OPTIONS; i++) o[i] = options[i].value;
+    HestonContext *ctx = heston_create_context();
+    if (!ctx) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    set_thread_count(ctx, (int)o[OPT_THREADS]);
+    set_random_seed(ctx, o[OPT_SEED]);
+    set_discretization_scheme(ctx, (int)o[OPT_SCHEME]);
+    set_variance_reduction(ctx, (int)o[OPT_VR]);
+    set_qmc_replicas(ctx, (int)o[OPT_QMC]);
+    set_greeks(ctx, (int)o[OPT_GREEKS]);
+    set_payoff(ctx, (int)o[OPT_PAYOFF], o[OPT_PUT] != 0 ? OPTION_PUT : OPTION_CALL, (int)o[OPT_BARRIER_TYPE],
+               o[OPT_BARRIER]);
+    set_target_tolerance(ctx, o[OPT_TOLERANCE]);
+    set_percentile_mode(ctx, PERCENTILE_STREAMING);
+    initialize_simulation(ctx, o[OPT_S0], o[OPT_V0], o[OPT_R], o[OPT_THETA], o[OPT_KAPPA],
+                          o[OPT_XI], o[OPT_RHO], o[OPT_T], o[OPT_K], (int)o[OPT_N]);
+
+    FILE *export_file = NULL;
+    int export_failed = 0;
+    if (export_path) {
+        int flags = (o[OPT_EXPORT_F64] != 0 ? EXPORT_FLOAT64 : 0) |
+                    (o[OPT_EXPORT_VALUES] != 0 ? EXPORT_PATH_VALUES : 0);
+        export_file = fopen(export_path, "wb");
+        if (!export_file || export_begin(ctx, flags, o[OPT_EXPORT_MB] * 1048576.0, (int)o[OPT_EXPORT_STRIDE],
+                                         (int)o[OPT_EXPORT_POINTS]) < 0) {
+            fprintf(stderr, "%s: cannot export to '%s'\n", argv[0], export_path);
+            if (export_file) fclose(export_file);
+            heston_destroy_context(ctx);
+            return 1;
+        }
+    }
+
+    long long max_paths = (long long)o[OPT_PATHS];
+    while (get_simulation_count(ctx) < max_paths && !is_converged(ctx)) {
+        if (export_file && write_export_chunk(ctx, export_file, 0) != 0) {
+            export_failed = 1;
+            break;
+        }
+        // Batches are rounded to whole antithetic pairs and QMC replica sets, so a tail
+        // smaller than one of those adds nothing
+        int count = get_simulation_count(ctx);
+        long long remaining = max_paths - count;
+        run_simulation_batch(ctx, remaining < BATCH_PATHS ? (int)remaining : BATCH_PATHS);
+        if (get_simulation_count(ctx) == count) break;
+    }
+    if (export_file) {
+        // The last full chunk, then whatever the final batches left in the open one
+        if (!export_failed) {
+            export_failed = write_export_chunk(ctx, export_file, 0) != 0 ||
+                            write_export_chunk(ctx, export_file, 1) != 0;
+        }
+        export_end(ctx);
+        if (fclose(export_file) != 0 || export_failed) {
+            fprintf(stderr, "%s: error writing '%s'\n", argv[0], export_path);
+            heston_destroy_context(ctx);
+            return 1;
+        }
+    }
+
+    double analytic = get_analytic_price(ctx);
+    printf("paths           %d\n", get_simulation_count(ctx));
+    printf("threads         %d\n", get_thread_count(ctx));
+    printf("price           %.6f\n", get_option_price(ctx));
+    printf("standard_error  %.6f\n", get_standard_error(ctx));
+    // Reference prices exist for European payoffs only
+    if (!isnan(analytic)) {
+        printf("analytic        %.6f\n", analytic);
+        printf("black_scholes   %.6f\n", get_black_scholes_price(ctx));
+        printf("error           %+.6f\n", get_option_price(ctx) - analytic);
+    }
+    if (o[OPT_GREEKS] != 0 && o[OPT_PAYOFF] == PAYOFF_EUROPEAN) {
+        static const char *names[NUM_GREEKS] = { "delta", "vega", "gamma" };
+        for (int k = 0; k < NUM_GREEKS; k++) {
+            printf("%-15s %.6f (%.6f)\n", names[k], get_greek(ctx, k), get_greek_standard_error(ctx, k));
+        }
+    }
+    heston_destroy_context(ctx);
+    return 0;
+}
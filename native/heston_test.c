@@ -0,0 +1,158 @@
+// Regression test for the native build, run by ctest. It checks that
+//
+//   - European call and put prices lie within MAX_SE_MULTIPLE standard errors of the
+//     semi-analytic price (put-call parity for puts), for every discretization scheme
+//     and variance reduction flag, on one thread and on several;
+//   - calibration recovers the parameters that generated its quotes, both analytically
+//     and with the Monte Carlo refinement, and the refinement gives the same fit whatever
+//     payoff the simulation is set to.
+//
+// Prints one line per failed check and exits with status 1 if there was any.
+#include <math.h>
+#include <stdio.h>
+#include "heston.h"
+
+#define TEST_PATHS 65536
+#define BATCH_PATHS 16384
+#define TEST_STEPS 100
+#define MAX_SE_MULTIPLE 4.0
+
+// Generating model of the calibration quotes
+#define CAL_V0 0.04
+#define CAL_THETA 0.1
+#define CAL_KAPPA 1.5
+#define CAL_XI 0.4
+#define CAL_RHO -0.6
+#define CAL_MC_PATHS 20000
+
+static int failures = 0;
+
+static void fail(const char *what, double got, double expected, double tolerance) {
+    printf("FAIL %s: %.6f, expected %.6f +/- %.6f\n", what, got, expected, tolerance);
+    failures++;
+}
+
+static void check_close(const char *what, double got, double expected, double tolerance) {
+    if (!(fabs(got - expected) <= tolerance)) fail(what, got, expected, tolerance);
+}
+
+// Same model as the web app's defaults
+static void initialize(HestonContext *ctx) {
+    initialize_simulation(ctx, 100.0, 0.04, 0.05, 0.1, 1.0, 0.2, -0.5, 1.0, 100.0, TEST_STEPS);
+}
+
+static void check_price(int scheme, int vr, int option_type, int threads) {
+    char what[96];
+    HestonContext *ctx = heston_create_context();
+    if (!ctx) {
+        printf("FAIL out of memory\n");
+        failures++;
+        return;
+    }
+    set_result_cache(ctx, 0);
+    set_discretization_scheme(ctx, scheme);
+    set_variance_reduction(ctx, vr);
+    set_payoff(ctx, PAYOFF_EUROPEAN, option_type, BARRIER_DOWN_OUT, 0.0);
+    set_thread_count(ctx, threads);
+    initialize(ctx);
+    while (get_simulation_count(ctx) < TEST_PATHS) {
+        int before = get_simulation_count(ctx);
+        run_simulation_batch(ctx, BATCH_PATHS);
+        if (get_simulation_count(ctx) == before) break;
+    }
+
+    snprintf(what, sizeof what, "%s scheme %d vr %d threads %d",
+             option_type == OPTION_PUT ? "put" : "call", scheme, vr, threads);
+    if (get_simulation_count(ctx) < TEST_PATHS) {
+        printf("FAIL %s: stopped after %d paths\n", what, get_simulation_count(ctx));
+        failures++;
+    } else {
+        check_close(what, get_option_price(ctx), get_analytic_price(ctx),
+                    MAX_SE_MULTIPLE * get_standard_error(ctx));
+    }
+    heston_destroy_context(ctx);
+}
+
+static void check_prices(void) {
+    static const int vr_flags[] = {
+        0, VR_ANTITHETIC, VR_CONTROL_VARIATE, VR_MOMENT_MATCHING,
+        VR_ANTITHETIC | VR_CONTROL_VARIATE, VR_ANTITHETIC | VR_CONTROL_VARIATE | VR_MOMENT_MATCHING
+    };
+    static const int thread_counts[] = {1, 4};
+    for (int scheme = SCHEME_MILSTEIN; scheme <= SCHEME_QE; scheme++)
+        for (size_t v = 0; v < sizeof vr_flags / sizeof vr_flags[0]; v++)
+            for (int option_type = OPTION_CALL; option_type <= OPTION_PUT; option_type++)
+                for (size_t t = 0; t < sizeof thread_counts / sizeof thread_counts[0]; t++)
+                    check_price(scheme, vr_flags[v], option_type, thread_counts[t]);
+}
+
+// Fit quotes generated by the CAL_* model from a different starting point, with the
+// simulation set to the given payoff
+static void calibrate(int style, int option_type, int mc_paths, double *out_result) {
+    static const double strikes[] = {80.0, 90.0, 100.0, 110.0, 120.0};
+    static const double maturities[] = {0.5, 1.0, 2.0};
+    double quotes[3 * 15];
+    int num_quotes = 0;
+    for (int t = 0; t < 3; t++) {
+        for (int k = 0; k < 5; k++) {
+            quotes[3 * num_quotes] = strikes[k];
+            quotes[3 * num_quotes + 1] = maturities[t];
+            quotes[3 * num_quotes + 2] = heston_analytic_call(100.0, CAL_V0, 0.05, CAL_THETA, CAL_KAPPA,
+                                                              CAL_XI, CAL_RHO, maturities[t], strikes[k]);
+            num_quotes++;
+        }
+    }
+
+    HestonContext *ctx = heston_create_context();
+    for (int i = 0; i <= CALIB_PARAMS; i++) out_result[i] = NAN;
+    if (!ctx) return;
+    set_result_cache(ctx, 0);
+    set_random_seed(ctx, 5.0);
+    set_discretization_scheme(ctx, SCHEME_FULL_TRUNCATION);
+    set_payoff(ctx, style, option_type, BARRIER_DOWN_OUT, 0.0);
+    initialize_simulation(ctx, 100.0, 0.06, 0.05, 0.08, 1.0, 0.3, -0.3, 1.0, 100.0, TEST_STEPS);
+    if (calibrate_heston(ctx, quotes, num_quotes, mc_paths, out_result) < 0) {
+        printf("FAIL calibration (style %d, type %d, %d paths) returned an error\n",
+               style, option_type, mc_paths);
+        failures++;
+    }
+    heston_destroy_context(ctx);
+}
+
+static void check_calibration(void) {
+    static const char *names[CALIB_PARAMS] = {"v0", "theta", "kappa", "xi", "rho"};
+    static const double generating[CALIB_PARAMS] = {CAL_V0, CAL_THETA, CAL_KAPPA, CAL_XI, CAL_RHO};
+    char what[96];
+    double exact[CALIB_PARAMS + 1], call[CALIB_PARAMS + 1], put[CALIB_PARAMS + 1];
+
+    // The analytic fit reproduces the generating model
+    calibrate(PAYOFF_EUROPEAN, OPTION_CALL, 0, exact);
+    for (int i = 0; i < CALIB_PARAMS; i++) {
+        snprintf(what, sizeof what, "analytic calibration %s", names[i]);
+        check_close(what, exact[i], generating[i], 1e-3 * fmax(1.0, fabs(generating[i])));
+    }
+    check_close("analytic calibration RMS", exact[CALIB_PARAMS], 0.0, 1e-4);
+
+    // The Monte Carlo refinement only absorbs the discretization and sampling error, and
+    // fits calls even when the simulation is set to a put
+    calibrate(PAYOFF_EUROPEAN, OPTION_CALL, CAL_MC_PATHS, call);
+    calibrate(PAYOFF_EUROPEAN, OPTION_PUT, CAL_MC_PATHS, put);
+    check_close("Monte Carlo calibration RMS", call[CALIB_PARAMS], 0.0, 0.05);
+    check_close("Monte Carlo calibration v0", call[0], CAL_V0, 0.01);
+    check_close("Monte Carlo calibration theta", call[1], CAL_THETA, 0.02);
+    for (int i = 0; i <= CALIB_PARAMS; i++) {
+        snprintf(what, sizeof what, "put-payoff calibration %s", i < CALIB_PARAMS ? names[i] : "RMS");
+        check_close(what, put[i], call[i], 1e-9 * fmax(1.0, fabs(call[i])));
+    }
+}
+
+int main(void) {
+    check_prices();
+    check_calibration();
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}